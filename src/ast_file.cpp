@@ -0,0 +1,789 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "driver.cpp"
+#include "inputs.cpp"
+
+// Binary form of the parsed declarations, so tools and caches can take the tree without lexing the source.
+// The file is the header followed by the node, var, children and roots tables and the string table, every
+// entry 4 byte aligned so the reader walks a mapping of the file, turning it back into parser structures
+constexpr char ast_magic[4] = {'C', 'P', 'E', 'A'};
+constexpr u32 ast_version = 7;
+// Index or string offset that refers to nothing
+constexpr u32 ast_none = ~0u;
+
+struct AstFileHeader
+{
+    char magic[4];
+    u32 version;
+    u32 node_count;
+    u32 var_count;
+    u32 child_count;
+    u32 root_count;
+    u32 string_size;
+};
+
+// Children of a node are told apart by their kind: a Function holds its type parameters as
+// TypeDecls, parameters as Fields and body as Stmts, a TypeDecl its Fields, EnumValues and Constraints,
+// a Stmt its Expr and the reductions of a parallel For before its body. An Expr holds lhs and rhs when flagged, then the call arguments
+struct AstNode
+{
+    enum Kind { Function, TypeDecl, Field, EnumValue, Constraint, Stmt, Expr };
+    enum Flags { Constexpr = 1, Packed = 2, Reorder = 4, Soa = 8, Lhs = 16, Rhs = 32, Parallel = 64 };
+
+    u8 kind;
+    // Expr::Type, Stmt::Type, TypeDecl::Type or the Coroutine::Kind of a Function
+    u8 type;
+    // LexToken::Type of an Expr, the underlying VarType of a TypeDecl, the Bounds::Policy of a Function
+    u8 token;
+    u8 flags;
+    // Offset in the string table, names are null terminated there
+    u32 name;
+    // Index in the var table
+    u32 var;
+    // The VarType of a Constraint, the align of a TypeDecl or For, the line of a Function or While
+    u32 value;
+    u32 first_child;
+    u32 child_count;
+};
+
+// Modifiers take 2 bits and mutability 1 bit per level, outermost first
+constexpr u32 ast_max_levels = 16;
+
+struct AstVar
+{
+    u32 name;
+    u32 var_type;
+    // Node of the TypeDecl, ast_none for built-in types
+    u32 user_type;
+    u32 modifiers;
+    u32 is_mutable;
+    u16 modifier_count;
+    u16 mutable_count;
+};
+
+struct AstWriter
+{
+    std::vector<AstNode> nodes;
+    std::vector<AstVar> vars;
+    std::vector<u32> children;
+    std::vector<u32> roots;
+    std::string strings;
+    std::unordered_map<std::string, u32> string_offsets;
+    std::unordered_map<TypeDecl*, u32> type_nodes;
+    bool failed;
+};
+
+u32 ast_string(AstWriter& writer, const char* string, u64 size)
+{
+    std::string key(string, size);
+    auto existing = writer.string_offsets.find(key);
+    if (existing != writer.string_offsets.end())
+        return existing->second;
+
+    u32 offset = writer.strings.size();
+    writer.strings += key;
+    writer.strings += '\0';
+    writer.string_offsets.emplace(std::move(key), offset);
+    return offset;
+}
+
+u32 ast_name(AstWriter& writer, char* name)
+{
+    if (!name)
+        return ast_none;
+    auto string = buffer_string_ptr(name);
+    return ast_string(writer, string.content, string.size);
+}
+
+u32 ast_node(AstWriter& writer, AstNode::Kind kind)
+{
+    writer.nodes.push_back({.kind = (u8)kind, .name = ast_none, .var = ast_none});
+    return writer.nodes.size() - 1;
+}
+
+// Children are written after their parent, so the indices only ever grow going down the tree
+void ast_children(AstWriter& writer, u32 node, std::vector<u32>& children)
+{
+    writer.nodes[node].first_child = writer.children.size();
+    writer.nodes[node].child_count = children.size();
+    writer.children.insert(writer.children.end(), children.begin(), children.end());
+}
+
+u32 write_ast_type_decl(AstWriter& writer, TypeDecl* type_decl);
+u32 write_ast_expr(AstWriter& writer, Expr* expr);
+
+u32 write_ast_var(AstWriter& writer, Var& var)
+{
+    if (var.modifier.size() > ast_max_levels || var.is_mutable.size() > ast_max_levels)
+    {
+        fprintf(stderr, "%s: type nests deeper than %u levels\n", name_string(var.name).c_str(), ast_max_levels);
+        writer.failed = true;
+        return ast_none;
+    }
+
+    AstVar result = {.name = ast_name(writer, var.name), .var_type = (u32)var.var_type, .user_type = ast_none};
+    if (var.user_type)
+        result.user_type = write_ast_type_decl(writer, var.user_type);
+    result.modifier_count = var.modifier.size();
+    for (auto i = 0; i < var.modifier.size(); i++)
+    {
+        result.modifiers |= (u32)var.modifier[i] << i * 2;
+    }
+    result.mutable_count = var.is_mutable.size();
+    for (auto i = 0; i < var.is_mutable.size(); i++)
+    {
+        result.is_mutable |= (u32)var.is_mutable[i] << i;
+    }
+
+    writer.vars.push_back(result);
+    return writer.vars.size() - 1;
+}
+
+// Exprs and Stmts only carry a Var for some of their types, a default one isn't written
+bool has_var(Var& var)
+{
+    return var.name || var.user_type || var.var_type != VarType::Any || var.modifier.size() || var.is_mutable.size();
+}
+
+u32 write_ast_field(AstWriter& writer, Var& var)
+{
+    auto node = ast_node(writer, AstNode::Field);
+    auto index = write_ast_var(writer, var);
+    writer.nodes[node].var = index;
+    return node;
+}
+
+// Type declarations are shared by everything using them, each one is written once
+u32 write_ast_type_decl(AstWriter& writer, TypeDecl* type_decl)
+{
+    auto existing = writer.type_nodes.find(type_decl);
+    if (existing != writer.type_nodes.end())
+        return existing->second;
+
+    auto node = ast_node(writer, AstNode::TypeDecl);
+    writer.type_nodes[type_decl] = node;
+    writer.nodes[node].type = type_decl->type;
+    writer.nodes[node].name = ast_name(writer, type_decl->name);
+    writer.nodes[node].token = type_decl->underlying_type;
+    writer.nodes[node].value = type_decl->align;
+    writer.nodes[node].flags = (type_decl->packed ? AstNode::Packed : 0) | (type_decl->reorder ? AstNode::Reorder : 0) | (type_decl->soa ? AstNode::Soa : 0);
+
+    std::vector<u32> children;
+    for (auto& field: type_decl->fields)
+    {
+        children.push_back(write_ast_field(writer, field));
+    }
+    for (auto& value: type_decl->values)
+    {
+        auto value_node = ast_node(writer, AstNode::EnumValue);
+        writer.nodes[value_node].name = ast_name(writer, value.name);
+        if (value.value)
+        {
+            std::vector<u32> value_children = {write_ast_expr(writer, value.value)};
+            ast_children(writer, value_node, value_children);
+        }
+        children.push_back(value_node);
+    }
+    for (auto constraint: type_decl->constraints)
+    {
+        auto constraint_node = ast_node(writer, AstNode::Constraint);
+        writer.nodes[constraint_node].value = constraint;
+        children.push_back(constraint_node);
+    }
+    ast_children(writer, node, children);
+    return node;
+}
+
+u32 write_ast_expr(AstWriter& writer, Expr* expr)
+{
+    auto node = ast_node(writer, AstNode::Expr);
+    writer.nodes[node].type = expr->type;
+    writer.nodes[node].token = expr->token.type;
+    if (expr->token.type == LexToken::Name || expr->token.type == LexToken::Number)
+        writer.nodes[node].name = ast_string(writer, expr->token.name, expr->token.string_size);
+    if (has_var(expr->dest_var))
+    {
+        auto var = write_ast_var(writer, expr->dest_var);
+        writer.nodes[node].var = var;
+    }
+
+    std::vector<u32> children;
+    if (expr->lhs)
+    {
+        writer.nodes[node].flags |= AstNode::Lhs;
+        children.push_back(write_ast_expr(writer, expr->lhs));
+    }
+    if (expr->rhs)
+    {
+        writer.nodes[node].flags |= AstNode::Rhs;
+        children.push_back(write_ast_expr(writer, expr->rhs));
+    }
+    for (auto arg: expr->args)
+    {
+        children.push_back(write_ast_expr(writer, arg));
+    }
+    ast_children(writer, node, children);
+    return node;
+}
+
+u32 write_ast_stmt(AstWriter& writer, Stmt* stmt)
+{
+    auto node = ast_node(writer, AstNode::Stmt);
+    writer.nodes[node].type = stmt->type;
+    writer.nodes[node].value = stmt->type == Stmt::While ? stmt->line_num : stmt->align;
+    writer.nodes[node].flags = (stmt->is_constexpr ? AstNode::Constexpr : 0) | (stmt->is_parallel ? AstNode::Parallel : 0);
+    if (has_var(stmt->var))
+    {
+        auto var = write_ast_var(writer, stmt->var);
+        writer.nodes[node].var = var;
+    }
+
+    std::vector<u32> children;
+    if (stmt->expr)
+        children.push_back(write_ast_expr(writer, stmt->expr));
+    for (auto reduction: stmt->reductions)
+    {
+        children.push_back(write_ast_expr(writer, reduction));
+    }
+    for (auto body_stmt: stmt->body)
+    {
+        children.push_back(write_ast_stmt(writer, body_stmt));
+    }
+    ast_children(writer, node, children);
+    return node;
+}
+
+u32 write_ast_function(AstWriter& writer, Function& function)
+{
+    auto node = ast_node(writer, AstNode::Function);
+    writer.nodes[node].name = ast_name(writer, function.name);
+    writer.nodes[node].flags = function.is_constexpr ? AstNode::Constexpr : 0;
+    writer.nodes[node].value = function.line_num;
+    writer.nodes[node].token = function.bounds;
+    writer.nodes[node].type = function.coroutine;
+
+    std::vector<u32> children;
+    for (auto type_param: function.type_params)
+    {
+        children.push_back(write_ast_type_decl(writer, type_param));
+    }
+    auto return_type = write_ast_var(writer, function.return_type);
+    writer.nodes[node].var = return_type;
+    for (auto& param: function.params)
+    {
+        children.push_back(write_ast_field(writer, param));
+    }
+    for (auto stmt: function.body)
+    {
+        children.push_back(write_ast_stmt(writer, stmt));
+    }
+    ast_children(writer, node, children);
+    return node;
+}
+
+template <typename T>
+void append_table(std::string& output, const std::vector<T>& table)
+{
+    output.append((const char*)table.data(), table.size() * sizeof(T));
+}
+
+ErrorOr<std::string> serialize_ast(std::vector<TopLevelDecl>& declarations)
+{
+    AstWriter writer = {};
+    for (auto& declaration: declarations)
+    {
+        if (declaration.type == TopLevelDecl::Function)
+            writer.roots.push_back(write_ast_function(writer, declaration.function));
+        else if (declaration.type == TopLevelDecl::TypeDecl)
+            writer.roots.push_back(write_ast_type_decl(writer, declaration.type_decl));
+        else
+            writer.roots.push_back(write_ast_stmt(writer, declaration.stmt));
+    }
+    if (writer.failed)
+        return {};
+
+    AstFileHeader header = {
+        .version = ast_version,
+        .node_count = (u32)writer.nodes.size(),
+        .var_count = (u32)writer.vars.size(),
+        .child_count = (u32)writer.children.size(),
+        .root_count = (u32)writer.roots.size(),
+        .string_size = (u32)writer.strings.size(),
+    };
+    memcpy(header.magic, ast_magic, sizeof(ast_magic));
+
+    std::string output((const char*)&header, sizeof(header));
+    append_table(output, writer.nodes);
+    append_table(output, writer.vars);
+    append_table(output, writer.children);
+    append_table(output, writer.roots);
+    output += writer.strings;
+    return output;
+}
+
+// A mapped AST file, the tables point straight into the view
+struct AstFile
+{
+    HANDLE handle;
+    Buffer view;
+    const AstFileHeader* header;
+    const AstNode* nodes;
+    const AstVar* vars;
+    const u32* children;
+    const u32* roots;
+    const char* strings;
+};
+
+void unmap_ast_file(AstFile& file)
+{
+    close_file_view({.handle = file.handle, .buffer = file.view});
+}
+
+bool ast_name_valid(const AstFile& file, u32 name)
+{
+    return name == ast_none || name < file.header->string_size;
+}
+
+// Kinds a node of the given kind may hold, in the order read_ast_* expects them
+bool ast_child_allowed(AstNode::Kind parent, AstNode::Kind child)
+{
+    switch (parent)
+    {
+        case AstNode::Function:
+            return child == AstNode::TypeDecl || child == AstNode::Field || child == AstNode::Stmt;
+        case AstNode::TypeDecl:
+            return child == AstNode::Field || child == AstNode::EnumValue || child == AstNode::Constraint;
+        case AstNode::EnumValue:
+        case AstNode::Expr:
+            return child == AstNode::Expr;
+        case AstNode::Stmt:
+            return child == AstNode::Expr || child == AstNode::Stmt;
+        default:
+            return false;
+    }
+}
+
+bool ast_var_named(const AstFile& file, u32 var)
+{
+    return var != ast_none && file.vars[var].name != ast_none;
+}
+
+// The parts of an Expr the backend takes for granted for its type
+bool ast_expr_valid(const AstFile& file, const AstNode& node)
+{
+    if (node.type > Expr::New || node.token > LexToken::TypeName)
+        return false;
+
+    auto lhs = (node.flags & AstNode::Lhs) != 0;
+    auto rhs = (node.flags & AstNode::Rhs) != 0;
+    if (lhs + rhs > node.child_count)
+        return false;
+    switch (node.type)
+    {
+        case Expr::Number:
+        case Expr::Name:
+        case Expr::Call:
+            return node.name != ast_none;
+        case Expr::Paren:
+        case Expr::Unary:
+        case Expr::Range:
+        case Expr::Await:
+            return rhs;
+        case Expr::Binary:
+        case Expr::Index:
+            return lhs && rhs;
+        case Expr::VarInit:
+            return rhs && ast_var_named(file, node.var);
+        case Expr::Elements:
+        {
+            if (!ast_var_named(file, node.var))
+                return false;
+            auto& var = file.vars[node.var];
+            return var.modifier_count && (var.modifiers & 3) == Var::Array && var.mutable_count;
+        }
+        case Expr::New:
+        {
+            if (!lhs || node.var == ast_none)
+                return false;
+            // The allocated element is the var without its outermost level
+            auto& var = file.vars[node.var];
+            return var.modifier_count && var.mutable_count > 1;
+        }
+    }
+    return true;
+}
+
+// The expression a Stmt of this type can't go without. Exprs after the first are the reductions of a parallel For,
+// each an update without a right side of a named outer variable, and are marked so they aren't taken for a Binary
+bool ast_stmt_valid(const AstFile& file, const AstNode& node, std::vector<bool>& reductions)
+{
+    if (node.type > Stmt::Yield)
+        return false;
+
+    u32 exprs = 0;
+    const AstNode* walked = 0;
+    for (u32 j = 0; j < node.child_count; j++)
+    {
+        auto index = file.children[node.first_child + j];
+        auto& child = file.nodes[index];
+        if (child.kind == AstNode::Expr && !exprs)
+            walked = &child;
+        if (child.kind != AstNode::Expr || !exprs++)
+            continue;
+        if (child.type != Expr::Binary || child.flags != AstNode::Lhs || child.child_count != 1 || !is_assignment((LexToken::Type)child.token))
+            return false;
+        auto& name = file.nodes[file.children[child.first_child]];
+        if (name.type != Expr::Name)
+            return false;
+        reductions[index] = true;
+    }
+    switch (node.type)
+    {
+        case Stmt::VarDecl:
+            return ast_var_named(file, node.var);
+        case Stmt::For:
+        {
+            if (!exprs || !ast_var_named(file, node.var))
+                return false;
+            // A parallel for walks a range or an array, any other one an array or a generator's call
+            if (walked->type == Expr::Name)
+                return ast_var_named(file, walked->var) && file.vars[walked->var].modifier_count && (file.vars[walked->var].modifiers & 3) == Var::Array;
+            return walked->type == (node.flags & AstNode::Parallel ? Expr::Range : Expr::Call);
+        }
+        case Stmt::While:
+        case Stmt::Expression:
+        case Stmt::Yield:
+            return exprs;
+    }
+    return true;
+}
+
+// Checks every index, enum value and child the tree relies on once, so walking the tree afterwards can't leave
+// the mapping, loop or reach for a part a node doesn't have. Apart from the TypeDecls, which the reader turns
+// into a parser structure once however often they're used, a node has one parent or is one root, so the walk
+// takes as many steps as the file has nodes
+bool validate_ast_file(const AstFile& file)
+{
+    auto& header = *file.header;
+    if (header.string_size && file.strings[header.string_size - 1] != '\0')
+        return false;
+
+    for (u32 i = 0; i < header.var_count; i++)
+    {
+        auto& var = file.vars[i];
+        if (!ast_name_valid(file, var.name) || var.var_type >= std::size(var_types))
+            return false;
+        if (var.user_type != ast_none && (var.user_type >= header.node_count || file.nodes[var.user_type].kind != AstNode::TypeDecl))
+            return false;
+        // Every level has its mutability, the value itself included
+        if (var.modifier_count > ast_max_levels || var.mutable_count != var.modifier_count + 1)
+            return false;
+        for (u32 j = 0; j < var.modifier_count; j++)
+        {
+            if ((var.modifiers >> j * 2 & 3) > Var::Array)
+                return false;
+        }
+    }
+
+    std::vector<bool> parented(header.node_count);
+    auto take_parent = [&](u32 index)
+    {
+        if (file.nodes[index].kind == AstNode::TypeDecl)
+            return true;
+        if (parented[index])
+            return false;
+        parented[index] = true;
+        return true;
+    };
+
+    for (u32 i = 0; i < header.node_count; i++)
+    {
+        auto& node = file.nodes[i];
+        if (node.kind > AstNode::Expr || !ast_name_valid(file, node.name))
+            return false;
+        if (node.var != ast_none && node.var >= header.var_count)
+            return false;
+        if (node.kind == AstNode::Constraint && node.value >= std::size(var_types))
+            return false;
+        if (node.kind == AstNode::TypeDecl && (node.token >= std::size(var_types) || node.type > TypeDecl::Arena))
+            return false;
+        if (node.kind == AstNode::Function && (node.token >= Bounds::PolicyCount || node.type > Coroutine::Generator || node.name == ast_none))
+            return false;
+        if (node.kind == AstNode::Field && node.var == ast_none)
+            return false;
+        if (node.first_child > header.child_count || node.child_count > header.child_count - node.first_child)
+            return false;
+        for (u32 j = 0; j < node.child_count; j++)
+        {
+            auto child = file.children[node.first_child + j];
+            if (child <= i || child >= header.node_count || !ast_child_allowed((AstNode::Kind)node.kind, (AstNode::Kind)file.nodes[child].kind) || !take_parent(child))
+                return false;
+        }
+    }
+
+    // Children are only looked into once they're known to be in the file. A Stmt comes before its reductions
+    std::vector<bool> reductions(header.node_count);
+    for (u32 i = 0; i < header.node_count; i++)
+    {
+        auto& node = file.nodes[i];
+        if (node.kind == AstNode::Expr && !reductions[i] && !ast_expr_valid(file, node))
+            return false;
+        if (node.kind == AstNode::Stmt && !ast_stmt_valid(file, node, reductions))
+            return false;
+    }
+
+    for (u32 i = 0; i < header.root_count; i++)
+    {
+        if (file.roots[i] >= header.node_count || !take_parent(file.roots[i]))
+            return false;
+    }
+    return true;
+}
+
+ErrorOr<AstFile> map_ast_file(const wchar_t* file_path)
+{
+    auto file_view = create_ro_file_view(file_path);
+    if (!file_view.buffer.content)
+        return {};
+
+    AstFile file = {.handle = file_view.handle, .view = file_view.buffer};
+    auto fail = [&]() -> ErrorOr<AstFile>
+    {
+        fprintf(stderr, "%ls: not a valid AST file\n", file_path);
+        unmap_ast_file(file);
+        return {};
+    };
+
+    if (file.view.size < sizeof(AstFileHeader))
+        return fail();
+    file.header = (const AstFileHeader*)file.view.content;
+    auto& header = *file.header;
+    if (memcmp(header.magic, ast_magic, sizeof(ast_magic)) != 0 || header.version != ast_version)
+        return fail();
+
+    u64 size = sizeof(AstFileHeader) + (u64)header.node_count * sizeof(AstNode) + (u64)header.var_count * sizeof(AstVar) + ((u64)header.child_count + header.root_count) * sizeof(u32) + header.string_size;
+    if (size != file.view.size)
+        return fail();
+
+    file.nodes = (const AstNode*)(file.header + 1);
+    file.vars = (const AstVar*)(file.nodes + header.node_count);
+    file.children = (const u32*)(file.vars + header.var_count);
+    file.roots = file.children + header.child_count;
+    file.strings = (const char*)(file.roots + header.root_count);
+    if (!validate_ast_file(file))
+        return fail();
+    return file;
+}
+
+// Turns a mapped file back into the parser's structures for the backend. Names keep pointing into the mapping
+struct AstReader
+{
+    const AstFile& file;
+    std::unordered_map<u32, TypeDecl*> type_decls;
+};
+
+char* read_ast_string(const AstReader& reader, u32 name)
+{
+    return name == ast_none ? 0 : (char*)reader.file.strings + name;
+}
+
+std::span<const u32> read_ast_children(const AstReader& reader, const AstNode& node)
+{
+    return {reader.file.children + node.first_child, node.child_count};
+}
+
+TypeDecl* read_ast_type_decl(AstReader& reader, u32 index);
+Expr* read_ast_expr(AstReader& reader, u32 index);
+
+Var read_ast_var(AstReader& reader, u32 index)
+{
+    Var result = {.var_type = VarType::Any};
+    if (index == ast_none)
+        return result;
+
+    auto& var = reader.file.vars[index];
+    result.name = read_ast_string(reader, var.name);
+    result.var_type = (VarType)var.var_type;
+    if (var.user_type != ast_none)
+        result.user_type = read_ast_type_decl(reader, var.user_type);
+    for (auto i = 0; i < var.modifier_count; i++)
+    {
+        result.modifier.push_back((Var::Modifier)(var.modifiers >> i * 2 & 3));
+    }
+    for (auto i = 0; i < var.mutable_count; i++)
+    {
+        result.is_mutable.push_back(var.is_mutable >> i & 1);
+    }
+    return result;
+}
+
+TypeDecl* read_ast_type_decl(AstReader& reader, u32 index)
+{
+    auto existing = reader.type_decls.find(index);
+    if (existing != reader.type_decls.end())
+        return existing->second;
+
+    auto& node = reader.file.nodes[index];
+    // The declarations read from a file go with it, unlike the parsed ones
+    auto type_decl = new_node<TypeDecl>();
+    reader.type_decls[index] = type_decl;
+    type_decl->type = (TypeDecl::Type)node.type;
+    type_decl->name = read_ast_string(reader, node.name);
+    type_decl->underlying_type = (VarType)node.token;
+    type_decl->align = node.value;
+    type_decl->packed = node.flags & AstNode::Packed;
+    type_decl->reorder = node.flags & AstNode::Reorder;
+    type_decl->soa = node.flags & AstNode::Soa;
+    for (auto child: read_ast_children(reader, node))
+    {
+        auto& child_node = reader.file.nodes[child];
+        if (child_node.kind == AstNode::Field)
+        {
+            type_decl->fields.push_back(read_ast_var(reader, child_node.var));
+        }
+        else if (child_node.kind == AstNode::EnumValue)
+        {
+            auto value = read_ast_children(reader, child_node);
+            type_decl->values.push_back({read_ast_string(reader, child_node.name), value.empty() ? 0 : read_ast_expr(reader, value[0])});
+        }
+        else if (child_node.kind == AstNode::Constraint)
+        {
+            type_decl->constraints.push_back((VarType)child_node.value);
+        }
+    }
+    return type_decl;
+}
+
+Expr* read_ast_expr(AstReader& reader, u32 index)
+{
+    auto& node = reader.file.nodes[index];
+    auto expr = new_node<Expr>();
+    expr->type = (Expr::Type)node.type;
+    expr->token.type = (LexToken::Type)node.token;
+    if (node.name != ast_none)
+    {
+        expr->token.name = read_ast_string(reader, node.name);
+        expr->token.string_size = strlen(expr->token.name);
+    }
+    if (node.var != ast_none)
+        expr->dest_var = read_ast_var(reader, node.var);
+
+    auto children = read_ast_children(reader, node);
+    auto next = 0;
+    if (node.flags & AstNode::Lhs && next < children.size())
+        expr->lhs = read_ast_expr(reader, children[next++]);
+    if (node.flags & AstNode::Rhs && next < children.size())
+        expr->rhs = read_ast_expr(reader, children[next++]);
+    for (; next < children.size(); next++)
+    {
+        expr->args.push_back(read_ast_expr(reader, children[next]));
+    }
+    return expr;
+}
+
+Stmt* read_ast_stmt(AstReader& reader, u32 index)
+{
+    auto& node = reader.file.nodes[index];
+    auto stmt = new_node<Stmt>();
+    stmt->type = (Stmt::Type)node.type;
+    if (stmt->type == Stmt::While)
+        stmt->line_num = node.value;
+    else
+        stmt->align = node.value;
+    stmt->is_constexpr = node.flags & AstNode::Constexpr;
+    stmt->is_parallel = node.flags & AstNode::Parallel;
+    stmt->var = read_ast_var(reader, node.var);
+    for (auto child: read_ast_children(reader, node))
+    {
+        if (reader.file.nodes[child].kind == AstNode::Expr && !stmt->expr)
+            stmt->expr = read_ast_expr(reader, child);
+        else if (reader.file.nodes[child].kind == AstNode::Expr)
+            stmt->reductions.push_back(read_ast_expr(reader, child));
+        else if (reader.file.nodes[child].kind == AstNode::Stmt)
+            stmt->body.push_back(read_ast_stmt(reader, child));
+    }
+    return stmt;
+}
+
+Function read_ast_function(AstReader& reader, u32 index)
+{
+    auto& node = reader.file.nodes[index];
+    Function function = {};
+    function.name = read_ast_string(reader, node.name);
+    function.is_constexpr = node.flags & AstNode::Constexpr;
+    function.line_num = node.value;
+    function.bounds = (Bounds::Policy)node.token;
+    function.coroutine = (Coroutine::Kind)node.type;
+    function.return_type = read_ast_var(reader, node.var);
+    for (auto child: read_ast_children(reader, node))
+    {
+        auto& child_node = reader.file.nodes[child];
+        if (child_node.kind == AstNode::TypeDecl)
+            function.type_params.push_back(read_ast_type_decl(reader, child));
+        else if (child_node.kind == AstNode::Field)
+            function.params.push_back(read_ast_var(reader, child_node.var));
+        else if (child_node.kind == AstNode::Stmt)
+            function.body.push_back(read_ast_stmt(reader, child));
+    }
+    return function;
+}
+
+std::vector<TopLevelDecl> read_ast_declarations(const AstFile& file)
+{
+    AstReader reader = {.file = file};
+    std::vector<TopLevelDecl> declarations;
+    for (u32 i = 0; i < file.header->root_count; i++)
+    {
+        auto root = file.roots[i];
+        auto kind = file.nodes[root].kind;
+        if (kind == AstNode::Function)
+            declarations.push_back({.type = TopLevelDecl::Function, .function = read_ast_function(reader, root)});
+        else if (kind == AstNode::TypeDecl)
+            declarations.push_back({.type = TopLevelDecl::TypeDecl, .type_decl = read_ast_type_decl(reader, root)});
+        else if (kind == AstNode::Stmt)
+            declarations.push_back({.type = TopLevelDecl::Stmt, .stmt = read_ast_stmt(reader, root)});
+    }
+    return declarations;
+}
+
+// Parses the inputs as one program and writes their declarations to ast_path instead of C++
+int write_ast(const wchar_t* ast_path, std::vector<std::wstring>& inputs)
+{
+    std::vector<TopLevelDecl> declarations;
+    std::vector<Buffer> file_buffers;
+    auto parsed = parse_inputs(inputs, declarations, file_buffers);
+
+    auto error = serialize_ast(declarations);
+    release_nodes();
+    for (auto& file_buffer: file_buffers)
+    {
+        free_file_buffer(file_buffer);
+    }
+    if (!parsed || error.error)
+        return 1;
+    return !write_file_atomically(ast_path, {.content = error.content.data(), .size = error.content.size()});
+}
+
+// Prints the C++ for a file written by write_ast, nothing gets lexed or parsed
+int compile_ast(const wchar_t* ast_path)
+{
+    auto error = map_ast_file(ast_path);
+    if (error.error)
+        return 1;
+    auto file = error.content;
+
+    auto output = output_preamble();
+    // Declarations don't remember which input they came from
+    instrument_source = wide_to_utf8(ast_path);
+    for (auto& declaration: read_ast_declarations(file))
+    {
+        output += with_runtimes(emit_top_level(declaration));
+    }
+    release_nodes();
+    unmap_ast_file(file);
+    fwrite(output.data(), 1, output.size(), stdout);
+    return 0;
+}
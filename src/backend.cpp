@@ -0,0 +1,2531 @@
+#pragma once
+#include <algorithm>
+#include <unordered_set>
+
+#include "parser.cpp"
+#include "profile.cpp"
+
+// Set once an emitted type names an arena, and once the output being written has the arena runtime
+bool arenas_emitted;
+bool arena_runtime_emitted;
+
+std::string recurse_var(Var return_type, int i)
+{
+    assert(i < return_type.is_mutable.size());
+    auto possible_const = !return_type.is_mutable[i] ? " const" : "";
+
+    if (return_type.var_type == VarType::Any && !return_type.user_type)
+    {
+        return std::format("auto{}", possible_const);
+    }
+
+    if (i < return_type.modifier.size() && return_type.modifier[i] == Var::Modifier::Array)
+    {
+        return std::format("std::span<{}>{}", recurse_var(return_type, ++i), possible_const);
+    }
+    else if (i < return_type.modifier.size() && return_type.modifier[i] == Var::Modifier::Ptr)
+    {
+        return std::format("{}*{}", recurse_var(return_type, ++i), possible_const);
+    }
+    else if (return_type.user_type && return_type.user_type->type == TypeDecl::Generic && return_type.user_type->underlying_type) {
+        return std::format("{}{}", var_types[return_type.user_type->underlying_type], possible_const);
+    }
+    else if (return_type.user_type && return_type.user_type->type == TypeDecl::Arena) {
+        arenas_emitted = true;
+        return std::format("cpec_arena{}", possible_const);
+    }
+    else if (return_type.user_type) {
+        return std::format("{}{}", name_string(return_type.user_type->name), possible_const);
+    }
+    else {
+        return std::format("{}{}", var_types[return_type.var_type], possible_const);
+    }
+}
+
+struct Layout {
+    u64 size;
+    u64 align;
+};
+
+Layout type_layout(TypeDecl* type_decl);
+
+// Sizes as the generated C++ will see them on a 64-bit target
+Layout var_layout(Var var, int i)
+{
+    if (i < var.modifier.size())
+    {
+        // std::span is a pointer and a size
+        return var.modifier[i] == Var::Array ? Layout{16, 8} : Layout{8, 8};
+    }
+    if (var.user_type)
+    {
+        return type_layout(var.user_type);
+    }
+
+    return {var_type_sizes[var.var_type], var_type_aligns[var.var_type]};
+}
+
+u64 align_up(u64 offset, u64 align)
+{
+    return (offset + align - 1) & ~(align - 1);
+}
+
+// Sorting by decreasing alignment leaves no padding between fields when every size is a multiple of its alignment
+std::vector<Var> layout_fields(TypeDecl* type_decl)
+{
+    auto fields = type_decl->fields;
+    if (type_decl->reorder && !type_decl->packed)
+    {
+        std::stable_sort(fields.begin(), fields.end(), [](const Var& a, const Var& b) { return var_layout(a, 0).align > var_layout(b, 0).align; });
+    }
+    return fields;
+}
+
+Layout type_layout(TypeDecl* type_decl)
+{
+    if (type_decl->type == TypeDecl::Enum)
+    {
+        Var underlying = {.var_type = type_decl->underlying_type ? type_decl->underlying_type : VarType::I32};
+        return var_layout(underlying, 0);
+    }
+
+    Layout layout = {0, 1};
+    for (auto field: layout_fields(type_decl))
+    {
+        auto field_layout = var_layout(field, 0);
+        auto field_align = type_decl->packed ? 1 : field_layout.align;
+        if (type_decl->type == TypeDecl::Union)
+        {
+            layout.size = std::max(layout.size, field_layout.size);
+        }
+        else
+        {
+            layout.size = align_up(layout.size, field_align) + field_layout.size;
+        }
+        layout.align = std::max(layout.align, field_align);
+    }
+    layout.align = std::max(layout.align, (u64)type_decl->align);
+    layout.size = align_up(layout.size, layout.align);
+    return layout;
+}
+
+const char* operator_string(LexToken::Type type)
+{
+    switch (type)
+    {
+        case LexToken::Assign: return "=";
+        case LexToken::PlusAssign: return "+=";
+        case LexToken::MinusAssign: return "-=";
+        case LexToken::MultiplyAssign: return "*=";
+        case LexToken::DivideAssign: return "/=";
+        case LexToken::Or: return "||";
+        case LexToken::And: return "&&";
+        case LexToken::Equal: return "==";
+        case LexToken::NotEqual: return "!=";
+        case LexToken::LessThen: return "<";
+        case LexToken::BiggerThen: return ">";
+        case LexToken::LessEqual: return "<=";
+        case LexToken::BiggerEqual: return ">=";
+        case LexToken::Plus: return "+";
+        case LexToken::Minus: return "-";
+        case LexToken::Multiply: return "*";
+        case LexToken::Divide: return "/";
+        case LexToken::Modulo: return "%";
+        case LexToken::Not: return "!";
+        default: assert(false); return "";
+    }
+}
+
+std::string indentation(int indent)
+{
+    return std::string(indent * 4, ' ');
+}
+
+std::string c_string_literal(std::string_view string)
+{
+    std::string out = "\"";
+    for (auto c: string)
+    {
+        if (c == '\\' || c == '"')
+            out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+// Set by --instrument, every function then counts its calls and cycles for the profile printed at exit
+bool instrument_functions;
+// Source file the functions being emitted come from, as the profile names it
+std::string instrument_source;
+// Set while emitting the body of an instrumented function, its whiles count their iterations
+bool instrumenting_body;
+// Numbers the while sites of a file
+u32 instrumented_loops;
+
+// Set by --bounds, how functions that don't pick for themselves check their indices
+Bounds::Policy bounds_policy = Bounds::Debug;
+// What the function being emitted picked, Default outside of functions
+Bounds::Policy function_bounds;
+// Set once an emitted index calls into the bounds runtime
+bool bounds_checks_emitted;
+// Set once the output being written has the bounds runtime, from the prelude header or from an earlier declaration
+bool bounds_runtime_emitted;
+// Indices a while checked ahead of itself, they go unchecked in the loop
+std::unordered_set<Expr*> prechecked_indices;
+
+// Set once a parallel for is emitted, and once the output being written has the parallel runtime
+bool parallel_loops_emitted;
+bool parallel_runtime_emitted;
+
+// What the function being emitted is, a coroutine returns with co_return
+Coroutine::Kind function_coroutine;
+// Set once an async or generator function is emitted, and once the output being written has the coroutine runtime
+bool coroutines_emitted;
+bool coroutine_runtime_emitted;
+
+Bounds::Policy current_bounds()
+{
+    return function_bounds ? function_bounds : bounds_policy;
+}
+
+// [[likely]] on the body of a while that usually goes around again, [[unlikely]] on one that never ran, per --profile-use
+std::string loop_body_hint(Stmt* stmt)
+{
+    if (!profile.loaded)
+        return "";
+    auto counts = profile.loops.find(profile_loop_key(instrument_source, stmt->line_num));
+    if (counts == profile.loops.end() || !counts->second.calls)
+        return "";
+    if (!counts->second.iterations)
+        return "[[unlikely]]";
+    if (counts->second.iterations >= 2 * counts->second.calls)
+        return "[[likely]]";
+    return "";
+}
+
+// Pure subexpressions a statement writes more than once, and its immutable bindings repeating an earlier one.
+// The first occurrence of each subexpression is hoisted into a temporary the others read
+struct CommonExprs
+{
+    // Occurrence to its slot in temporaries, every occurrence of the same subexpression shares one
+    std::unordered_map<Expr*, u32> repeated;
+    // Filled in as the first occurrences are emitted
+    std::vector<std::string> temporaries;
+    // Binding to the earlier one with the same type and value
+    std::unordered_map<Expr*, Expr*> rebindings;
+};
+
+// Set while emit_expr emits the expression of a statement
+CommonExprs* common_exprs;
+// Numbers the temporaries, those of a statement share the scope with others
+u32 common_expr_temporaries;
+
+// let/mut bindings inside an expression are declared into hoisted, ahead of the statement using them
+std::string recurse_expr(Expr* expr, std::string& hoisted, int indent)
+{
+    if (common_exprs)
+    {
+        auto found = common_exprs->repeated.find(expr);
+        if (found != common_exprs->repeated.end())
+        {
+            auto& temporary = common_exprs->temporaries[found->second];
+            if (!temporary.empty())
+                return temporary;
+
+            // The first occurrence, emitted as it is once it's no longer repeated
+            auto slot = found->second;
+            common_exprs->repeated.erase(found);
+            auto value = recurse_expr(expr, hoisted, indent);
+            auto name = std::format("cpec_cse_{}", common_expr_temporaries++);
+            hoisted += std::format("{}auto const {} = {};\n", indentation(indent), name, value);
+            common_exprs->temporaries[slot] = name;
+            return name;
+        }
+    }
+
+    switch (expr->type)
+    {
+        case Expr::Number:
+        case Expr::Name:
+            return std::string(expr->token.name, expr->token.string_size);
+        case Expr::Paren:
+        {
+            // Nested parens are wrapped all at once, one level at a time copies the inside once per level
+            auto depth = 0;
+            for (; expr->type == Expr::Paren; expr = expr->rhs)
+            {
+                depth++;
+            }
+            auto out = std::string(depth, '(');
+            out += recurse_expr(expr, hoisted, indent);
+            out.append(depth, ')');
+            return out;
+        }
+        case Expr::Unary:
+            return std::format("{}{}", operator_string(expr->token.type), recurse_expr(expr->rhs, hoisted, indent));
+        case Expr::Binary:
+        {
+            auto lhs = recurse_expr(expr->lhs, hoisted, indent);
+            auto rhs = recurse_expr(expr->rhs, hoisted, indent);
+            return std::format("{} {} {}", lhs, operator_string(expr->token.type), rhs);
+        }
+        case Expr::Call:
+        {
+            std::string args;
+            for (auto j = 0; j < expr->args.size(); j++)
+            {
+                if (j) args += ", ";
+                args += recurse_expr(expr->args[j], hoisted, indent);
+            }
+            return std::format("{}({})", std::string(expr->token.name, expr->token.string_size), args);
+        }
+        case Expr::Elements:
+            return std::format("cpec_{}[cpec_i]", name_string(expr->dest_var.name));
+        case Expr::Index:
+        {
+            auto array = recurse_expr(expr->lhs, hoisted, indent);
+            auto index = recurse_expr(expr->rhs, hoisted, indent);
+            auto policy = prechecked_indices.contains(expr) ? Bounds::Unchecked : current_bounds();
+            if (policy == Bounds::Unchecked)
+                return std::format("{}.data()[{}]", array, index);
+            bounds_checks_emitted = true;
+            return std::format("{}({}, {})", policy == Bounds::Checked ? "cpec_checked_at" : "cpec_debug_at", array, index);
+        }
+        case Expr::VarInit:
+        {
+            auto var_name = name_string(expr->dest_var.name);
+            if (common_exprs && common_exprs->rebindings.contains(expr))
+            {
+                // Under the same name the earlier declaration already is this one
+                auto earlier_name = name_string(common_exprs->rebindings[expr]->dest_var.name);
+                if (earlier_name != var_name)
+                    hoisted += std::format("{}{} {} = {};\n", indentation(indent), recurse_var(expr->dest_var, 0), var_name, earlier_name);
+                return var_name;
+            }
+            auto expr_out = recurse_expr(expr->rhs, hoisted, indent);
+            hoisted += std::format("{}{} {} = {};\n", indentation(indent), recurse_var(expr->dest_var, 0), var_name, expr_out);
+            return var_name;
+        }
+        case Expr::Range:
+            // Only the walk of a parallel for, emit_parallel_for emits its ends
+            return "";
+        case Expr::Await:
+            return std::format("co_await {}", recurse_expr(expr->rhs, hoisted, indent));
+        case Expr::New:
+        {
+            // The runtime hands out mut elements, a span or pointer of const ones takes them as well
+            auto element = expr->dest_var;
+            element.modifier.erase(element.modifier.begin());
+            element.is_mutable.erase(element.is_mutable.begin());
+            element.is_mutable[0] = true;
+            auto arena = recurse_expr(expr->lhs, hoisted, indent);
+            arenas_emitted = true;
+            if (expr->rhs)
+                return std::format("cpec_arena_array<{}>({}, {})", recurse_var(element, 0), arena, recurse_expr(expr->rhs, hoisted, indent));
+            return std::format("cpec_arena_new<{}>({})", recurse_var(element, 0), arena);
+        }
+    }
+    return "";
+}
+
+std::string emit_block(std::vector<Stmt*>& body, int indent, const std::string& prefix = "");
+std::string emit_stmt(Stmt* stmt, int indent);
+
+// omp simd is only a safe promise for plain numeric elements
+bool simd_element(Var element)
+{
+    if (element.modifier.size())
+        return false;
+    if (element.user_type)
+        return element.user_type->type == TypeDecl::Generic;
+    return element.var_type != VarType::Any;
+}
+
+struct SimdLoop {
+    bool safe;
+    std::vector<std::string> locals;
+    // Outer variables only ever updated with += -= or *=, keyed by name with the reduction operator
+    std::vector<std::pair<std::string, char>> reductions;
+};
+
+void simd_check_expr(Expr* expr, SimdLoop& loop)
+{
+    if (!expr)
+        return;
+    if (expr->type == Expr::Call || expr->type == Expr::Index || expr->type == Expr::Await || expr->type == Expr::New)
+    {
+        // Calls may carry side effects from one iteration to the next, and an index may reach another iteration's element
+        loop.safe = false;
+        return;
+    }
+    if (expr->type == Expr::VarInit)
+    {
+        loop.locals.push_back(name_string(expr->dest_var.name));
+    }
+    if (expr->type == Expr::Binary && is_assignment(expr->token.type) && expr->lhs->type == Expr::Name)
+    {
+        auto name = std::string(expr->lhs->token.name, expr->lhs->token.string_size);
+        if (std::find(loop.locals.begin(), loop.locals.end(), name) == loop.locals.end())
+        {
+            auto reduction = expr->token.type == LexToken::PlusAssign || expr->token.type == LexToken::MinusAssign ? '+' : expr->token.type == LexToken::MultiplyAssign ? '*' : 0;
+            auto found = std::find_if(loop.reductions.begin(), loop.reductions.end(), [&](auto& entry) { return entry.first == name; });
+            if (!reduction || found != loop.reductions.end() && found->second != reduction)
+                loop.safe = false;
+            else if (found == loop.reductions.end())
+                loop.reductions.push_back({name, reduction});
+        }
+    }
+    simd_check_expr(expr->lhs, loop);
+    simd_check_expr(expr->rhs, loop);
+    for (auto arg: expr->args)
+    {
+        simd_check_expr(arg, loop);
+    }
+}
+
+void simd_check_body(std::vector<Stmt*>& body, SimdLoop& loop)
+{
+    for (auto stmt: body)
+    {
+        if (stmt->type == Stmt::Return || stmt->type == Stmt::Yield)
+        {
+            loop.safe = false;
+        }
+        simd_check_expr(stmt->expr, loop);
+        if (stmt->type == Stmt::VarDecl || stmt->type == Stmt::For)
+        {
+            loop.locals.push_back(name_string(stmt->var.name));
+        }
+        simd_check_body(stmt->body, loop);
+    }
+}
+
+std::string simd_pragma(SimdLoop& loop, int indent)
+{
+    if (!loop.safe)
+        return "";
+
+    std::string reductions;
+    for (auto [name, reduction]: loop.reductions)
+    {
+        reductions += std::format(" reduction({}:{})", reduction, name);
+    }
+    return std::format("{}#pragma omp simd{}\n", indentation(indent), reductions);
+}
+
+std::string emit_array_data(Var array, int align, int indent)
+{
+    auto array_name = name_string(array.name);
+    auto data = std::format("{}.data()", array_name);
+    if (align)
+    {
+        data = std::format("std::assume_aligned<{}>({})", align, data);
+    }
+    return std::format("{}auto* cpec_{} = {};\n", indentation(indent), array_name, data);
+}
+
+std::string emit_for(Stmt* stmt, int indent)
+{
+    auto array = stmt->expr->dest_var;
+    auto array_name = name_string(array.name);
+    auto var_name = name_string(stmt->var.name);
+
+    SimdLoop loop = {.safe = simd_element(stmt->var)};
+    loop.locals.push_back(var_name);
+    simd_check_body(stmt->body, loop);
+
+    // A mut element is a reference so writes go straight to the array
+    auto element = stmt->var;
+    auto reference = element.is_mutable[0] ? "&" : "";
+
+    std::string out = std::format("{}{{\n", indentation(indent));
+    out += emit_array_data(array, stmt->align, indent + 1);
+    out += simd_pragma(loop, indent + 1);
+    out += std::format("{}for (u64 {}_i = 0; {}_i < {}.size(); {}_i++)\n", indentation(indent + 1), var_name, var_name, array_name, var_name);
+    out += std::format("{}{{\n", indentation(indent + 1));
+    out += std::format("{}{}{} {} = cpec_{}[{}_i];\n", indentation(indent + 2), recurse_var(element, 0), reference, var_name, array_name, var_name);
+    for (auto body_stmt: stmt->body)
+    {
+        out += emit_stmt(body_stmt, indent + 2);
+    }
+    out += std::format("{}}}\n", indentation(indent + 1));
+    out += std::format("{}}}\n", indentation(indent));
+    return out;
+}
+
+void collect_elements(Expr* expr, std::vector<Var>& arrays)
+{
+    if (!expr)
+        return;
+    if (expr->type == Expr::Elements)
+    {
+        auto name = name_string(expr->dest_var.name);
+        auto found = std::find_if(arrays.begin(), arrays.end(), [&](Var& array) { return name_string(array.name) == name; });
+        if (found == arrays.end())
+            arrays.push_back(expr->dest_var);
+    }
+    collect_elements(expr->lhs, arrays);
+    collect_elements(expr->rhs, arrays);
+    for (auto arg: expr->args)
+    {
+        collect_elements(arg, arrays);
+    }
+}
+
+// Names of the arrays an element-wise statement assigns to, a[] = b[] = c[] writes a and b
+void collect_written_elements(Expr* expr, std::vector<std::string>& written)
+{
+    if (!expr)
+        return;
+    if (expr->type == Expr::Binary && is_assignment(expr->token.type) && expr->lhs->type == Expr::Elements)
+        written.push_back(name_string(expr->lhs->dest_var.name));
+    collect_written_elements(expr->lhs, written);
+    collect_written_elements(expr->rhs, written);
+    for (auto arg: expr->args)
+    {
+        collect_written_elements(arg, written);
+    }
+}
+
+// Whether cpec_count elements from either pointer stay clear of the other, or start at the same one
+std::string emit_apart(const std::string& a, const std::string& b)
+{
+    auto end = [](const std::string& data) { return std::format("(uintptr_t){} + cpec_count * sizeof(*{})", data, data); };
+    return std::format("(uintptr_t){} == (uintptr_t){} || {} <= (uintptr_t){} || {} <= (uintptr_t){}", a, b, end(a), b, end(b), a);
+}
+
+// a[] = b[] + c[] * 2 runs over every element, as many as the first array named holds
+std::string emit_elements(Stmt* stmt, int indent)
+{
+    std::vector<Var> arrays;
+    collect_elements(stmt->expr, arrays);
+
+    SimdLoop loop = {.safe = true};
+    for (auto array: arrays)
+    {
+        loop.safe &= simd_element(element_var(array));
+    }
+    simd_check_expr(stmt->expr, loop);
+
+    std::string hoisted;
+    std::string out = std::format("{}{{\n", indentation(indent));
+    out += std::format("{}auto const cpec_count = {}.size();\n", indentation(indent + 1), name_string(arrays[0].name));
+    // Every element of the others is reached through the count of the first. Even unchecked builds assert
+    // they agree, there's no index a later check could catch
+    for (auto i = 1; i < arrays.size(); i++)
+    {
+        auto check = current_bounds() == Bounds::Checked ? "cpec_checked_length" : "cpec_debug_length";
+        out += std::format("{}{}({}.size(), cpec_count);\n", indentation(indent + 1), check, name_string(arrays[i].name));
+        bounds_checks_emitted = true;
+    }
+    for (auto array: arrays)
+    {
+        out += emit_array_data(array, 0, indent + 1);
+    }
+
+    auto body = recurse_expr(stmt->expr, hoisted, indent + 2);
+    auto emit_loop = [&](std::string pragma, int loop_indent) {
+        auto loop_out = pragma;
+        loop_out += std::format("{}for (u64 cpec_i = 0; cpec_i < cpec_count; cpec_i++)\n", indentation(loop_indent));
+        loop_out += std::format("{}{{\n", indentation(loop_indent));
+        loop_out += std::format("{}{};\n", indentation(loop_indent + 1), body);
+        loop_out += std::format("{}}}\n", indentation(loop_indent));
+        return loop_out;
+    };
+
+    // Arrays can be views of one buffer. An element written and one read at another index share memory only when
+    // the views overlap without starting together, and then omp simd would be wrong
+    std::vector<std::string> written;
+    collect_written_elements(stmt->expr, written);
+    std::vector<std::string> pairs;
+    for (auto& written_name: written)
+    {
+        for (auto array: arrays)
+        {
+            auto array_name = name_string(array.name);
+            if (array_name != written_name)
+                pairs.push_back(emit_apart("cpec_" + written_name, "cpec_" + array_name));
+        }
+    }
+    auto apart = pairs.size() == 1 ? pairs[0] : "";
+    for (auto i = 0; pairs.size() > 1 && i < pairs.size(); i++)
+    {
+        apart += std::format("{}({})", i ? " && " : "", pairs[i]);
+    }
+
+    if (!loop.safe || apart.empty())
+    {
+        out += emit_loop(simd_pragma(loop, indent + 1), indent + 1);
+    }
+    else
+    {
+        out += std::format("{}if ({})\n", indentation(indent + 1), apart);
+        out += std::format("{}{{\n", indentation(indent + 1));
+        out += emit_loop(simd_pragma(loop, indent + 2), indent + 2);
+        out += std::format("{}}}\n", indentation(indent + 1));
+        out += std::format("{}else\n", indentation(indent + 1));
+        out += std::format("{}{{\n", indentation(indent + 1));
+        out += emit_loop("", indent + 2);
+        out += std::format("{}}}\n", indentation(indent + 1));
+    }
+    out += std::format("{}}}\n", indentation(indent));
+    return out;
+}
+
+bool is_pure_call(Expr* call);
+
+// Every subexpression gets the id of its spelling, built from the ids of its operands so each costs the same to spell
+struct CommonExprSearch
+{
+    std::unordered_map<std::string, u32> ids;
+    // Per id
+    std::vector<u32> counts;
+    std::vector<bool> first_conditional;
+    // Id of every occurrence that could be moved into a temporary
+    std::unordered_map<Expr*, u32> candidates;
+    // Names the statement binds, and those bound so far in evaluation order
+    std::vector<std::string> bound;
+    std::vector<std::string> bound_so_far;
+    // Type and value id of an immutable binding to the first binding of them
+    std::unordered_map<std::string, Expr*> bindings;
+    CommonExprs found;
+    // Writes and impure calls could change what a repeated subexpression evaluates to
+    bool safe;
+
+    u32 id_of(const std::string& spelling)
+    {
+        auto [entry, inserted] = ids.try_emplace(spelling, (u32)counts.size());
+        if (inserted)
+        {
+            counts.push_back(0);
+            first_conditional.push_back(false);
+        }
+        return entry->second;
+    }
+
+    void add_candidate(Expr* expr, u32 id, bool conditional)
+    {
+        if (!counts[id]++)
+            first_conditional[id] = conditional;
+        candidates[expr] = id;
+    }
+};
+
+void collect_bindings(Expr* expr, std::vector<std::string>& bound)
+{
+    if (!expr)
+        return;
+    if (expr->type == Expr::VarInit)
+        bound.push_back(name_string(expr->dest_var.name));
+    collect_bindings(expr->lhs, bound);
+    collect_bindings(expr->rhs, bound);
+    for (auto arg: expr->args)
+    {
+        collect_bindings(arg, bound);
+    }
+}
+
+// Walks in the order recurse_expr emits, an operand right of && or || is conditional as it may never be evaluated.
+// Returns whether the value could be computed ahead of the statement
+bool count_common_exprs(Expr* expr, CommonExprSearch& search, bool conditional, u32& id)
+{
+    switch (expr->type)
+    {
+        case Expr::Number:
+            id = search.id_of(std::string(expr->token.name, expr->token.string_size));
+            return true;
+        case Expr::Name:
+        {
+            auto name = std::string(expr->token.name, expr->token.string_size);
+            id = search.id_of(name);
+            // Until the statement binds it, the name is still the outer variable
+            auto bound_later = std::find(search.bound.begin(), search.bound.end(), name) != search.bound.end();
+            return !bound_later || std::find(search.bound_so_far.begin(), search.bound_so_far.end(), name) != search.bound_so_far.end();
+        }
+        case Expr::Paren:
+            return count_common_exprs(expr->rhs, search, conditional, id);
+        case Expr::Unary:
+        {
+            auto movable = count_common_exprs(expr->rhs, search, conditional, id);
+            id = search.id_of(std::format("{}#{}", operator_string(expr->token.type), id));
+            return movable;
+        }
+        case Expr::Binary:
+        {
+            if (is_assignment(expr->token.type))
+                search.safe = false;
+            u32 lhs, rhs;
+            auto movable = count_common_exprs(expr->lhs, search, conditional, lhs);
+            auto short_circuit = expr->token.type == LexToken::And || expr->token.type == LexToken::Or;
+            movable &= count_common_exprs(expr->rhs, search, conditional || short_circuit, rhs);
+            id = search.id_of(std::format("#{} {} #{}", lhs, operator_string(expr->token.type), rhs));
+            if (movable && !is_assignment(expr->token.type))
+                search.add_candidate(expr, id, conditional);
+            return movable;
+        }
+        case Expr::Call:
+        {
+            auto movable = is_pure_call(expr);
+            if (!movable)
+                search.safe = false;
+            auto spelling = std::format("{}(", std::string(expr->token.name, expr->token.string_size));
+            for (auto arg: expr->args)
+            {
+                u32 arg_id;
+                movable &= count_common_exprs(arg, search, conditional, arg_id);
+                spelling += std::format("#{},", arg_id);
+            }
+            id = search.id_of(spelling + ")");
+            if (movable)
+                search.add_candidate(expr, id, conditional);
+            return movable;
+        }
+        case Expr::Elements:
+            search.safe = false;
+            return false;
+        case Expr::Index:
+        {
+            // Reads memory, assigning to it already made the statement unsafe
+            u32 array, index;
+            count_common_exprs(expr->lhs, search, conditional, array);
+            count_common_exprs(expr->rhs, search, conditional, index);
+            return false;
+        }
+        case Expr::VarInit:
+        {
+            u32 value;
+            auto movable = count_common_exprs(expr->rhs, search, conditional, value);
+            search.bound_so_far.push_back(name_string(expr->dest_var.name));
+            if (movable && !expr->dest_var.is_mutable[0])
+            {
+                // Copying a literal or a variable from another binding saves nothing, only the same name is redundant then
+                auto cheap = expr->rhs->type == Expr::Number || expr->rhs->type == Expr::Name;
+                auto key = std::format("{} #{}", recurse_var(expr->dest_var, 0), value);
+                if (cheap)
+                    key += " " + name_string(expr->dest_var.name);
+                auto [earlier, inserted] = search.bindings.try_emplace(key, expr);
+                if (!inserted)
+                    search.found.rebindings[expr] = earlier->second;
+            }
+            // A declaration, not a value to share
+            return false;
+        }
+        case Expr::Range:
+            return false;
+        case Expr::Await:
+            // Anything may run while it's suspended
+            search.safe = false;
+            return false;
+        case Expr::New:
+        {
+            // Every allocation is new memory, never the same value twice
+            u32 arena, count;
+            count_common_exprs(expr->lhs, search, conditional, arena);
+            if (expr->rhs)
+                count_common_exprs(expr->rhs, search, conditional, count);
+            return false;
+        }
+    }
+    return false;
+}
+
+// Takes back the counts of what an occurrence holds, a repeat only reads the temporary
+void uncount_common_exprs(Expr* expr, CommonExprSearch& search)
+{
+    if (!expr)
+        return;
+    auto candidate = search.candidates.find(expr);
+    if (candidate != search.candidates.end())
+        search.counts[candidate->second]--;
+    uncount_common_exprs(expr->lhs, search);
+    uncount_common_exprs(expr->rhs, search);
+    for (auto arg: expr->args)
+    {
+        uncount_common_exprs(arg, search);
+    }
+}
+
+bool is_common_expr(CommonExprSearch& search, u32 id)
+{
+    // Hoisting evaluates it ahead of the statement, only safe when its first occurrence always ran
+    return search.counts[id] >= 2 && !search.first_conditional[id];
+}
+
+void skip_repeated_operands(Expr* expr, CommonExprSearch& search, std::vector<bool>& seen)
+{
+    if (!expr)
+        return;
+    auto candidate = search.candidates.find(expr);
+    if (candidate != search.candidates.end() && is_common_expr(search, candidate->second))
+    {
+        if (seen[candidate->second])
+        {
+            uncount_common_exprs(expr->lhs, search);
+            uncount_common_exprs(expr->rhs, search);
+            for (auto arg: expr->args)
+            {
+                uncount_common_exprs(arg, search);
+            }
+            return;
+        }
+        seen[candidate->second] = true;
+    }
+    if (search.found.rebindings.contains(expr))
+    {
+        uncount_common_exprs(expr->rhs, search);
+        return;
+    }
+    skip_repeated_operands(expr->lhs, search, seen);
+    skip_repeated_operands(expr->rhs, search, seen);
+    for (auto arg: expr->args)
+    {
+        skip_repeated_operands(arg, search, seen);
+    }
+}
+
+CommonExprs find_common_exprs(Expr* expr)
+{
+    CommonExprSearch search = {.safe = true};
+    collect_bindings(expr, search.bound);
+    u32 id;
+    count_common_exprs(expr, search, false, id);
+    if (!search.safe)
+        return {};
+
+    // Subexpressions of a repeat aren't evaluated again and don't count
+    std::vector<bool> seen(search.counts.size());
+    skip_repeated_operands(expr, search, seen);
+
+    std::unordered_map<u32, u32> slots;
+    for (auto [occurrence, occurrence_id]: search.candidates)
+    {
+        if (!is_common_expr(search, occurrence_id))
+            continue;
+        auto [slot, inserted] = slots.try_emplace(occurrence_id, (u32)slots.size());
+        search.found.repeated[occurrence] = slot->second;
+    }
+    search.found.temporaries.resize(slots.size());
+    return search.found;
+}
+
+// What a while writes, for telling which of the names it reads stay put
+struct LoopWrites
+{
+    std::vector<std::string> assigned;
+    // Set by a return, which may leave before the loop is done, or a call or suspension that may write anything
+    bool escapes;
+};
+
+void loop_writes_expr(Expr* expr, LoopWrites& writes)
+{
+    if (!expr)
+        return;
+    if (expr->type == Expr::Binary && is_assignment(expr->token.type) && expr->lhs->type == Expr::Name)
+        writes.assigned.push_back(std::string(expr->lhs->token.name, expr->lhs->token.string_size));
+    else if (expr->type == Expr::VarInit)
+        writes.assigned.push_back(name_string(expr->dest_var.name));
+    else if (expr->type == Expr::Call && !is_pure_call(expr) || expr->type == Expr::Await)
+        writes.escapes = true;
+    loop_writes_expr(expr->lhs, writes);
+    loop_writes_expr(expr->rhs, writes);
+    for (auto arg: expr->args)
+    {
+        loop_writes_expr(arg, writes);
+    }
+}
+
+void loop_writes_body(std::vector<Stmt*>& body, LoopWrites& writes)
+{
+    for (auto stmt: body)
+    {
+        if (stmt->type == Stmt::Return || stmt->type == Stmt::Yield)
+            writes.escapes = true;
+        if (stmt->type == Stmt::VarDecl || stmt->type == Stmt::For)
+            writes.assigned.push_back(name_string(stmt->var.name));
+        loop_writes_expr(stmt->expr, writes);
+        loop_writes_body(stmt->body, writes);
+    }
+}
+
+bool is_assigned(LoopWrites& writes, Expr* name)
+{
+    return std::find(writes.assigned.begin(), writes.assigned.end(), std::string(name->token.name, name->token.string_size)) != writes.assigned.end();
+}
+
+bool loop_invariant(Expr* expr, LoopWrites& writes)
+{
+    switch (expr->type)
+    {
+        case Expr::Number:
+            return true;
+        case Expr::Name:
+            return !is_assigned(writes, expr);
+        case Expr::Paren:
+        case Expr::Unary:
+            return loop_invariant(expr->rhs, writes);
+        case Expr::Binary:
+            return !is_assignment(expr->token.type) && loop_invariant(expr->lhs, writes) && loop_invariant(expr->rhs, writes);
+        case Expr::Call:
+            return is_pure_call(expr) && std::all_of(expr->args.begin(), expr->args.end(), [&](Expr* arg) { return loop_invariant(arg, writes); });
+        default:
+            return false;
+    }
+}
+
+// a[counter] reached whenever the statement runs, so not on the right of && or ||
+void collect_loop_indices(Expr* expr, const std::string& counter, LoopWrites& writes, std::vector<Expr*>& indices)
+{
+    if (!expr)
+        return;
+    if (expr->type == Expr::Index && expr->lhs->type == Expr::Name && !is_assigned(writes, expr->lhs) && expr->rhs->type == Expr::Name && std::string(expr->rhs->token.name, expr->rhs->token.string_size) == counter)
+        indices.push_back(expr);
+    collect_loop_indices(expr->lhs, counter, writes, indices);
+    if (expr->type != Expr::Binary || expr->token.type != LexToken::And && expr->token.type != LexToken::Or)
+        collect_loop_indices(expr->rhs, counter, writes, indices);
+    for (auto arg: expr->args)
+    {
+        collect_loop_indices(arg, counter, writes, indices);
+    }
+}
+
+// while i < n { ... a[i] ... i += 1 } with n and a left alone reads a[i] only for i from its value on entry up to n.
+// When the loop can't leave early, that range is checked once ahead of it and those accesses go unchecked inside.
+// Returns the check, the accesses it covers are added to prechecked
+std::string hoist_index_checks(Stmt* stmt, int indent, std::vector<Expr*>& prechecked)
+{
+    auto policy = current_bounds();
+    auto cond = stmt->expr;
+    if (policy == Bounds::Unchecked || cond->type != Expr::Binary || cond->token.type != LexToken::LessThen && cond->token.type != LexToken::BiggerThen)
+        return "";
+    auto counter_expr = cond->token.type == LexToken::LessThen ? cond->lhs : cond->rhs;
+    auto bound = cond->token.type == LexToken::LessThen ? cond->rhs : cond->lhs;
+    if (counter_expr->type != Expr::Name)
+        return "";
+    auto counter = std::string(counter_expr->token.name, counter_expr->token.string_size);
+
+    LoopWrites writes = {};
+    loop_writes_expr(cond, writes);
+    loop_writes_body(stmt->body, writes);
+    if (writes.escapes || std::count(writes.assigned.begin(), writes.assigned.end(), counter) != 1 || !loop_invariant(bound, writes))
+        return "";
+
+    // Only what runs before the counter steps up sees it below the bound. A step of 1 reaches every index up to
+    // bound - 1, a bigger one can stop short of it, and then the range check would fail for an array the loop fits
+    std::vector<Expr*> indices;
+    auto stepped = false;
+    for (auto body_stmt: stmt->body)
+    {
+        auto expr = body_stmt->expr;
+        if (body_stmt->type == Stmt::Expression && expr->type == Expr::Binary && expr->token.type == LexToken::PlusAssign && expr->lhs->type == Expr::Name && std::string(expr->lhs->token.name, expr->lhs->token.string_size) == counter)
+        {
+            stepped = expr->rhs->type == Expr::Number && std::string(expr->rhs->token.name, expr->rhs->token.string_size) == "1";
+            break;
+        }
+        if (body_stmt->type == Stmt::Expression || body_stmt->type == Stmt::VarDecl)
+            collect_loop_indices(expr, counter, writes, indices);
+    }
+    if (!stepped || indices.empty())
+        return "";
+
+    std::string hoisted;
+    auto bound_out = recurse_expr(bound, hoisted, indent);
+    std::vector<std::string> arrays;
+    std::string checks;
+    for (auto index: indices)
+    {
+        prechecked_indices.insert(index);
+        prechecked.push_back(index);
+        auto array = std::string(index->lhs->token.name, index->lhs->token.string_size);
+        if (std::find(arrays.begin(), arrays.end(), array) != arrays.end())
+            continue;
+        arrays.push_back(array);
+        checks += std::format("{}{}({}, {}, {}.size());\n", indentation(indent + 1), policy == Bounds::Checked ? "cpec_checked_range" : "cpec_debug_range", counter, bound_out, array);
+    }
+    bounds_checks_emitted = true;
+    return std::format("{}if ({} < {})\n{}{{\n{}{}}}\n", indentation(indent), counter, bound_out, indentation(indent), checks, indentation(indent));
+}
+
+// recurse_expr with every common subexpression of the statement evaluated once
+std::string emit_expr(Expr* expr, std::string& hoisted, int indent)
+{
+    auto found = find_common_exprs(expr);
+    common_exprs = &found;
+    auto out = recurse_expr(expr, hoisted, indent);
+    common_exprs = 0;
+    return out;
+}
+
+// for x in numbers(n) resumes the generator for every value it yields
+std::string emit_generator_for(Stmt* stmt, int indent)
+{
+    std::string hoisted;
+    auto generator = emit_expr(stmt->expr, hoisted, indent);
+    auto possible_const = stmt->var.is_mutable[0] ? "" : " const";
+    return std::format("{}{}for (auto{} {}: {}){}", hoisted, indentation(indent), possible_const, name_string(stmt->var.name), generator, emit_block(stmt->body, indent));
+}
+
+// Iterations are cut into chunks the runtime hands out to its threads. Every chunk works on its own partial of each
+// reduction, behind a reference of the same name, and the partials are combined in chunk order after the loop.
+// Chunks don't depend on the number of threads, so neither does the result
+std::string emit_parallel_for(Stmt* stmt, int indent)
+{
+    parallel_loops_emitted = true;
+    auto var_name = name_string(stmt->var.name);
+    auto range = stmt->expr->type == Expr::Range ? stmt->expr : 0;
+
+    std::string hoisted;
+    std::string out = std::format("{}{{\n", indentation(indent));
+    auto first = range && range->lhs ? recurse_expr(range->lhs, hoisted, indent + 1) : "0";
+    auto end = range ? recurse_expr(range->rhs, hoisted, indent + 1) : std::format("{}.size()", name_string(stmt->expr->dest_var.name));
+    out += hoisted;
+    if (!range)
+        out += emit_array_data(stmt->expr->dest_var, stmt->align, indent + 1);
+    out += std::format("{}i64 const cpec_first = {};\n", indentation(indent + 1), first);
+    out += std::format("{}i64 const cpec_end = {};\n", indentation(indent + 1), end);
+
+    std::string captures;
+    std::string partials;
+    for (auto reduction: stmt->reductions)
+    {
+        auto name = std::string(reduction->lhs->token.name, reduction->lhs->token.string_size);
+        auto type = recurse_var(reduction->lhs->dest_var, 0);
+        auto identity = reduction->token.type == LexToken::MultiplyAssign ? 1 : 0;
+        out += std::format("{}std::vector<{}> cpec_{}_partials(cpec_parallel_chunks(cpec_first, cpec_end), {});\n", indentation(indent + 1), type, name, identity);
+        partials += std::format("{}{} cpec_{} = {};\n", indentation(indent + 2), type, name, identity);
+        captures += std::format(", &{} = cpec_{}", name, name);
+    }
+
+    auto chunk = stmt->reductions.empty() ? "i64" : "i64 cpec_chunk";
+    out += std::format("{}cpec_parallel_for(cpec_first, cpec_end, [&]({}, i64 cpec_chunk_first, i64 cpec_chunk_end)\n", indentation(indent + 1), chunk);
+    out += std::format("{}{{\n", indentation(indent + 1));
+    out += partials;
+    auto loop_indent = indent + 2;
+    if (!stmt->reductions.empty())
+    {
+        out += std::format("{}[&{}]\n", indentation(loop_indent), captures);
+        out += std::format("{}{{\n", indentation(loop_indent));
+        loop_indent++;
+    }
+
+    // The references to partials can't be named by a reduction clause, loops with reductions are left to the C++ compiler
+    SimdLoop loop = {.safe = simd_element(stmt->var) && stmt->reductions.empty()};
+    loop.locals.push_back(var_name);
+    simd_check_body(stmt->body, loop);
+    out += simd_pragma(loop, loop_indent);
+    auto index = range ? var_name : var_name + "_i";
+    out += std::format("{}for (i64 {} = cpec_chunk_first; {} < cpec_chunk_end; {}++)\n", indentation(loop_indent), index, index, index);
+    out += std::format("{}{{\n", indentation(loop_indent));
+    if (!range)
+    {
+        // A mut element is a reference so writes go straight to the array
+        auto reference = stmt->var.is_mutable[0] ? "&" : "";
+        auto array_name = name_string(stmt->expr->dest_var.name);
+        out += std::format("{}{}{} {} = cpec_{}[{}];\n", indentation(loop_indent + 1), recurse_var(stmt->var, 0), reference, var_name, array_name, index);
+    }
+    for (auto body_stmt: stmt->body)
+    {
+        out += emit_stmt(body_stmt, loop_indent + 1);
+    }
+    out += std::format("{}}}\n", indentation(loop_indent));
+
+    if (!stmt->reductions.empty())
+    {
+        out += std::format("{}}}();\n", indentation(indent + 2));
+        for (auto reduction: stmt->reductions)
+        {
+            auto name = std::string(reduction->lhs->token.name, reduction->lhs->token.string_size);
+            out += std::format("{}cpec_{}_partials[cpec_chunk] = cpec_{};\n", indentation(indent + 2), name, name);
+        }
+    }
+    out += std::format("{}}});\n", indentation(indent + 1));
+
+    for (auto reduction: stmt->reductions)
+    {
+        auto name = std::string(reduction->lhs->token.name, reduction->lhs->token.string_size);
+        out += std::format("{}for (auto cpec_partial: cpec_{}_partials)\n", indentation(indent + 1), name);
+        out += std::format("{}{{\n", indentation(indent + 1));
+        out += std::format("{}{} {} cpec_partial;\n", indentation(indent + 2), name, operator_string(reduction->token.type));
+        out += std::format("{}}}\n", indentation(indent + 1));
+    }
+    out += std::format("{}}}\n", indentation(indent));
+    return out;
+}
+
+std::string emit_while(Stmt* stmt, int indent, std::vector<Expr*>& prechecked)
+{
+    std::string hoisted;
+    auto cond = stmt->expr;
+    auto counter = hoist_index_checks(stmt, indent, prechecked);
+    std::string iteration;
+    if (instrumenting_body)
+    {
+        auto site = std::format("cpec_loop_{}", instrumented_loops++);
+        counter += std::format("{}static cpec_profile_site {}(\"while\", {}, {});\n", indentation(indent), site, c_string_literal(instrument_source), stmt->line_num);
+        counter += std::format("{}cpec_profile_enter_loop({});\n", indentation(indent), site);
+        iteration = std::format("{}cpec_profile_iterate({});\n", indentation(indent + 1), site);
+    }
+    auto body_hint = loop_body_hint(stmt);
+    auto hint = body_hint.empty() ? "" : " " + body_hint;
+
+    if (cond->type == Expr::VarInit)
+    {
+        // A lone binding fits in the C++ condition itself
+        auto expr_out = emit_expr(cond->rhs, hoisted, indent + 1);
+        if (hoisted.empty())
+        {
+            auto decl = std::format("{} {} = {}", recurse_var(cond->dest_var, 0), name_string(cond->dest_var.name), expr_out);
+            return std::format("{}{}while ({}){}{}", counter, indentation(indent), decl, hint, emit_block(stmt->body, indent, iteration));
+        }
+        hoisted.clear();
+    }
+
+    auto cond_out = emit_expr(cond, hoisted, indent + 1);
+    if (hoisted.empty())
+    {
+        return std::format("{}{}while ({}){}{}", counter, indentation(indent), cond_out, hint, emit_block(stmt->body, indent, iteration));
+    }
+
+    // Bindings are evaluated again on every iteration, before the condition is tested
+    std::string out = std::format("{}{}while (true)\n{}{{\n{}", counter, indentation(indent), indentation(indent), hoisted);
+    auto exit_hint = body_hint == "[[likely]]" ? "[[unlikely]] " : body_hint == "[[unlikely]]" ? "[[likely]] " : "";
+    out += std::format("{}if (!({})) {}break;\n{}", indentation(indent + 1), cond_out, exit_hint, iteration);
+    for (auto body_stmt: stmt->body)
+    {
+        out += emit_stmt(body_stmt, indent + 1);
+    }
+    out += std::format("{}}}\n", indentation(indent));
+    return out;
+}
+
+std::string emit_stmt(Stmt* stmt, int indent)
+{
+    std::string hoisted;
+    switch (stmt->type)
+    {
+        case Stmt::VarDecl:
+        {
+            auto var_name = name_string(stmt->var.name);
+            if (stmt->is_constexpr)
+            {
+                // constexpr already implies the top level const
+                auto variable = stmt->var;
+                variable.is_mutable[0] = true;
+                auto expr_out = recurse_expr(stmt->expr, hoisted, indent);
+                return std::format("{}{}constexpr {} {} = {};\n", hoisted, indentation(indent), recurse_var(variable, 0), var_name, expr_out);
+            }
+            if (!stmt->expr)
+            {
+                return std::format("{}{} {}{{}};\n", indentation(indent), recurse_var(stmt->var, 0), var_name);
+            }
+            auto expr_out = emit_expr(stmt->expr, hoisted, indent);
+            return std::format("{}{}{} {} = {};\n", hoisted, indentation(indent), recurse_var(stmt->var, 0), var_name, expr_out);
+        }
+        case Stmt::Return:
+        {
+            auto keyword = function_coroutine ? "co_return" : "return";
+            if (!stmt->expr)
+            {
+                return std::format("{}{};\n", indentation(indent), keyword);
+            }
+            auto expr_out = emit_expr(stmt->expr, hoisted, indent);
+            return std::format("{}{}{} {};\n", hoisted, indentation(indent), keyword, expr_out);
+        }
+        case Stmt::Yield:
+        {
+            auto expr_out = emit_expr(stmt->expr, hoisted, indent);
+            return std::format("{}{}co_yield {};\n", hoisted, indentation(indent), expr_out);
+        }
+        case Stmt::For:
+            if (stmt->is_parallel)
+                return emit_parallel_for(stmt, indent);
+            if (stmt->expr->type == Expr::Call)
+                return emit_generator_for(stmt, indent);
+            return emit_for(stmt, indent);
+        case Stmt::Expression:
+        {
+            if (contains_expr(stmt->expr, Expr::Elements))
+                return emit_elements(stmt, indent);
+            auto expr_out = emit_expr(stmt->expr, hoisted, indent);
+            return std::format("{}{}{};\n", hoisted, indentation(indent), expr_out);
+        }
+        case Stmt::While:
+        {
+            // Indices a loop checked ahead of itself are all in its body. Nodes are freed along with their file,
+            // and one allocated later at the same address mustn't pass for checked
+            std::vector<Expr*> prechecked;
+            auto out = emit_while(stmt, indent, prechecked);
+            for (auto index: prechecked)
+            {
+                prechecked_indices.erase(index);
+            }
+            return out;
+        }
+    }
+    return "";
+}
+
+// prefix goes ahead of the statements, already indented
+std::string emit_block(std::vector<Stmt*>& body, int indent, const std::string& prefix)
+{
+    if (body.empty() && prefix.empty())
+    {
+        return " {}\n";
+    }
+
+    std::string out = std::format("\n{}{{\n{}", indentation(indent), prefix);
+    for (auto stmt: body)
+    {
+        out += emit_stmt(stmt, indent + 1);
+    }
+    out += std::format("{}}}\n", indentation(indent));
+    return out;
+}
+
+// Immutable values bigger than two registers travel by const reference, arenas always by reference
+bool pass_by_reference(Var param)
+{
+    if (is_arena(param))
+        return true;
+    if (param.modifier.size() || param.is_mutable[0] || !param.user_type || param.user_type->type == TypeDecl::Generic)
+        return false;
+    return type_layout(param.user_type).size > 16;
+}
+
+// A mut pointee can still be reached through another argument, a view or a global, so pointers aren't __restrict
+std::string emit_param(Var param)
+{
+    auto param_name = name_string(param.name);
+    if (pass_by_reference(param))
+    {
+        return std::format("{}& {}", recurse_var(param, 0), param_name);
+    }
+    return std::format("{} {}", recurse_var(param, 0), param_name);
+}
+
+struct PurityCheck {
+    enum Level { Impure, Pure, Const } purity;
+    std::vector<std::string> locals;
+
+    bool is_local(Expr* name)
+    {
+        return std::find(locals.begin(), locals.end(), std::string(name->token.name, name->token.string_size)) != locals.end();
+    }
+};
+
+// Purity of every function emitted so far, calls to them keep the caller as pure as the callee
+std::unordered_map<std::string, PurityCheck::Level> function_purities;
+
+void purity_check_expr(Expr* expr, PurityCheck& check)
+{
+    if (!expr)
+        return;
+
+    if (expr->type == Expr::Call)
+    {
+        auto callee = function_purities.find(std::string(expr->token.name, expr->token.string_size));
+        check.purity = std::min(check.purity, callee == function_purities.end() ? PurityCheck::Impure : callee->second);
+    }
+    else if (expr->type == Expr::VarInit)
+    {
+        check.locals.push_back(name_string(expr->dest_var.name));
+    }
+    else if (expr->type == Expr::Name && !check.is_local(expr))
+    {
+        // Globals can change between calls
+        check.purity = std::min(check.purity, PurityCheck::Pure);
+    }
+    else if (expr->type == Expr::Elements || expr->type == Expr::Index)
+    {
+        check.purity = std::min(check.purity, PurityCheck::Pure);
+    }
+    else if (expr->type == Expr::Binary && is_assignment(expr->token.type) && (expr->lhs->type != Expr::Name || !check.is_local(expr->lhs)))
+    {
+        check.purity = PurityCheck::Impure;
+    }
+    else if (expr->type == Expr::New && !check.is_local(expr->lhs))
+    {
+        check.purity = PurityCheck::Impure;
+    }
+
+    purity_check_expr(expr->lhs, check);
+    purity_check_expr(expr->rhs, check);
+    for (auto arg: expr->args)
+    {
+        purity_check_expr(arg, check);
+    }
+}
+
+void purity_check_body(std::vector<Stmt*>& body, PurityCheck& check)
+{
+    auto locals_size = check.locals.size();
+    for (auto stmt: body)
+    {
+        if (stmt->type == Stmt::For && stmt->expr->type != Expr::Range)
+        {
+            // Reads through the array, or writes to it for a mut element
+            check.purity = std::min(check.purity, stmt->var.is_mutable[0] ? PurityCheck::Impure : PurityCheck::Pure);
+        }
+        purity_check_expr(stmt->expr, check);
+        if (stmt->type == Stmt::VarDecl || stmt->type == Stmt::For)
+        {
+            check.locals.push_back(name_string(stmt->var.name));
+        }
+        purity_check_body(stmt->body, check);
+    }
+    check.locals.resize(locals_size);
+}
+
+// const: the result depends only on the argument values; pure: it may also read memory, but writes nothing outside
+PurityCheck::Level function_purity(Function& function)
+{
+    PurityCheck check = {.purity = PurityCheck::Const};
+    for (auto param: function.params)
+    {
+        check.locals.push_back(name_string(param.name));
+        for (auto i = 1; i < param.is_mutable.size(); i++)
+        {
+            if (param.is_mutable[i])
+                check.purity = PurityCheck::Impure;
+        }
+        if (param.modifier.size() || pass_by_reference(param))
+            check.purity = std::min(check.purity, PurityCheck::Pure);
+        // Allocations from the caller's arena are writes the caller sees
+        if (is_arena(param) && param.is_mutable[0])
+            check.purity = PurityCheck::Impure;
+    }
+    purity_check_body(function.body, check);
+    return check.purity;
+}
+
+std::string emit_function_signature(Function& function)
+{
+    std::string params;
+    for (auto j = 0; j < function.params.size(); j++)
+    {
+        // The frame of a coroutine outlives the call, it keeps copies rather than references to the arguments.
+        // An arena is the caller's to keep alive
+        auto& param = function.params[j];
+        params += function.coroutine && !is_arena(param) ? std::format("{} {}", recurse_var(param, 0), name_string(param.name)) : emit_param(param);
+        if (j != function.params.size() - 1)
+        {
+            params += ", ";
+        }
+    }
+    auto possible_constexpr = function.is_constexpr ? "constexpr " : "";
+    auto return_type = recurse_var(function.return_type, 0);
+    if (function.coroutine)
+    {
+        // The promise stores the value, it's assigned when the coroutine returns or yields
+        auto carried = function.return_type;
+        carried.is_mutable[0] = true;
+        auto wrapper = function.coroutine == Coroutine::Async ? "cpec_task" : "cpec_generator";
+        return_type = std::format("{}<{}>", wrapper, recurse_var(carried, 0));
+    }
+    return std::format("{}{} {}({})", possible_constexpr, return_type, name_string(function.name), params);
+}
+
+bool is_pure_call(Expr* call)
+{
+    auto callee = function_purities.find(std::string(call->token.name, call->token.string_size));
+    return callee != function_purities.end() && callee->second != PurityCheck::Impure;
+}
+
+bool is_instrumented(Function& function);
+
+std::string emit_purity(Function& function)
+{
+    // Every call of a coroutine starts a frame of its own. An instrumented function counts its calls, merging
+    // or dropping any of them would skew the counts
+    auto purity = function.coroutine || is_instrumented(function) ? PurityCheck::Impure : function_purity(function);
+    function_purities[name_string(function.name)] = purity;
+    if (purity == PurityCheck::Const)
+        return "[[gnu::const]] ";
+    if (purity == PurityCheck::Pure)
+        return "[[gnu::pure]] ";
+    return "";
+}
+
+// Every VarType the parameter may stand for, the whole var_types[] table when unconstrained
+std::vector<enum VarType> generic_candidates(TypeDecl* type_param)
+{
+    if (!type_param->constraints.empty())
+        return type_param->constraints;
+
+    std::vector<enum VarType> candidates;
+    for (auto i = 0; i < COUNTOF(var_types); i++)
+    {
+        if (var_types[i])
+            candidates.push_back((VarType)i);
+    }
+    return candidates;
+}
+
+std::string emit_template_header(Function& function)
+{
+    std::string type_names, requirements;
+    for (auto type_param: function.type_params)
+    {
+        auto type_name = name_string(type_param->name);
+        type_names += std::format("{}typename {}", type_names.empty() ? "" : ", ", type_name);
+
+        std::string allowed;
+        for (auto candidate: generic_candidates(type_param))
+        {
+            allowed += std::format("{}std::same_as<{}, {}>", allowed.empty() ? "" : " || ", type_name, var_types[candidate]);
+        }
+        requirements += std::format("{}({})", requirements.empty() ? "" : " && ", allowed);
+    }
+    return std::format("template <{}>\n{}requires {}\n", type_names, indentation(1), requirements);
+}
+
+// Explicit instantiations make the C++ compiler specialize the function for every listed combination
+std::string emit_instantiations(Function& function, int param)
+{
+    if (param == function.type_params.size())
+    {
+        return std::format("template {};\n", emit_function_signature(function));
+    }
+
+    auto type_param = function.type_params[param];
+    std::string out;
+    for (auto candidate: type_param->constraints)
+    {
+        type_param->underlying_type = candidate;
+        out += emit_instantiations(function, param + 1);
+    }
+    type_param->underlying_type = VarType::Any;
+    return out;
+}
+
+// constexpr functions may run at compile time, where there's nothing to count. A coroutine suspends with its
+// scope open, its counts would take in whatever ran meanwhile
+bool is_instrumented(Function& function)
+{
+    return instrument_functions && !function.is_constexpr && !function.coroutine;
+}
+
+std::string emit_profile_site(Function& function)
+{
+    auto function_name = name_string(function.name);
+    return std::format("static cpec_profile_site cpec_site_{}({}, {}, {});\n", function_name, c_string_literal(function_name), c_string_literal(instrument_source), function.line_num);
+}
+
+std::string emit_function_body(Function& function)
+{
+    function_bounds = function.bounds;
+    function_coroutine = function.coroutine;
+    std::string out;
+    if (!is_instrumented(function))
+    {
+        out = emit_block(function.body, 0);
+    }
+    else
+    {
+        instrumenting_body = true;
+        out = emit_block(function.body, 0, std::format("{}cpec_profile_scope cpec_profile(cpec_site_{});\n", indentation(1), name_string(function.name)));
+        instrumenting_body = false;
+    }
+    function_bounds = Bounds::Default;
+    function_coroutine = Coroutine::None;
+    return out;
+}
+
+// Calls are what keeps a function from being inlined into its callers
+bool is_small_leaf(std::vector<Stmt*>& body)
+{
+    if (body.size() > 4)
+        return false;
+    for (auto stmt: body)
+    {
+        if (!stmt->body.empty() || contains_expr(stmt->expr, Expr::Call))
+            return false;
+    }
+    return true;
+}
+
+// From --profile-use: hot for the functions most of the time went to, always_inline too for the small leaves among
+// them that are called often, cold and noinline for the ones never called
+std::string emit_profile_hints(Function& function)
+{
+    if (!profile.loaded)
+        return "";
+    auto counts = profile.functions.find(name_string(function.name));
+    if (counts == profile.functions.end())
+        return "";
+
+    if (!counts->second.calls)
+        return "[[gnu::cold]] [[gnu::noinline]] ";
+    if (counts->second.self_cycles < profile.hot_self_cycles)
+        return "";
+    if (counts->second.calls >= 1000 && !function.coroutine && is_small_leaf(function.body))
+        return "[[gnu::hot]] [[gnu::always_inline]] ";
+    return "[[gnu::hot]] ";
+}
+
+std::string emit_function(Function& function)
+{
+    if (function.coroutine)
+        coroutines_emitted = true;
+    auto purity = emit_purity(function);
+    std::string site;
+    if (is_instrumented(function))
+        site = emit_profile_site(function);
+    purity += emit_profile_hints(function);
+    if (function.type_params.empty())
+    {
+        return site + purity + emit_function_signature(function) + emit_function_body(function);
+    }
+
+    auto out = site + emit_template_header(function) + purity + emit_function_signature(function) + emit_function_body(function);
+    for (auto type_param: function.type_params)
+    {
+        if (type_param->constraints.empty())
+            return out;
+    }
+    // constexpr is not allowed on an explicit instantiation
+    auto instance = function;
+    instance.is_constexpr = false;
+    return out + emit_instantiations(instance, 0);
+}
+
+// Columns hold one std::vector per field; accessors hand them out as [T] does, std::span<T const> unless the field is mut
+std::string emit_soa(TypeDecl* type_decl, std::vector<Var>& fields)
+{
+    auto type_name = name_string(type_decl->name);
+    auto indent = indentation(1);
+
+    std::string columns, push_back, elements, accessors;
+    for (auto field: fields)
+    {
+        auto field_name = name_string(field.name);
+
+        auto element = field;
+        element.is_mutable[0] = true;
+        columns += std::format("{}std::vector<{}> {}_column;\n", indent, recurse_var(element, 0), field_name);
+        push_back += std::format("{}{}{}_column.push_back(value.{});\n", indent, indent, field_name, field_name);
+        elements += std::format("{}{}_column[i]", elements.empty() ? "" : ", ", field_name);
+
+        auto column = field;
+        column.modifier.insert(column.modifier.begin(), Var::Array);
+        column.is_mutable.insert(column.is_mutable.begin(), true);
+        if (field.is_mutable[0])
+        {
+            accessors += std::format("{}{} {}() {{ return {}_column; }}\n", indent, recurse_var(column, 0), field_name, field_name);
+        }
+        column.is_mutable[1] = false;
+        accessors += std::format("{}{} {}() const {{ return {}_column; }}\n", indent, recurse_var(column, 0), field_name, field_name);
+    }
+
+    auto first_column = name_string(fields[0].name);
+    std::string out = std::format("struct {}Soa\n{{\n{}\n", type_name, columns);
+    out += std::format("{}u64 size() const {{ return {}_column.size(); }}\n", indent, first_column);
+    out += std::format("{}void push_back({} const& value)\n{}{{\n{}{}}}\n", indent, type_name, indent, push_back, indent);
+    out += std::format("{}{} operator[](u64 i) const {{ return {{{}}}; }}\n\n", indent, type_name, elements);
+    out += accessors;
+    out += "};\n";
+    return out;
+}
+
+std::string emit_type_decl(TypeDecl* type_decl)
+{
+    auto type_name = name_string(type_decl->name);
+    auto indent = indentation(1);
+
+    if (type_decl->type == TypeDecl::Enum)
+    {
+        auto underlying = type_decl->underlying_type ? std::format(" : {}", var_types[type_decl->underlying_type]) : "";
+        std::string out = std::format("enum {}{}\n{{\n", type_name, underlying);
+        for (auto value: type_decl->values)
+        {
+            if (value.value)
+            {
+                std::string hoisted;
+                out += std::format("{}{} = {},\n", indent, name_string(value.name), recurse_expr(value.value, hoisted, 1));
+            }
+            else
+            {
+                out += std::format("{}{},\n", indent, name_string(value.name));
+            }
+        }
+        return out + "};\n";
+    }
+
+    auto fields = layout_fields(type_decl);
+    auto align = type_decl->align ? std::format(" alignas({})", type_decl->align) : "";
+    std::string out = std::format("{}{} {}\n{{\n", type_decl->type == TypeDecl::Struct ? "struct" : "union", align, type_name);
+    for (auto field: fields)
+    {
+        out += std::format("{}{} {};\n", indent, recurse_var(field, 0), name_string(field.name));
+    }
+    out += "};\n";
+
+    if (type_decl->packed)
+    {
+        out = std::format("#pragma pack(push, 1)\n{}#pragma pack(pop)\n", out);
+    }
+    if (type_decl->soa)
+    {
+        out += emit_soa(type_decl, fields);
+    }
+    return out;
+}
+
+// C++ spelling of a VarType, derived from its size and signedness
+std::string c_type(VarType var_type)
+{
+    if (var_type == VarType::Bool)
+        return "bool";
+    if (strncmp(var_types[var_type], "real", 4) == 0)
+        return var_type_sizes[var_type] == 4 ? "float" : "double";
+    return std::format("{}int{}_t", var_type_signed[var_type] ? "" : "u", var_type_sizes[var_type] * 8);
+}
+
+// Runtime behind --instrument. Each thread counts into its own table and adds it to the sites when it ends,
+// the main thread's table is in by the time the profile is printed at exit. Threads still running then are left out.
+// Cycles of a recursive function are counted once, by its outermost call, self cycles leave out instrumented callees.
+// A while site counts how often the loop was reached as calls, and its iterations. The profile goes to stderr, or to
+// the file named by CPEC_PROFILE, in the format --profile-use reads
+std::string emit_profile_runtime()
+{
+    return R"(#ifndef CPEC_PROFILE_RUNTIME
+#define CPEC_PROFILE_RUNTIME
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define cpec_cycles() __rdtsc()
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define cpec_cycles() __rdtsc()
+#else
+#include <chrono>
+#define cpec_cycles() (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count()
+#endif
+
+struct cpec_profile_site
+{
+    const char* name;
+    const char* file;
+    int line;
+    uint32_t index;
+    uint64_t calls, cycles, self_cycles, iterations;
+
+    cpec_profile_site(const char* name, const char* file, int line);
+};
+
+struct cpec_profile_counts
+{
+    uint64_t calls, cycles, self_cycles, iterations;
+    uint32_t depth;
+};
+
+inline std::mutex cpec_profile_mutex;
+
+inline std::vector<cpec_profile_site*>& cpec_profile_sites()
+{
+    static std::vector<cpec_profile_site*> sites;
+    return sites;
+}
+
+inline void cpec_profile_report()
+{
+    std::lock_guard lock(cpec_profile_mutex);
+    auto sites = cpec_profile_sites();
+    std::stable_sort(sites.begin(), sites.end(), [](cpec_profile_site* a, cpec_profile_site* b) { return a->self_cycles > b->self_cycles; });
+    auto path = getenv("CPEC_PROFILE");
+    auto out = path ? fopen(path, "w") : stderr;
+    if (!out)
+    {
+        fprintf(stderr, "Failed to write the profile to %s\n", path);
+        return;
+    }
+    fprintf(out, "%16s %16s %12s %12s  site\n", "self cycles", "cycles", "calls", "iterations");
+    for (auto site: sites)
+    {
+        fprintf(out, "%16llu %16llu %12llu %12llu  %s %s:%d\n", (unsigned long long)site->self_cycles, (unsigned long long)site->cycles, (unsigned long long)site->calls, (unsigned long long)site->iterations, site->name, site->file, site->line);
+    }
+    if (path)
+        fclose(out);
+}
+
+inline cpec_profile_site::cpec_profile_site(const char* name, const char* file, int line) : name(name), file(file), line(line), calls(), cycles(), self_cycles(), iterations()
+{
+    std::lock_guard lock(cpec_profile_mutex);
+    auto& sites = cpec_profile_sites();
+    if (sites.empty())
+        atexit(cpec_profile_report);
+    index = sites.size();
+    sites.push_back(this);
+}
+
+struct cpec_profile_thread
+{
+    std::vector<cpec_profile_counts> counts;
+
+    ~cpec_profile_thread()
+    {
+        std::lock_guard lock(cpec_profile_mutex);
+        auto& sites = cpec_profile_sites();
+        for (size_t i = 0; i < counts.size(); i++)
+        {
+            sites[i]->calls += counts[i].calls;
+            sites[i]->cycles += counts[i].cycles;
+            sites[i]->self_cycles += counts[i].self_cycles;
+            sites[i]->iterations += counts[i].iterations;
+        }
+    }
+};
+
+inline thread_local cpec_profile_thread cpec_profile_thread_counts;
+
+inline cpec_profile_counts& cpec_profile_counts_of(cpec_profile_site& site)
+{
+    auto& counts = cpec_profile_thread_counts.counts;
+    if (site.index >= counts.size())
+    {
+        std::lock_guard lock(cpec_profile_mutex);
+        counts.resize(cpec_profile_sites().size());
+    }
+    return counts[site.index];
+}
+
+inline void cpec_profile_enter_loop(cpec_profile_site& site)
+{
+    cpec_profile_counts_of(site).calls++;
+}
+
+// Only after cpec_profile_enter_loop, which made room for the site
+inline void cpec_profile_iterate(cpec_profile_site& site)
+{
+    cpec_profile_thread_counts.counts[site.index].iterations++;
+}
+
+struct cpec_profile_scope
+{
+    uint32_t index;
+    uint64_t start;
+    uint64_t child_cycles;
+    cpec_profile_scope* parent;
+
+    static inline thread_local cpec_profile_scope* current;
+
+    cpec_profile_scope(cpec_profile_site& site) : index(site.index), child_cycles(), parent(current)
+    {
+        auto& counts = cpec_profile_counts_of(site);
+        counts.calls++;
+        counts.depth++;
+        current = this;
+        start = cpec_cycles();
+    }
+
+    ~cpec_profile_scope()
+    {
+        auto elapsed = cpec_cycles() - start;
+        auto& counts = cpec_profile_thread_counts.counts[index];
+        counts.self_cycles += elapsed - child_cycles;
+        if (--counts.depth == 0)
+            counts.cycles += elapsed;
+        if (parent)
+            parent->child_cycles += elapsed;
+        current = parent;
+    }
+};
+#endif
+)";
+}
+
+// Runtime behind --bounds=checked and --bounds=debug. A checked index stops the program in every build, a debug one
+// is an assert. Indices a while checked ahead of itself are read straight from data()
+std::string emit_bounds_runtime()
+{
+    return R"(#ifndef CPEC_BOUNDS_RUNTIME
+#define CPEC_BOUNDS_RUNTIME
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <span>
+#include <type_traits>
+
+template <typename Index>
+constexpr bool cpec_index_in_bounds(Index index, size_t size)
+{
+    return !(index < 0) && (unsigned long long)index < size;
+}
+
+// Every index from first up to end, end is past first
+template <typename First, typename End>
+constexpr bool cpec_range_in_bounds(First first, End end, size_t size)
+{
+    if constexpr (std::is_floating_point_v<End>)
+        return !(first < 0) && end <= (End)size;
+    else
+        return !(first < 0) && (unsigned long long)end <= size;
+}
+
+[[noreturn]] inline void cpec_out_of_bounds(size_t size)
+{
+    fprintf(stderr, "index out of bounds of an array of %zu elements\n", size);
+    abort();
+}
+
+template <typename T, typename Index>
+constexpr T& cpec_checked_at(std::span<T> array, Index index)
+{
+    if (!cpec_index_in_bounds(index, array.size())) [[unlikely]]
+        cpec_out_of_bounds(array.size());
+    return array.data()[index];
+}
+
+template <typename T, typename Index>
+constexpr T& cpec_debug_at(std::span<T> array, Index index)
+{
+    assert(cpec_index_in_bounds(index, array.size()));
+    return array.data()[index];
+}
+
+template <typename First, typename End>
+constexpr void cpec_checked_range(First first, End end, size_t size)
+{
+    if (!cpec_range_in_bounds(first, end, size)) [[unlikely]]
+        cpec_out_of_bounds(size);
+}
+
+template <typename First, typename End>
+constexpr void cpec_debug_range(First first, End end, size_t size)
+{
+    assert(cpec_range_in_bounds(first, end, size));
+}
+
+// Arrays an element-wise statement walks together all have as many elements as the first
+[[noreturn]] inline void cpec_length_mismatch(size_t size, size_t count)
+{
+    fprintf(stderr, "array of %zu elements walked along with one of %zu\n", size, count);
+    abort();
+}
+
+constexpr void cpec_checked_length(size_t size, size_t count)
+{
+    if (size != count) [[unlikely]]
+        cpec_length_mismatch(size, count);
+}
+
+constexpr void cpec_debug_length(size_t size, size_t count)
+{
+    assert(size == count);
+}
+#endif
+)";
+}
+
+// Runtime behind parallel for. A pool of CPEC_THREADS threads, one per core by default and counting the thread that
+// starts a loop, works through its chunks. Every thread has a deque of chunk ranges, it takes chunks from the front of
+// its last range and, once it runs out, steals the back half of the first range another thread still has.
+// A parallel for reached from inside another one runs on the thread that reached it
+std::string emit_parallel_runtime()
+{
+    return R"(#ifndef CPEC_PARALLEL_RUNTIME
+#define CPEC_PARALLEL_RUNTIME
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Loops are cut into at most this many chunks on every machine, so their partials are combined the same way
+constexpr i64 cpec_parallel_max_chunks = 512;
+
+inline i64 cpec_parallel_chunk_size(i64 first, i64 end)
+{
+    return (end - first + cpec_parallel_max_chunks - 1) / cpec_parallel_max_chunks;
+}
+
+inline i64 cpec_parallel_chunks(i64 first, i64 end)
+{
+    if (end <= first)
+        return 0;
+    auto size = cpec_parallel_chunk_size(first, end);
+    return (end - first + size - 1) / size;
+}
+
+struct cpec_parallel_job
+{
+    void (*run)(void* body, i64 chunk, i64 first, i64 end);
+    void* body;
+    i64 first;
+    i64 end;
+    i64 chunk_size;
+    // Chunks not done yet
+    std::atomic<i64> remaining;
+};
+
+struct cpec_parallel_deque
+{
+    std::mutex mutex;
+    // Ranges of chunk numbers, end excluded
+    std::deque<std::pair<i64, i64>> ranges;
+};
+
+// Set on the threads of the pool, and on a thread while it starts a loop
+inline thread_local bool cpec_parallel_inside;
+
+struct cpec_parallel_pool
+{
+    std::vector<std::thread> threads;
+    // One per thread of the pool, the last one for the thread starting the loop
+    std::vector<cpec_parallel_deque> deques;
+    // Loops started by different threads take turns
+    std::mutex starting;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    cpec_parallel_job* job = 0;
+    u64 generation = 0;
+    // Threads of the pool working on job
+    u32 busy = 0;
+    bool stopping = false;
+
+    static u64 thread_count()
+    {
+        auto threads = getenv("CPEC_THREADS");
+        auto count = threads ? atoi(threads) : (int)std::thread::hardware_concurrency();
+        return std::max(count, 1);
+    }
+
+    static cpec_parallel_pool& get()
+    {
+        static cpec_parallel_pool pool;
+        return pool;
+    }
+
+    cpec_parallel_pool() : deques(thread_count())
+    {
+        for (u64 i = 0; i + 1 < deques.size(); i++)
+        {
+            threads.emplace_back([this, i] { serve(i); });
+        }
+    }
+
+    ~cpec_parallel_pool()
+    {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& thread: threads)
+        {
+            thread.join();
+        }
+    }
+
+    bool take(u64 self, i64& chunk)
+    {
+        auto& own = deques[self];
+        {
+            std::lock_guard lock(own.mutex);
+            if (!own.ranges.empty())
+            {
+                auto& range = own.ranges.back();
+                chunk = range.first++;
+                if (range.first == range.second)
+                    own.ranges.pop_back();
+                return true;
+            }
+        }
+        for (u64 i = 1; i < deques.size(); i++)
+        {
+            auto& victim = deques[(self + i) % deques.size()];
+            std::pair<i64, i64> stolen;
+            {
+                std::lock_guard lock(victim.mutex);
+                if (victim.ranges.empty())
+                    continue;
+                auto& range = victim.ranges.front();
+                auto half = range.second - (range.second - range.first + 1) / 2;
+                stolen = {half, range.second};
+                range.second = half;
+                if (range.first == range.second)
+                    victim.ranges.pop_front();
+            }
+            chunk = stolen.first;
+            if (stolen.first + 1 < stolen.second)
+            {
+                std::lock_guard lock(own.mutex);
+                own.ranges.push_back({stolen.first + 1, stolen.second});
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void work(cpec_parallel_job& current, u64 self)
+    {
+        i64 chunk;
+        while (take(self, chunk))
+        {
+            auto first = current.first + chunk * current.chunk_size;
+            current.run(current.body, chunk, first, std::min(current.end, first + current.chunk_size));
+            if (current.remaining.fetch_sub(1) == 1)
+            {
+                std::lock_guard lock(mutex);
+                done.notify_all();
+            }
+        }
+    }
+
+    void serve(u64 self)
+    {
+        cpec_parallel_inside = true;
+        u64 seen = 0;
+        std::unique_lock lock(mutex);
+        while (true)
+        {
+            wake.wait(lock, [&] { return stopping || (job && generation != seen); });
+            if (stopping)
+                return;
+            seen = generation;
+            auto current = job;
+            busy++;
+            lock.unlock();
+            work(*current, self);
+            lock.lock();
+            busy--;
+            done.notify_all();
+        }
+    }
+
+    // Returns once every chunk ran and no thread of the pool still looks at current
+    void run(cpec_parallel_job& current, i64 chunks)
+    {
+        std::lock_guard turn(starting);
+        auto count = (i64)deques.size();
+        for (i64 i = 0; i < count; i++)
+        {
+            auto first = chunks * i / count;
+            auto end = chunks * (i + 1) / count;
+            std::lock_guard lock(deques[i].mutex);
+            if (first < end)
+                deques[i].ranges.push_back({first, end});
+        }
+        current.remaining = chunks;
+        {
+            std::lock_guard lock(mutex);
+            job = &current;
+            generation++;
+        }
+        wake.notify_all();
+
+        work(current, count - 1);
+        std::unique_lock lock(mutex);
+        done.wait(lock, [&] { return current.remaining == 0 && busy == 0; });
+        job = 0;
+    }
+};
+
+// Calls body(chunk, first, end) for the chunks of first up to end, numbered from 0 in order
+template <typename Body>
+void cpec_parallel_for(i64 first, i64 end, Body&& body)
+{
+    auto chunks = cpec_parallel_chunks(first, end);
+    if (!chunks)
+        return;
+    auto chunk_size = cpec_parallel_chunk_size(first, end);
+    if (chunks == 1 || cpec_parallel_inside || cpec_parallel_pool::get().threads.empty())
+    {
+        for (i64 chunk = 0; chunk < chunks; chunk++)
+        {
+            auto chunk_first = first + chunk * chunk_size;
+            body(chunk, chunk_first, std::min(end, chunk_first + chunk_size));
+        }
+        return;
+    }
+
+    cpec_parallel_job job = {
+        .run = [](void* context, i64 chunk, i64 chunk_first, i64 chunk_end) { (*(std::remove_reference_t<Body>*)context)(chunk, chunk_first, chunk_end); },
+        .body = (void*)&body,
+        .first = first,
+        .end = end,
+        .chunk_size = chunk_size,
+    };
+    cpec_parallel_inside = true;
+    cpec_parallel_pool::get().run(job, chunks);
+    cpec_parallel_inside = false;
+}
+#endif
+)";
+}
+
+// Runtime behind async and generator functions. Their frames come from free lists per size class and thread, a
+// pipeline starting a task per request reuses the frames of finished ones instead of going to operator new.
+// Awaitables from outside, like I/O, resume what they suspended through cpec_async_post, and the thread driving a
+// task with get resumes it, so many requests overlap on that one thread
+std::string emit_coroutine_runtime()
+{
+    return R"(#ifndef CPEC_COROUTINE_RUNTIME
+#define CPEC_COROUTINE_RUNTIME
+#include <stddef.h>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <iterator>
+#include <mutex>
+#include <new>
+#include <utility>
+
+// Frames are handed out in multiples of the granule, those bigger than the last class go to operator new
+constexpr size_t cpec_frame_granule = 64;
+constexpr size_t cpec_frame_classes = 16;
+
+// Freed frames of every size class, linked through their first bytes. A frame freed on another thread than the
+// one it came from joins the lists of the thread freeing it
+struct cpec_frame_pool
+{
+    void* free[cpec_frame_classes] = {};
+
+    ~cpec_frame_pool()
+    {
+        for (auto frame: free)
+        {
+            while (frame)
+            {
+                auto next = *(void**)frame;
+                ::operator delete(frame);
+                frame = next;
+            }
+        }
+    }
+};
+
+inline thread_local cpec_frame_pool cpec_frames;
+
+inline void* cpec_frame_allocate(size_t size)
+{
+    auto size_class = (size - 1) / cpec_frame_granule;
+    if (size_class >= cpec_frame_classes)
+        return ::operator new(size);
+    auto& head = cpec_frames.free[size_class];
+    if (!head)
+        return ::operator new((size_class + 1) * cpec_frame_granule);
+    auto frame = head;
+    head = *(void**)frame;
+    return frame;
+}
+
+inline void cpec_frame_free(void* frame, size_t size)
+{
+    auto size_class = (size - 1) / cpec_frame_granule;
+    if (size_class >= cpec_frame_classes)
+    {
+        ::operator delete(frame);
+        return;
+    }
+    *(void**)frame = cpec_frames.free[size_class];
+    cpec_frames.free[size_class] = frame;
+}
+
+// The promises of tasks and generators put their frames in the pool
+struct cpec_frame_promise
+{
+    static void* operator new(size_t size)
+    {
+        return cpec_frame_allocate(size);
+    }
+
+    static void operator delete(void* frame, size_t size)
+    {
+        cpec_frame_free(frame, size);
+    }
+};
+
+// Coroutines posted by whatever completed what they awaited, waiting to be resumed
+struct cpec_async_queue
+{
+    std::mutex mutex;
+    std::condition_variable posted;
+    std::deque<std::coroutine_handle<>> ready;
+
+    static cpec_async_queue& get()
+    {
+        static cpec_async_queue queue;
+        return queue;
+    }
+};
+
+// Safe from any thread, the coroutine is resumed by the thread driving its task
+inline void cpec_async_post(std::coroutine_handle<> coroutine)
+{
+    auto& queue = cpec_async_queue::get();
+    {
+        std::lock_guard lock(queue.mutex);
+        queue.ready.push_back(coroutine);
+    }
+    queue.posted.notify_one();
+}
+
+// Resumes the first coroutine posted, waiting for one when there's none yet
+inline void cpec_async_run_one()
+{
+    auto& queue = cpec_async_queue::get();
+    std::unique_lock lock(queue.mutex);
+    queue.posted.wait(lock, [&] { return !queue.ready.empty(); });
+    auto coroutine = queue.ready.front();
+    queue.ready.pop_front();
+    lock.unlock();
+    coroutine.resume();
+}
+
+// What an async function returns. It runs as soon as it's called up to the first await that suspends, so a caller
+// can start several before awaiting any. Awaiting it gives the value it returned once it's done, the task has to
+// be awaited, or driven with get, before it goes away
+template <typename T>
+struct cpec_task
+{
+    struct promise_type: cpec_frame_promise
+    {
+        T value;
+        // Resumed once this one is done
+        std::coroutine_handle<> continuation;
+
+        cpec_task get_return_object()
+        {
+            return cpec_task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_never initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        auto final_suspend() noexcept
+        {
+            struct finished
+            {
+                bool await_ready() noexcept
+                {
+                    return false;
+                }
+
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+                {
+                    auto continuation = handle.promise().continuation;
+                    return continuation ? continuation : std::noop_coroutine();
+                }
+
+                void await_resume() noexcept
+                {
+                }
+            };
+            return finished{};
+        }
+
+        void return_value(T returned)
+        {
+            value = returned;
+        }
+
+        void unhandled_exception()
+        {
+            std::terminate();
+        }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+
+    explicit cpec_task(std::coroutine_handle<promise_type> task) : handle(task)
+    {
+    }
+
+    cpec_task(cpec_task&& other) noexcept : handle(std::exchange(other.handle, {}))
+    {
+    }
+
+    ~cpec_task()
+    {
+        if (handle)
+            handle.destroy();
+    }
+
+    bool await_ready() const
+    {
+        return handle.done();
+    }
+
+    void await_suspend(std::coroutine_handle<> awaiting) const
+    {
+        handle.promise().continuation = awaiting;
+    }
+
+    T await_resume() const
+    {
+        return handle.promise().value;
+    }
+
+    // Waits from code that isn't a coroutine, resuming the posted coroutines until the task is done
+    T get() const
+    {
+        while (!handle.done())
+        {
+            cpec_async_run_one();
+        }
+        return handle.promise().value;
+    }
+};
+
+// What a generator function returns, for walks it. Every value the walk takes runs the generator up to its next yield
+template <typename T>
+struct cpec_generator
+{
+    struct promise_type: cpec_frame_promise
+    {
+        T value;
+
+        cpec_generator get_return_object()
+        {
+            return cpec_generator(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_always final_suspend() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_always yield_value(T yielded)
+        {
+            value = yielded;
+            return {};
+        }
+
+        void return_void()
+        {
+        }
+
+        void unhandled_exception()
+        {
+            std::terminate();
+        }
+    };
+
+    struct iterator
+    {
+        std::coroutine_handle<promise_type> handle;
+
+        T operator*() const
+        {
+            return handle.promise().value;
+        }
+
+        iterator& operator++()
+        {
+            handle.resume();
+            return *this;
+        }
+
+        bool operator==(std::default_sentinel_t) const
+        {
+            return handle.done();
+        }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+
+    explicit cpec_generator(std::coroutine_handle<promise_type> generator) : handle(generator)
+    {
+    }
+
+    cpec_generator(cpec_generator&& other) noexcept : handle(std::exchange(other.handle, {}))
+    {
+    }
+
+    ~cpec_generator()
+    {
+        if (handle)
+            handle.destroy();
+    }
+
+    iterator begin()
+    {
+        handle.resume();
+        return {handle};
+    }
+
+    std::default_sentinel_t end()
+    {
+        return {};
+    }
+};
+#endif
+)";
+}
+
+// Runtime behind arenas. An arena bumps a pointer through blocks it gets from malloc, each twice the size of the one
+// before, and frees them all when it goes out of scope. Allocating is an add and a compare on the hot path
+std::string emit_arena_runtime()
+{
+    return R"(#ifndef CPEC_ARENA_RUNTIME
+#define CPEC_ARENA_RUNTIME
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <span>
+#include <type_traits>
+
+// Size of the first block of an arena, later ones double
+constexpr size_t cpec_arena_first_block = 4096;
+
+[[noreturn]] inline void cpec_arena_failed(const char* reason)
+{
+    fprintf(stderr, "arena allocation failed: %s\n", reason);
+    abort();
+}
+
+struct cpec_arena
+{
+    // Blocks start with this header, the newest is current and links to the ones before
+    struct block
+    {
+        block* previous;
+        size_t size;
+    };
+
+    block* current = 0;
+    // Free space of current
+    char* next = 0;
+    char* end = 0;
+
+    cpec_arena() = default;
+    cpec_arena(const cpec_arena&) = delete;
+    cpec_arena& operator=(const cpec_arena&) = delete;
+
+    ~cpec_arena()
+    {
+        while (current)
+        {
+            auto previous = current->previous;
+            free(current);
+            current = previous;
+        }
+    }
+
+    static char* align_up(char* pointer, size_t align)
+    {
+        return (char*)(((uintptr_t)pointer + align - 1) & ~(uintptr_t)(align - 1));
+    }
+
+    void* allocate(size_t size, size_t align)
+    {
+        auto start = align_up(next, align);
+        if (!current || start > end || size > (size_t)(end - start)) [[unlikely]]
+            start = grow(size, align);
+        next = start + size;
+        return start;
+    }
+
+    // A block always fits the allocation asking for it, however big
+    [[gnu::noinline]] char* grow(size_t size, size_t align)
+    {
+        auto wanted = sizeof(block) + align + size;
+        if (wanted < size)
+            cpec_arena_failed("size overflows");
+        auto block_size = std::max(current ? current->size * 2 : cpec_arena_first_block, wanted);
+        auto fresh = (block*)malloc(block_size);
+        if (!fresh)
+            cpec_arena_failed("out of memory");
+        *fresh = {.previous = current, .size = block_size};
+        current = fresh;
+        end = (char*)fresh + block_size;
+        return align_up((char*)(fresh + 1), align);
+    }
+};
+
+// count zeroed elements, the span converts to one of const elements. Blocks come from malloc, which
+// implicitly creates objects of the plain types the language has, so there's nothing to construct
+template <typename T, typename Count>
+std::span<T> cpec_arena_array(cpec_arena& arena, Count count)
+{
+    static_assert(std::is_trivially_destructible_v<T>, "an arena frees its memory without destroying what's in it");
+    if constexpr (std::is_signed_v<Count>)
+    {
+        if (count < 0) [[unlikely]]
+            cpec_arena_failed("bad element count");
+    }
+    if ((unsigned long long)count > SIZE_MAX / sizeof(T)) [[unlikely]]
+        cpec_arena_failed("bad element count");
+    auto data = arena.allocate((size_t)count * sizeof(T), alignof(T));
+    memset(data, 0, (size_t)count * sizeof(T));
+    return {(T*)data, (size_t)count};
+}
+
+template <typename T>
+T* cpec_arena_new(cpec_arena& arena)
+{
+    static_assert(std::is_trivially_destructible_v<T>, "an arena frees its memory without destroying what's in it");
+    auto data = arena.allocate(sizeof(T), alignof(T));
+    memset(data, 0, sizeof(T));
+    return (T*)data;
+}
+#endif
+)";
+}
+
+// The first declaration of an output needing the bounds, parallel, coroutine or arena runtime brings it along,
+// unless a prelude header has them
+std::string with_runtimes(std::string declaration)
+{
+    std::string runtimes;
+    if (bounds_checks_emitted && !bounds_runtime_emitted)
+    {
+        bounds_runtime_emitted = true;
+        runtimes += emit_bounds_runtime();
+    }
+    if (parallel_loops_emitted && !parallel_runtime_emitted)
+    {
+        parallel_runtime_emitted = true;
+        runtimes += emit_parallel_runtime();
+    }
+    if (coroutines_emitted && !coroutine_runtime_emitted)
+    {
+        coroutine_runtime_emitted = true;
+        runtimes += emit_coroutine_runtime();
+    }
+    if (arenas_emitted && !arena_runtime_emitted)
+    {
+        arena_runtime_emitted = true;
+        runtimes += emit_arena_runtime();
+    }
+    return runtimes + declaration;
+}
+
+// Headers and VarType typedefs every generated file relies on
+std::string emit_prelude()
+{
+    std::string out = "#pragma once\n#include <stdint.h>\n#include <concepts>\n#include <memory>\n#include <span>\n#include <vector>\n\n";
+    for (auto i = 1; i < COUNTOF(var_types); i++)
+    {
+        if (i != VarType::Bool)
+            out += std::format("typedef {} {};\n", c_type((VarType)i), var_types[i]);
+    }
+    out += "\n" + emit_bounds_runtime();
+    out += "\n" + emit_parallel_runtime();
+    out += "\n" + emit_coroutine_runtime();
+    out += "\n" + emit_arena_runtime();
+    if (instrument_functions)
+        out += "\n" + emit_profile_runtime();
+    return out;
+}
@@ -0,0 +1,232 @@
+#pragma once
+#include "backend.cpp"
+#include "inputs.cpp"
+
+// A parsed top-level declaration, for whatever wants the tree besides the backend
+struct TopLevelDecl
+{
+    enum Type { Function, TypeDecl, Stmt } type;
+    struct Function function;
+    struct TypeDecl* type_decl;
+    struct Stmt* stmt;
+};
+
+// Collects every declaration compile_top_level parses when set
+std::vector<TopLevelDecl>* parsed_declarations;
+
+std::string emit_top_level(TopLevelDecl& declaration)
+{
+    if (declaration.type == TopLevelDecl::Function)
+        return emit_function(declaration.function);
+    if (declaration.type == TopLevelDecl::TypeDecl)
+        return emit_type_decl(declaration.type_decl);
+    return emit_stmt(declaration.stmt, 0);
+}
+
+// Parses the top-level declaration starting at lex_token and returns its C++,
+// errors are already reported through print_error when this fails
+ErrorOr<std::string> compile_top_level(LexBuffer& lex_buffer, LexToken lex_token)
+{
+    // Declarations that fail halfway leave their parameters behind, callers may keep going
+    auto scope_size = scope_vars.size();
+    std::vector<TypeDecl*> type_params;
+    auto fail = [&]() -> ErrorOr<std::string>
+    {
+        forget_type_params(type_params);
+        scope_vars.resize(scope_size);
+        return {};
+    };
+
+    if (lex_token.type == LexToken::Keyword && lex_token.keyword == Keyword::Generic)
+    {
+        auto error = lex_generic(lex_buffer);
+        if (error.error) return fail();
+        type_params = error.content;
+        lex_token = lex_string(lex_buffer, false);
+    }
+
+    auto coroutine = Coroutine::None;
+    if (lex_token.type == LexToken::Keyword && (lex_token.keyword == Keyword::Async || lex_token.keyword == Keyword::Generator))
+    {
+        coroutine = lex_token.keyword == Keyword::Async ? Coroutine::Async : Coroutine::Generator;
+        lex_token = lex_string(lex_buffer, false);
+        if (!possibly_var(lex_token.type))
+        {
+            print_expectation_error(lex_buffer, lex_token, {"variable type"});
+            return fail();
+        }
+    }
+
+    auto is_constexpr = lex_token.type == LexToken::Keyword && lex_token.keyword == Keyword::Const;
+    if (is_constexpr || possibly_var(lex_token.type))
+    {
+        auto error = is_constexpr ? lex_const_var(lex_buffer) : lex_var(lex_buffer, lex_token);
+        if (error.error) return fail();
+        auto variable = error.content;
+
+        lex_token = lex_string(lex_buffer, false);
+        if (lex_token.type != LexToken::Name)
+        {
+            print_expectation_error(lex_buffer, lex_token, {"name"});
+            return fail();
+        }
+        // The C++ task or generator is declared with the type it carries
+        if (coroutine && variable.var_type == VarType::Any && variable.modifier.empty() && !variable.user_type)
+        {
+            print_error(lex_buffer, lex_token, coroutine == Coroutine::Async ? "async function needs a return type" : "generator function needs the type it yields", 0);
+            return fail();
+        }
+
+        variable.name = lex_token.name;
+        lex_token = lex_string(lex_buffer, false);
+        if (lex_token.type == LexToken::StartParen)
+        {
+            auto error = lex_function(lex_buffer, variable, coroutine);
+            if (error.error) return fail();
+            auto function = error.content;
+            function.is_constexpr = is_constexpr;
+            function.type_params = type_params;
+            if (parsed_declarations)
+                parsed_declarations->push_back({.type = TopLevelDecl::Function, .function = function});
+            PhaseScope emitting(PhaseStats::Emit);
+            auto output = emit_function(function);
+            forget_type_params(type_params);
+            return output;
+        }
+        else if (lex_token.type == LexToken::Assign && type_params.empty() && !coroutine)
+        {
+            auto error = lex_var_init(lex_buffer, variable);
+            if (error.error) return fail();
+            auto stmt = error.content;
+            stmt->is_constexpr = is_constexpr;
+            if (parsed_declarations)
+                parsed_declarations->push_back({.type = TopLevelDecl::Stmt, .stmt = stmt});
+            PhaseScope emitting(PhaseStats::Emit);
+            return emit_stmt(stmt, 0);
+        }
+
+        if (coroutine)
+            print_expectation_error(lex_buffer, lex_token, {"("});
+        else
+            print_expectation_error(lex_buffer, lex_token, {"(", "="});
+        return fail();
+    }
+    else if (!type_params.empty())
+    {
+        print_expectation_error(lex_buffer, lex_token, {"function"});
+        return fail();
+    }
+    else if (lex_token.type == LexToken::Keyword && (lex_token.keyword == Keyword::Enum || lex_token.keyword == Keyword::Struct || lex_token.keyword == Keyword::Union))
+    {
+        auto error = lex_type_decl(lex_buffer, lex_token.keyword);
+        if (error.error) return fail();
+        if (parsed_declarations)
+            parsed_declarations->push_back({.type = TopLevelDecl::TypeDecl, .type_decl = error.content});
+        PhaseScope emitting(PhaseStats::Emit);
+        return emit_type_decl(error.content);
+    }
+    else if (lex_token.type == LexToken::Keyword && lex_token.keyword == Keyword::While)
+    {
+        auto error = lex_while(lex_buffer);
+        if (error.error) return fail();
+        if (parsed_declarations)
+            parsed_declarations->push_back({.type = TopLevelDecl::Stmt, .stmt = error.content});
+        PhaseScope emitting(PhaseStats::Emit);
+        return emit_stmt(error.content, 0);
+    }
+    else if (lex_token.type == LexToken::SLComment)
+    {
+        skip_line(lex_buffer);
+        return std::string();
+    }
+
+    print_error(lex_buffer, lex_token, "expected a declaration", 0);
+    return fail();
+}
+
+// Set once the prelude lives in its own header, every generated file then starts with it
+std::string prelude_include;
+
+// What every generated file starts with. Without a prelude header the profiling runtime goes in each file,
+// and the bounds, parallel, coroutine and arena runtimes go ahead of the first declaration needing them
+std::string output_preamble()
+{
+    bounds_checks_emitted = false;
+    bounds_runtime_emitted = !prelude_include.empty();
+    parallel_loops_emitted = false;
+    parallel_runtime_emitted = !prelude_include.empty();
+    coroutines_emitted = false;
+    coroutine_runtime_emitted = !prelude_include.empty();
+    arenas_emitted = false;
+    arena_runtime_emitted = !prelude_include.empty();
+    if (instrument_functions && prelude_include.empty())
+        return emit_profile_runtime();
+    return prelude_include;
+}
+
+// Files compiled on their own don't see what earlier files declared, or how pure their functions were
+void forget_declarations()
+{
+    scope_vars.clear();
+    type_decls.clear();
+    generator_yields.clear();
+    function_purities.clear();
+    parsed_type_decls.clear();
+}
+
+// Appends the C++ for every declaration that compiled, stopping at the first error.
+// Type definitions go to type_definitions instead when given, named so they can be merged across files
+bool compile_file(Buffer file_buffer, const wchar_t* file_path, std::string& output, std::vector<std::pair<std::string, std::string>>* type_definitions = 0)
+{
+    LexBuffer lex_buffer;
+    lex_buffer.buffer = file_buffer;
+    lex_buffer.file_path = file_path;
+    lex_buffer.line_num = 1;
+    lex_buffer.string = lex_buffer.buffer.content;
+    if (instrument_functions || profile.loaded)
+        instrument_source = wide_to_utf8(file_path);
+    PhaseScope parsing(PhaseStats::Parse, phase_stats_enabled ? file_stats(file_path) : 0);
+
+    while (true)
+    {
+        auto lex_token = lex_string(lex_buffer, false);
+        if (lex_token.type == LexToken::Eof)
+            return true;
+
+        auto is_type_decl = lex_token.type == LexToken::Keyword && (lex_token.keyword == Keyword::Enum || lex_token.keyword == Keyword::Struct || lex_token.keyword == Keyword::Union);
+        auto name_token = is_type_decl ? lex_string(lex_buffer, true) : lex_token;
+
+        auto error = compile_top_level(lex_buffer, lex_token);
+        if (error.error)
+            return false;
+
+        if (is_type_decl && type_definitions)
+            type_definitions->emplace_back(std::string(name_token.name, name_token.string_size), error.content);
+        else
+            output += with_runtimes(error.content);
+    }
+}
+
+// Parses the inputs as one program into declarations. They point into file_buffers,
+// which the caller frees once it's done with the tree, whether or not parsing failed
+bool parse_inputs(std::vector<std::wstring>& inputs, std::vector<TopLevelDecl>& declarations, std::vector<Buffer>& file_buffers)
+{
+    parsed_declarations = &declarations;
+    auto parsed = true;
+    for (auto& input: inputs)
+    {
+        auto file_buffer = read_file_to_unix_buffer(input.c_str());
+        if (!file_buffer.content)
+        {
+            parsed = false;
+            break;
+        }
+        file_buffers.push_back(file_buffer);
+
+        std::string output;
+        if (!compile_file(file_buffer, input.c_str(), output))
+            parsed = false;
+    }
+    parsed_declarations = 0;
+    return parsed;
+}
@@ -1,10 +1,10 @@
+#pragma once
 #include <limits>
-#include <stdint.h>
+#include <string>
 #include "windows_framework.h"
 #include "utils.h"
-
-typedef int64_t i64;
-typedef uint64_t u64;
+#include "memory.cpp"
+#include "phase_stats.cpp"
 
 struct Buffer {
 	char* content;
@@ -16,6 +16,18 @@ struct FileView {
 	const Buffer buffer;
 };
 
+// FNV-1a, used to tell whether contents changed, not for anything adversarial
+u64 hash_buffer(const Buffer& buffer)
+{
+	u64 result = 14695981039346656037ull;
+	for (u64 i = 0; i < buffer.size; i++)
+	{
+		result ^= (unsigned char)buffer.content[i];
+		result *= 1099511628211ull;
+	}
+	return result;
+}
+
 HANDLE create_wo_file(const wchar_t* file_path)
 {
 	const auto file_handle = CreateFileW(file_path, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
@@ -74,6 +86,28 @@ bool write_file(const HANDLE file_handle, const wchar_t* file_path, const Buffer
 	return 0;
 }
 
+// Readers of the file never see it half written
+bool write_file_atomically(const wchar_t* file_path, const Buffer& file_buffer)
+{
+	const auto temp_path = std::wstring(file_path) + L".tmp";
+	const auto file_handle = create_wo_file(temp_path.c_str());
+	if (!file_handle)
+		return 0;
+
+	const auto written = write_file(file_handle, temp_path.c_str(), file_buffer);
+	CloseHandle(file_handle);
+	if (!written)
+		return 0;
+
+	if (!MoveFileExW(temp_path.c_str(), file_path, MOVEFILE_REPLACE_EXISTING))
+	{
+		DebugLog(L"Failed to replace file \"%ls\"!\n", file_path);
+		return 0;
+	}
+
+	return 1;
+}
+
 HANDLE open_ro_file(const wchar_t* file_path)
 {
 	const auto file_handle = CreateFileW(file_path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
@@ -112,100 +146,97 @@ const FileView create_ro_file_view(const wchar_t* file_path)
 	const auto file_handle = open_ro_file(file_path);
 	if (!file_handle) return result;
 
+	const auto file_view_size = get_file_size(file_handle);
+	if (!file_view_size) {
+		DebugLog(L"Failed to get file size of file \"%ls\"!\n", file_path);
+		CloseHandle(file_handle);
+		return result;
+	}
+
 	const auto file_map = CreateFileMappingW(file_handle, 0, PAGE_READONLY, 0, 0, 0);
 	if (!file_map)
 	{
 		DebugLog(L"Failed to create file mapping of file \"%ls\"!\n", file_path);
 		if (GetLastError() == ERROR_FILE_INVALID)
 			DebugLog(L"File \"%ls\" is empty!\n", file_path);
+		CloseHandle(file_handle);
 		return result;
 	}
 
+	// The view keeps the mapping alive on its own
 	const auto file_view = (char*)MapViewOfFile(file_map, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(file_map);
 	if (!file_view)
 	{
 		DebugLog(L"Failed to create file view of file \"%ls\"!\n", file_path);
-		return result;
-	}
-
-	const auto file_view_size = get_file_size(file_handle);
-	if (!file_view_size) {
-		DebugLog(L"Failed to get file size of file \"%ls\"!\n", file_path);
+		CloseHandle(file_handle);
 		return result;
 	}
 
 	return {.handle = file_handle, .buffer = {.content = file_view, .size = file_view_size}};
 }
 
-u64 read_file_view_to_unix_buffer(char* out_buffer, const FileView file_view, const wchar_t* file_path)
+void close_file_view(const FileView& file_view)
 {
-	if (!strstr(file_view.buffer.content, "\r\n"))
-	{
-#ifdef DEBUG
-		DebugLog(L"File \"%ls\" is unix\n", file_path);
-#endif
-		size_t size;
-		if (strcmp(&file_view.buffer.content[file_view.buffer.size-1], "\n") == 0)
-			size = file_view.buffer.size - 1;
-		else
-			size = file_view.buffer.size;
-
-		memcpy(out_buffer, file_view.buffer.content, size);
-		return size;
-	}
-
-#ifdef DEBUG
-	DebugLog(L"File \"%ls\" is dos\n", file_path);
-#endif
-
-	u64 result = file_view.buffer.size;
+	UnmapViewOfFile(file_view.buffer.content);
+	CloseHandle(file_view.handle);
+}
 
-	auto out_buffer_end = out_buffer;
-	auto haystack = file_view.buffer.content;
-	const char* last_dos_le = 0;
-	while (true)
+// CRLF line endings become LF and a final line break is dropped. The view isn't null terminated,
+// every scan is bounded by its size
+u64 read_file_view_to_unix_buffer(char* out_buffer, const FileView file_view, const wchar_t* file_path)
+{
+	auto in = file_view.buffer.content;
+	const auto end = in + file_view.buffer.size;
+	auto out = out_buffer;
+	while (in < end)
 	{
-		const auto dos_le = strstr(haystack, "\r\n");
-		if (!dos_le) {
-			const auto eof = file_view.buffer.content + file_view.buffer.size;
-			if (last_dos_le != eof - 2)
-			{
-				// File doesn't have eol
-				memcpy(out_buffer_end, haystack, eof - haystack);
-				break;
-			}
-			result--;
+		const auto carriage_return = (char*)memchr(in, '\r', end - in);
+		const auto segment_end = carriage_return ? carriage_return : end;
+		memcpy(out, in, segment_end - in);
+		out += segment_end - in;
+		in = segment_end;
+		if (!carriage_return)
 			break;
-		}
 
-		const auto size = dos_le - haystack;
-		memcpy(out_buffer_end, haystack, size);
-		out_buffer_end += size;
-		haystack = dos_le + 1;
-		result--;
-		last_dos_le = dos_le;
+		// A lone CR isn't a line ending and stays
+		if (in + 1 == end || in[1] != '\n')
+			*out++ = '\r';
+		in++;
 	}
 
-	return result;
+	if (out > out_buffer && out[-1] == '\n')
+		out--;
+	return out - out_buffer;
 }
 
 const Buffer read_file_to_unix_buffer(const wchar_t* file_path)
 {
+	const auto stats = phase_stats_enabled ? file_stats(file_path) : 0;
+	PhaseScope reading(PhaseStats::Read, stats);
+
 	const auto file_view = create_ro_file_view(file_path);
 	if (!file_view.buffer.content)
 		return {};
 
-	const auto file_buffer = (char*)VirtualAlloc(0, file_view.buffer.size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	// The zeroed byte past the content terminates it for the lexer
+	const auto file_buffer = (char*)memory_alloc(file_view.buffer.size + 1, MemoryStats::Input);
 	if (!file_buffer)
 	{
-		DebugLog(L"Failed to allocate memory!\n");
+		close_file_view(file_view);
 		return {};
 	}
 
 	const auto file_buffer_size = read_file_view_to_unix_buffer(file_buffer, file_view, file_path);
 
-	CloseHandle(file_view.handle);
-	UnmapViewOfFile(file_view.buffer.content);
+	close_file_view(file_view);
+	if (stats)
+		stats->size = file_buffer_size;
 
 	return {.content = file_buffer, .size = file_buffer_size};
 }
+
+void free_file_buffer(const Buffer& file_buffer)
+{
+	memory_free(file_buffer.content);
+}
@@ -0,0 +1,197 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "file_utils.cpp"
+#include "utils.h"
+
+// Directory arguments pick up the files matching the include globs that no exclude glob matches,
+// both given before the directory on the command line
+struct InputFilter
+{
+    std::vector<std::wstring> includes = {L"*.cpe"};
+    std::vector<std::wstring> excludes;
+    bool default_includes = true;
+};
+
+bool is_separator(wchar_t c)
+{
+    return c == L'\\' || c == L'/';
+}
+
+// * and ? stay within a path component, ** crosses them
+bool glob_match(const wchar_t* pattern, const wchar_t* path)
+{
+    while (*pattern)
+    {
+        if (pattern[0] == L'*' && pattern[1] == L'*')
+        {
+            pattern += 2;
+            if (is_separator(*pattern)) pattern++;
+            for (auto rest = path; ; rest++)
+            {
+                if (glob_match(pattern, rest)) return true;
+                if (!*rest) return false;
+            }
+        }
+        if (*pattern == L'*')
+        {
+            pattern++;
+            for (auto rest = path; ; rest++)
+            {
+                if (glob_match(pattern, rest)) return true;
+                if (!*rest || is_separator(*rest)) return false;
+            }
+        }
+        if (!*path)
+            return false;
+        if (*pattern == L'?' ? is_separator(*path) : !(*pattern == *path || is_separator(*pattern) && is_separator(*path)))
+            return false;
+        pattern++;
+        path++;
+    }
+    return !*path;
+}
+
+// Globs without a separator match the file name, the others the path below the directory argument
+bool glob_match_any(const std::vector<std::wstring>& globs, const std::wstring& relative_path, const wchar_t* name)
+{
+    for (auto& glob: globs)
+    {
+        auto has_separator = glob.find_first_of(L"\\/") != std::wstring::npos;
+        if (glob_match(glob.c_str(), has_separator ? relative_path.c_str() : name))
+            return true;
+    }
+    return false;
+}
+
+void collect_directory(const std::wstring& directory, const std::wstring& relative_path, InputFilter& filter, std::vector<std::wstring>& inputs)
+{
+    WIN32_FIND_DATAW find_data;
+    auto find_handle = FindFirstFileW((directory + L"\\*").c_str(), &find_data);
+    if (find_handle == INVALID_HANDLE_VALUE)
+    {
+        fprintf(stderr, "Failed to list directory \"%ls\"!\n", directory.c_str());
+        return;
+    }
+
+    do
+    {
+        auto name = find_data.cFileName;
+        if (wcscmp(name, L".") == 0 || wcscmp(name, L"..") == 0)
+            continue;
+
+        auto path = directory + L"\\" + name;
+        auto relative = relative_path.empty() ? std::wstring(name) : relative_path + L"\\" + name;
+        if (glob_match_any(filter.excludes, relative, name))
+            continue;
+
+        if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            collect_directory(path, relative, filter, inputs);
+        else if (glob_match_any(filter.includes, relative, name))
+            inputs.push_back(path);
+    } while (FindNextFileW(find_handle, &find_data));
+
+    FindClose(find_handle);
+}
+
+std::wstring utf8_to_wide(const char* string, int size)
+{
+    std::wstring result(MultiByteToWideChar(CP_UTF8, 0, string, size, 0, 0), 0);
+    MultiByteToWideChar(CP_UTF8, 0, string, size, result.data(), result.size());
+    return result;
+}
+
+std::string wide_to_utf8(const wchar_t* string)
+{
+    auto size = wcslen(string);
+    std::string result(WideCharToMultiByte(CP_UTF8, 0, string, size, 0, 0, 0, 0), 0);
+    WideCharToMultiByte(CP_UTF8, 0, string, size, result.data(), result.size(), 0, 0);
+    return result;
+}
+
+bool collect_arguments(std::vector<std::wstring>& arguments, InputFilter& filter, std::vector<std::wstring>& inputs, int depth);
+
+// Arguments in a response file are separated by blanks or line breaks, quotes keep blanks in a path.
+// The mapping is read in place, it's not null terminated so the size bounds every scan
+bool collect_response_file(const wchar_t* file_path, InputFilter& filter, std::vector<std::wstring>& inputs, int depth)
+{
+    auto file_view = create_ro_file_view(file_path);
+    if (!file_view.buffer.content)
+        return false;
+
+    std::vector<std::wstring> arguments;
+    auto string = file_view.buffer.content;
+    auto end = string + file_view.buffer.size;
+    while (string < end)
+    {
+        while (string < end && (*string == ' ' || *string == '\t' || *string == '\r' || *string == '\n')) string++;
+        if (string == end)
+            break;
+
+        auto quoted = *string == '"';
+        if (quoted) string++;
+        auto start = string;
+        while (string < end && (quoted ? *string != '"' : !(*string == ' ' || *string == '\t' || *string == '\r' || *string == '\n'))) string++;
+        arguments.push_back(utf8_to_wide(start, string - start));
+        if (quoted && string < end) string++;
+    }
+
+    close_file_view(file_view);
+    return collect_arguments(arguments, filter, inputs, depth + 1);
+}
+
+bool collect_arguments(std::vector<std::wstring>& arguments, InputFilter& filter, std::vector<std::wstring>& inputs, int depth)
+{
+    // Response files naming themselves would never end
+    if (depth > 16)
+    {
+        fprintf(stderr, "Response files are nested too deep!\n");
+        return false;
+    }
+
+    for (auto i = 0; i < arguments.size(); i++)
+    {
+        auto& argument = arguments[i];
+        if ((argument == L"--include" || argument == L"--exclude") && i + 1 < arguments.size())
+        {
+            auto& globs = argument == L"--include" ? filter.includes : filter.excludes;
+            if (&globs == &filter.includes && filter.default_includes)
+            {
+                filter.includes.clear();
+                filter.default_includes = false;
+            }
+            globs.push_back(arguments[++i]);
+        }
+        else if (argument[0] == L'@')
+        {
+            if (!collect_response_file(argument.c_str() + 1, filter, inputs, depth))
+                return false;
+        }
+        else
+        {
+            auto attributes = GetFileAttributesW(argument.c_str());
+            if (attributes != INVALID_FILE_ATTRIBUTES && attributes & FILE_ATTRIBUTE_DIRECTORY)
+            {
+                while (argument.size() > 1 && is_separator(argument.back())) argument.pop_back();
+                collect_directory(argument, L"", filter, inputs);
+            }
+            else
+            {
+                inputs.push_back(argument);
+            }
+        }
+    }
+    return true;
+}
+
+// Expands @response files and directories into the list of files to compile
+ErrorOr<std::vector<std::wstring>> collect_inputs(int argc, const wchar_t** argv)
+{
+    std::vector<std::wstring> arguments(argv, argv + argc);
+    std::vector<std::wstring> inputs;
+    InputFilter filter;
+    if (!collect_arguments(arguments, filter, inputs, 0))
+        return {};
+    return inputs;
+}
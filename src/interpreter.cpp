@@ -0,0 +1,1413 @@
+#pragma once
+#include <math.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "driver.cpp"
+
+// Runs a program straight from its parse, so a script doesn't wait on a C++ compile. Functions are
+// compiled to bytecode for a register machine: numbers, spans, let/mut bindings, while and for loops,
+// element-wise statements, calls and enum values are supported, pointers and user types aren't
+
+// Registers hold integers wrapped to the width of their VarType, reals as double and spans as data and size
+struct RunValue
+{
+    union
+    {
+        i64 i;
+        u64 u;
+        double f;
+        char* data;
+    };
+    u64 size;
+};
+
+// Static type of a register, VarType::Any without is_span when the expression has no value
+struct RunType
+{
+    enum VarType var_type;
+    bool is_span;
+    bool mutable_elements;
+};
+
+#define RUN_OPS(X) \
+    X(LoadConst) X(Move) X(Convert) \
+    X(AddI) X(SubI) X(MulI) X(DivI) X(DivU) X(ModI) X(ModU) X(NegI) \
+    X(AddF) X(SubF) X(MulF) X(DivF) X(NegF) X(Not) \
+    X(EqI) X(NeI) X(LtI) X(LeI) X(LtU) X(LeU) X(EqF) X(NeF) X(LtF) X(LeF) \
+    X(Jump) X(JumpIfFalse) X(JumpIfTrue) X(LoadGlobal) X(StoreGlobal) \
+    X(LoadElement) X(StoreElement) X(CheckIndex) X(CheckLength) X(Length) X(Call) X(Return) X(ReturnVoid) X(MissingReturn)
+
+struct RunOp
+{
+#define RUN_OP_ENUM(name) name,
+    enum Type : u8 { RUN_OPS(RUN_OP_ENUM) };
+#undef RUN_OP_ENUM
+};
+
+// a is the destination when there is one. Integer arithmetic wraps its result to type, Convert
+// goes from the VarType in c to type, element accesses read and write type
+struct Instruction
+{
+    RunOp::Type op;
+    enum VarType type;
+    u32 a;
+    u32 b;
+    u32 c;
+};
+
+struct RunFunction
+{
+    std::string name;
+    // 0 for the function running the top-level statements
+    Function* source;
+    std::vector<RunType> param_types;
+    std::vector<bool> mutable_params;
+    RunType return_type;
+    // Declared without a type, the first return with a value decides it
+    bool infer_return;
+    enum State { Pending, Compiling, Compiled } state;
+
+    std::vector<Instruction> code;
+    std::vector<RunValue> constants;
+    u32 register_count;
+};
+
+struct RunGlobal
+{
+    RunType type;
+    bool is_mutable;
+};
+
+struct RunProgram
+{
+    std::vector<RunFunction> functions;
+    std::unordered_map<std::string, u32> function_indices;
+    std::vector<RunGlobal> globals;
+    std::unordered_map<std::string, u32> global_indices;
+};
+
+struct RunLocal
+{
+    std::string name;
+    u32 reg;
+    RunType type;
+    bool is_mutable;
+};
+
+struct RunOperand
+{
+    u32 reg;
+    RunType type;
+    // Known while compiling, converting it costs nothing at run time
+    bool is_constant;
+    RunValue value;
+};
+
+struct RunCompiler
+{
+    RunProgram& program;
+    RunFunction& function;
+    std::vector<RunLocal> locals;
+    u32 next_register;
+    // Top-level declarations of the init function become globals
+    int block_depth;
+    // Index register of the element-wise statement being compiled, ~0u outside of one
+    u32 element_index;
+    // Latest position a jump lands on
+    u32 label;
+    bool failed;
+};
+
+constexpr u32 run_no_register = ~0u;
+constexpr RunType run_void = {.var_type = VarType::Any};
+
+template <typename... Args>
+void run_error(RunCompiler& compiler, std::format_string<Args...> format, Args&&... args)
+{
+    if (!compiler.failed)
+        fprintf(stderr, "%s: %s\n", compiler.function.name.c_str(), std::format(format, std::forward<Args>(args)...).c_str());
+    compiler.failed = true;
+}
+
+bool is_void(RunType type)
+{
+    return type.var_type == VarType::Any && !type.is_span;
+}
+
+bool is_real(enum VarType var_type)
+{
+    return var_type == VarType::Real32 || var_type == VarType::Real64;
+}
+
+ErrorOr<RunType> run_type(Var var)
+{
+    auto var_type = var.var_type;
+    if (var.user_type)
+    {
+        if (var.user_type->type != TypeDecl::Enum)
+            return {};
+        var_type = var.user_type->underlying_type ? var.user_type->underlying_type : VarType::I32;
+    }
+
+    if (var.modifier.empty())
+        return RunType{.var_type = var_type};
+    if (var.modifier.size() == 1 && var.modifier[0] == Var::Array && var_type != VarType::Any)
+        return RunType{.var_type = var_type, .is_span = true, .mutable_elements = var.is_mutable[1]};
+    return {};
+}
+
+// The usual arithmetic conversions of C++, so results match the generated code
+enum VarType arithmetic_type(enum VarType a, enum VarType b)
+{
+    if (a == VarType::Real64 || b == VarType::Real64)
+        return VarType::Real64;
+    if (a == VarType::Real32 || b == VarType::Real32)
+        return VarType::Real32;
+
+    auto promote = [](enum VarType var_type) { return var_type_sizes[var_type] < 4 || var_type == VarType::Bool ? VarType::I32 : var_type; };
+    a = promote(a);
+    b = promote(b);
+    if (a == b)
+        return a;
+    if (var_type_signed[a] == var_type_signed[b])
+        return var_type_sizes[a] > var_type_sizes[b] ? a : b;
+
+    auto unsigned_type = var_type_signed[a] ? b : a;
+    auto signed_type = var_type_signed[a] ? a : b;
+    return var_type_sizes[unsigned_type] >= var_type_sizes[signed_type] ? unsigned_type : signed_type;
+}
+
+i64 wrap_integer(i64 value, enum VarType var_type)
+{
+    switch (var_type)
+    {
+        case VarType::I8: return (int8_t)value;
+        case VarType::I16: return (int16_t)value;
+        case VarType::I32: return (int32_t)value;
+        case VarType::U8: return (uint8_t)value;
+        case VarType::U16: return (uint16_t)value;
+        case VarType::U32: return (uint32_t)value;
+        case VarType::Bool: return value != 0;
+        default: return value;
+    }
+}
+
+RunValue convert_value(RunValue value, enum VarType from, enum VarType to)
+{
+    RunValue result = {};
+    if (is_real(to))
+    {
+        auto real = is_real(from) ? value.f : var_type_signed[from] ? (double)value.i : (double)value.u;
+        result.f = to == VarType::Real32 ? (float)real : real;
+    }
+    else if (is_real(from))
+    {
+        result.i = to == VarType::Bool ? value.f != 0 : wrap_integer(var_type_signed[to] || value.f < 0 ? (i64)value.f : (i64)(u64)value.f, to);
+    }
+    else
+    {
+        result.i = wrap_integer(value.i, to);
+    }
+    return result;
+}
+
+u32 emit(RunCompiler& compiler, Instruction instruction)
+{
+    compiler.function.code.push_back(instruction);
+    return compiler.function.code.size() - 1;
+}
+
+// Points a jump emitted earlier at the next instruction
+void patch_jump(RunCompiler& compiler, u32 jump)
+{
+    compiler.function.code[jump].a = compiler.label = compiler.function.code.size();
+}
+
+// Position of the next instruction, for jumps back to it
+u32 mark_label(RunCompiler& compiler)
+{
+    return compiler.label = compiler.function.code.size();
+}
+
+u32 new_register(RunCompiler& compiler)
+{
+    auto reg = compiler.next_register++;
+    compiler.function.register_count = std::max(compiler.function.register_count, compiler.next_register);
+    return reg;
+}
+
+u32 add_constant(RunCompiler& compiler, RunValue value)
+{
+    compiler.function.constants.push_back(value);
+    return compiler.function.constants.size() - 1;
+}
+
+RunOperand load_constant(RunCompiler& compiler, RunValue value, enum VarType var_type)
+{
+    auto reg = new_register(compiler);
+    emit(compiler, {.op = RunOp::LoadConst, .a = reg, .b = add_constant(compiler, value)});
+    return {reg, {.var_type = var_type}, true, value};
+}
+
+RunLocal* find_local(RunCompiler& compiler, const std::string& name)
+{
+    for (auto i = (int)compiler.locals.size() - 1; i >= 0; i--)
+    {
+        if (compiler.locals[i].name == name)
+            return &compiler.locals[i];
+    }
+    return 0;
+}
+
+// Locals stay in their registers until the block declaring them ends, temporaries only for a statement
+void free_temporaries(RunCompiler& compiler)
+{
+    compiler.next_register = compiler.locals.empty() ? compiler.function.param_types.size() : std::max<u32>(compiler.locals.back().reg + 1, compiler.function.param_types.size());
+}
+
+// Makes the last instruction write to dest when it produced the temporary operand, instead of moving it there
+bool retarget_last(RunCompiler& compiler, RunOperand operand, u32 dest)
+{
+    auto& code = compiler.function.code;
+    if (code.empty() || compiler.label == code.size() || code.back().a != operand.reg || operand.reg < compiler.function.param_types.size())
+        return false;
+
+    switch (code.back().op)
+    {
+        case RunOp::Jump: case RunOp::JumpIfFalse: case RunOp::JumpIfTrue: case RunOp::StoreGlobal: case RunOp::StoreElement: case RunOp::CheckIndex: case RunOp::CheckLength:
+        case RunOp::Return: case RunOp::ReturnVoid: case RunOp::MissingReturn:
+            return false;
+        default:
+            break;
+    }
+    for (auto& local: compiler.locals)
+    {
+        if (local.reg == operand.reg)
+            return false;
+    }
+
+    code.back().a = dest;
+    return true;
+}
+
+// Converts into dest, or into a new register unless the operand already has the type
+RunOperand convert(RunCompiler& compiler, RunOperand operand, RunType to, u32 dest = run_no_register)
+{
+    if (is_void(operand.type))
+    {
+        run_error(compiler, "expression has no value");
+        return operand;
+    }
+    if (operand.type.is_span != to.is_span || to.is_span && (operand.type.var_type != to.var_type || to.mutable_elements && !operand.type.mutable_elements))
+    {
+        run_error(compiler, "can't convert between a span and a number or spans of different elements");
+        return operand;
+    }
+
+    auto same = to.is_span || operand.type.var_type == to.var_type;
+    if (same && (dest == run_no_register || dest == operand.reg))
+        return {operand.reg, to, operand.is_constant, operand.value};
+
+    if (dest == run_no_register)
+        dest = new_register(compiler);
+    if (operand.is_constant)
+    {
+        auto value = convert_value(operand.value, operand.type.var_type, to.var_type);
+        // The load of the unconverted constant is dead once it's replaced
+        auto& code = compiler.function.code;
+        if (code.back().op == RunOp::LoadConst && retarget_last(compiler, operand, dest))
+            code.back().b = add_constant(compiler, value);
+        else
+            emit(compiler, {.op = RunOp::LoadConst, .a = dest, .b = add_constant(compiler, value)});
+        return {dest, to, true, value};
+    }
+    if (same && !retarget_last(compiler, operand, dest))
+        emit(compiler, {.op = RunOp::Move, .a = dest, .b = operand.reg});
+    else if (!same)
+        emit(compiler, {.op = RunOp::Convert, .type = to.var_type, .a = dest, .b = operand.reg, .c = (u32)operand.type.var_type});
+    return {dest, to};
+}
+
+RunOperand convert(RunCompiler& compiler, RunOperand operand, enum VarType to)
+{
+    return convert(compiler, operand, {.var_type = to});
+}
+
+bool is_comparison(LexToken::Type type)
+{
+    return type == LexToken::Equal || type == LexToken::NotEqual || type == LexToken::LessThen || type == LexToken::BiggerThen || type == LexToken::LessEqual || type == LexToken::BiggerEqual;
+}
+
+bool expect_number(RunCompiler& compiler, RunOperand operand)
+{
+    if (operand.type.is_span || is_void(operand.type))
+    {
+        run_error(compiler, "operand must be a number");
+        return false;
+    }
+    return true;
+}
+
+RunOperand compile_expr(RunCompiler& compiler, Expr* expr);
+void compile_function(RunProgram& program, u32 index);
+
+RunOperand compile_number(RunCompiler& compiler, Expr* expr)
+{
+    auto text = std::string(expr->token.name, expr->token.string_size);
+    RunValue value = {};
+    if (text.find('.') != std::string::npos)
+    {
+        value.f = strtod(text.c_str(), 0);
+        return load_constant(compiler, value, VarType::Real64);
+    }
+
+    // An unsuffixed literal is an int in C++ unless it doesn't fit
+    value.u = strtoull(text.c_str(), 0, 10);
+    return load_constant(compiler, value, value.u <= INT32_MAX ? VarType::I32 : value.u <= INT64_MAX ? VarType::I64 : VarType::U64);
+}
+
+RunOperand compile_arithmetic(RunCompiler& compiler, LexToken::Type op, RunOperand lhs, RunOperand rhs)
+{
+    if (!expect_number(compiler, lhs) || !expect_number(compiler, rhs))
+        return lhs;
+
+    auto var_type = arithmetic_type(lhs.type.var_type, rhs.type.var_type);
+    lhs = convert(compiler, lhs, var_type);
+    rhs = convert(compiler, rhs, var_type);
+    auto real = is_real(var_type);
+    auto is_signed = var_type_signed[var_type];
+
+    RunOp::Type run_op;
+    switch (op)
+    {
+        case LexToken::Plus: case LexToken::PlusAssign: run_op = real ? RunOp::AddF : RunOp::AddI; break;
+        case LexToken::Minus: case LexToken::MinusAssign: run_op = real ? RunOp::SubF : RunOp::SubI; break;
+        case LexToken::Multiply: case LexToken::MultiplyAssign: run_op = real ? RunOp::MulF : RunOp::MulI; break;
+        case LexToken::Divide: case LexToken::DivideAssign: run_op = real ? RunOp::DivF : is_signed ? RunOp::DivI : RunOp::DivU; break;
+        default:
+            if (real)
+            {
+                run_error(compiler, "% needs integer operands");
+                return lhs;
+            }
+            run_op = is_signed ? RunOp::ModI : RunOp::ModU;
+    }
+
+    auto reg = new_register(compiler);
+    emit(compiler, {.op = run_op, .type = var_type, .a = reg, .b = lhs.reg, .c = rhs.reg});
+    if (var_type == VarType::Real32)
+        emit(compiler, {.op = RunOp::Convert, .type = var_type, .a = reg, .b = reg, .c = (u32)VarType::Real64});
+    return {reg, {.var_type = var_type}};
+}
+
+RunOperand compile_comparison(RunCompiler& compiler, LexToken::Type op, RunOperand lhs, RunOperand rhs)
+{
+    if (!expect_number(compiler, lhs) || !expect_number(compiler, rhs))
+        return lhs;
+
+    auto var_type = arithmetic_type(lhs.type.var_type, rhs.type.var_type);
+    lhs = convert(compiler, lhs, var_type);
+    rhs = convert(compiler, rhs, var_type);
+    auto real = is_real(var_type);
+    auto is_signed = var_type_signed[var_type];
+
+    // > and >= are < and <= with the operands swapped
+    if (op == LexToken::BiggerThen || op == LexToken::BiggerEqual)
+    {
+        std::swap(lhs, rhs);
+        op = op == LexToken::BiggerThen ? LexToken::LessThen : LexToken::LessEqual;
+    }
+
+    RunOp::Type run_op;
+    switch (op)
+    {
+        case LexToken::Equal: run_op = real ? RunOp::EqF : RunOp::EqI; break;
+        case LexToken::NotEqual: run_op = real ? RunOp::NeF : RunOp::NeI; break;
+        case LexToken::LessThen: run_op = real ? RunOp::LtF : is_signed ? RunOp::LtI : RunOp::LtU; break;
+        default: run_op = real ? RunOp::LeF : is_signed ? RunOp::LeI : RunOp::LeU; break;
+    }
+
+    auto reg = new_register(compiler);
+    emit(compiler, {.op = run_op, .a = reg, .b = lhs.reg, .c = rhs.reg});
+    return {reg, {.var_type = VarType::Bool}};
+}
+
+// && and || only evaluate their right side when the left one doesn't decide the result
+RunOperand compile_logical(RunCompiler& compiler, Expr* expr)
+{
+    auto reg = new_register(compiler);
+    convert(compiler, compile_expr(compiler, expr->lhs), {.var_type = VarType::Bool}, reg);
+    auto jump = emit(compiler, {.op = expr->token.type == LexToken::And ? RunOp::JumpIfFalse : RunOp::JumpIfTrue, .b = reg});
+    convert(compiler, compile_expr(compiler, expr->rhs), {.var_type = VarType::Bool}, reg);
+    patch_jump(compiler, jump);
+    return {reg, {.var_type = VarType::Bool}};
+}
+
+RunOperand compile_element(RunCompiler& compiler, Expr* expr)
+{
+    auto span = find_local(compiler, name_string(expr->dest_var.name));
+    if (!span || !span->type.is_span || compiler.element_index == run_no_register)
+    {
+        run_error(compiler, "element-wise operand must be an array");
+        return {0, run_void};
+    }
+
+    auto reg = new_register(compiler);
+    emit(compiler, {.op = RunOp::LoadElement, .type = span->type.var_type, .a = reg, .b = span->reg, .c = compiler.element_index});
+    return {reg, {.var_type = span->type.var_type}};
+}
+
+// Returns the index, checked against the length of span whatever --bounds says
+RunOperand compile_index(RunCompiler& compiler, Expr* expr, RunOperand& span)
+{
+    span = compile_expr(compiler, expr->lhs);
+    if (!span.type.is_span)
+    {
+        run_error(compiler, "only arrays of numbers can be indexed");
+        return {0, run_void};
+    }
+
+    auto index = convert(compiler, compile_expr(compiler, expr->rhs), VarType::U64);
+    emit(compiler, {.op = RunOp::CheckIndex, .a = index.reg, .b = span.reg});
+    return index;
+}
+
+RunOperand compile_indexed(RunCompiler& compiler, Expr* expr)
+{
+    RunOperand span;
+    auto index = compile_index(compiler, expr, span);
+    if (is_void(index.type))
+        return index;
+
+    auto reg = new_register(compiler);
+    emit(compiler, {.op = RunOp::LoadElement, .type = span.type.var_type, .a = reg, .b = span.reg, .c = index.reg});
+    return {reg, {.var_type = span.type.var_type}};
+}
+
+RunOperand compile_assignment(RunCompiler& compiler, Expr* expr)
+{
+    auto target = expr->lhs;
+    auto rhs = compile_expr(compiler, expr->rhs);
+    if (target->type == Expr::Elements)
+    {
+        auto span = find_local(compiler, name_string(target->dest_var.name));
+        if (!span || !span->type.mutable_elements)
+        {
+            run_error(compiler, "elements of an immutable array can't be assigned");
+            return rhs;
+        }
+
+        auto value = expr->token.type == LexToken::Assign ? rhs : compile_arithmetic(compiler, expr->token.type, compile_element(compiler, target), rhs);
+        value = convert(compiler, value, span->type.var_type);
+        emit(compiler, {.op = RunOp::StoreElement, .type = span->type.var_type, .a = span->reg, .b = compiler.element_index, .c = value.reg});
+        return value;
+    }
+    if (target->type == Expr::Index)
+    {
+        RunOperand span;
+        auto index = compile_index(compiler, target, span);
+        if (is_void(index.type))
+            return rhs;
+        if (!span.type.mutable_elements)
+        {
+            run_error(compiler, "elements of an immutable array can't be assigned");
+            return rhs;
+        }
+
+        auto value = rhs;
+        if (expr->token.type != LexToken::Assign)
+        {
+            auto element = new_register(compiler);
+            emit(compiler, {.op = RunOp::LoadElement, .type = span.type.var_type, .a = element, .b = span.reg, .c = index.reg});
+            value = compile_arithmetic(compiler, expr->token.type, {element, {.var_type = span.type.var_type}}, rhs);
+        }
+        value = convert(compiler, value, span.type.var_type);
+        emit(compiler, {.op = RunOp::StoreElement, .type = span.type.var_type, .a = span.reg, .b = index.reg, .c = value.reg});
+        return value;
+    }
+
+    auto name = std::string(target->token.name, target->token.string_size);
+    auto local = find_local(compiler, name);
+    auto global = compiler.program.global_indices.find(name);
+    if (!local && global == compiler.program.global_indices.end())
+    {
+        run_error(compiler, "unknown name {}", name);
+        return rhs;
+    }
+    auto is_mutable = local ? local->is_mutable : compiler.program.globals[global->second].is_mutable;
+    if (!is_mutable)
+    {
+        run_error(compiler, "can't assign to immutable {}", name);
+        return rhs;
+    }
+
+    auto value = rhs;
+    if (expr->token.type != LexToken::Assign)
+        value = compile_arithmetic(compiler, expr->token.type, compile_expr(compiler, target), rhs);
+    if (local)
+        return convert(compiler, value, local->type, local->reg);
+
+    value = convert(compiler, value, compiler.program.globals[global->second].type);
+    emit(compiler, {.op = RunOp::StoreGlobal, .a = global->second, .b = value.reg});
+    return value;
+}
+
+RunOperand compile_call(RunCompiler& compiler, Expr* expr)
+{
+    auto name = std::string(expr->token.name, expr->token.string_size);
+    auto found = compiler.program.function_indices.find(name);
+    if (found == compiler.program.function_indices.end())
+    {
+        run_error(compiler, "unknown function {}", name);
+        return {0, run_void};
+    }
+
+    auto& callee = compiler.program.functions[found->second];
+    if (callee.infer_return && callee.state != RunFunction::Compiled)
+    {
+        if (callee.state == RunFunction::Compiling)
+        {
+            run_error(compiler, "recursive function {} needs a return type", name);
+            return {0, run_void};
+        }
+        compile_function(compiler.program, found->second);
+    }
+    if (expr->args.size() != callee.param_types.size())
+    {
+        run_error(compiler, "{} takes {} arguments", name, callee.param_types.size());
+        return {0, run_void};
+    }
+
+    // Arguments go to consecutive registers, they become the callee's first registers
+    std::vector<RunOperand> args;
+    for (auto arg: expr->args)
+    {
+        args.push_back(compile_expr(compiler, arg));
+    }
+    auto first = compiler.next_register;
+    for (auto i = 0; i < args.size(); i++)
+    {
+        convert(compiler, args[i], callee.param_types[i], new_register(compiler));
+    }
+
+    auto reg = new_register(compiler);
+    emit(compiler, {.op = RunOp::Call, .a = reg, .b = found->second, .c = first});
+    return {reg, callee.return_type};
+}
+
+RunOperand compile_expr(RunCompiler& compiler, Expr* expr)
+{
+    if (compiler.failed)
+        return {0, run_void};
+
+    switch (expr->type)
+    {
+        case Expr::Number:
+            return compile_number(compiler, expr);
+        case Expr::Name:
+        {
+            auto name = std::string(expr->token.name, expr->token.string_size);
+            if (auto local = find_local(compiler, name))
+                return {local->reg, local->type};
+
+            auto global = compiler.program.global_indices.find(name);
+            if (global == compiler.program.global_indices.end())
+            {
+                run_error(compiler, "unknown name {}", name);
+                return {0, run_void};
+            }
+            auto reg = new_register(compiler);
+            emit(compiler, {.op = RunOp::LoadGlobal, .a = reg, .b = global->second});
+            return {reg, compiler.program.globals[global->second].type};
+        }
+        case Expr::Paren:
+            return compile_expr(compiler, expr->rhs);
+        case Expr::Unary:
+        {
+            auto operand = compile_expr(compiler, expr->rhs);
+            if (!expect_number(compiler, operand))
+                return operand;
+            auto reg = new_register(compiler);
+            if (expr->token.type == LexToken::Not)
+            {
+                operand = convert(compiler, operand, VarType::Bool);
+                emit(compiler, {.op = RunOp::Not, .a = reg, .b = operand.reg});
+                return {reg, {.var_type = VarType::Bool}};
+            }
+
+            auto var_type = arithmetic_type(operand.type.var_type, operand.type.var_type);
+            operand = convert(compiler, operand, var_type);
+            emit(compiler, {.op = is_real(var_type) ? RunOp::NegF : RunOp::NegI, .type = var_type, .a = reg, .b = operand.reg});
+            return {reg, {.var_type = var_type}};
+        }
+        case Expr::Binary:
+        {
+            if (is_assignment(expr->token.type))
+                return compile_assignment(compiler, expr);
+            if (expr->token.type == LexToken::And || expr->token.type == LexToken::Or)
+                return compile_logical(compiler, expr);
+
+            auto lhs = compile_expr(compiler, expr->lhs);
+            auto rhs = compile_expr(compiler, expr->rhs);
+            if (is_comparison(expr->token.type))
+                return compile_comparison(compiler, expr->token.type, lhs, rhs);
+            return compile_arithmetic(compiler, expr->token.type, lhs, rhs);
+        }
+        case Expr::Call:
+            return compile_call(compiler, expr);
+        case Expr::Elements:
+            return compile_element(compiler, expr);
+        case Expr::Index:
+            return compile_indexed(compiler, expr);
+        case Expr::VarInit:
+        {
+            auto value = compile_expr(compiler, expr->rhs);
+            if (is_void(value.type))
+            {
+                run_error(compiler, "expression has no value");
+                return value;
+            }
+            auto reg = new_register(compiler);
+            compiler.locals.push_back({name_string(expr->dest_var.name), reg, value.type, expr->dest_var.is_mutable[0]});
+            return convert(compiler, value, value.type, reg);
+        }
+        case Expr::Range:
+            // Only the walk of a parallel for, compile_range_for compiles its ends
+            break;
+        case Expr::Await:
+            // Only in async functions, which compile_function turns down
+            break;
+        case Expr::New:
+            run_error(compiler, "arenas can't be run by the interpreter");
+            break;
+    }
+    return {0, run_void};
+}
+
+void compile_block(RunCompiler& compiler, std::vector<Stmt*>& body);
+
+// Loops index from 0 up to the size of span, leaving the index register set for the body
+template <typename Body>
+void compile_span_loop(RunCompiler& compiler, u32 span, Body body)
+{
+    auto index = load_constant(compiler, {}, VarType::U64).reg;
+    auto size = new_register(compiler);
+    emit(compiler, {.op = RunOp::Length, .a = size, .b = span});
+    auto one = add_constant(compiler, {.u = 1});
+    auto condition = new_register(compiler);
+    auto step = new_register(compiler);
+    emit(compiler, {.op = RunOp::LoadConst, .a = step, .b = one});
+
+    auto loop = mark_label(compiler);
+    emit(compiler, {.op = RunOp::LtU, .a = condition, .b = index, .c = size});
+    auto exit = emit(compiler, {.op = RunOp::JumpIfFalse, .b = condition});
+    body(index);
+    emit(compiler, {.op = RunOp::AddI, .type = VarType::U64, .a = index, .b = index, .c = step});
+    emit(compiler, {.op = RunOp::Jump, .a = (u32)loop});
+    patch_jump(compiler, exit);
+}
+
+// parallel for i in range(first, end), first and end are evaluated once
+void compile_range_for(RunCompiler& compiler, Stmt* stmt)
+{
+    auto range = stmt->expr;
+    // Copied, the index counts up in its own register
+    auto first = range->lhs ? compile_expr(compiler, range->lhs) : load_constant(compiler, {}, VarType::I64);
+    auto index = new_register(compiler);
+    convert(compiler, first, {.var_type = VarType::I64}, index);
+    auto end_value = compile_expr(compiler, range->rhs);
+    auto end = new_register(compiler);
+    convert(compiler, end_value, {.var_type = VarType::I64}, end);
+    auto condition = new_register(compiler);
+    auto step = new_register(compiler);
+    emit(compiler, {.op = RunOp::LoadConst, .a = step, .b = add_constant(compiler, {.i = 1})});
+
+    auto locals_size = compiler.locals.size();
+    auto loop = mark_label(compiler);
+    emit(compiler, {.op = RunOp::LtI, .a = condition, .b = index, .c = end});
+    auto exit = emit(compiler, {.op = RunOp::JumpIfFalse, .b = condition});
+    // The index is the last local, so free_temporaries in the body leaves the counters alone
+    auto reg = new_register(compiler);
+    compiler.locals.push_back({name_string(stmt->var.name), reg, {.var_type = VarType::I64}, false});
+    emit(compiler, {.op = RunOp::Move, .a = reg, .b = index});
+    compile_block(compiler, stmt->body);
+    emit(compiler, {.op = RunOp::AddI, .type = VarType::I64, .a = index, .b = index, .c = step});
+    emit(compiler, {.op = RunOp::Jump, .a = (u32)loop});
+    patch_jump(compiler, exit);
+    compiler.locals.resize(locals_size);
+}
+
+// A parallel for runs its iterations in order, the interpreter has a single thread
+void compile_for(RunCompiler& compiler, Stmt* stmt)
+{
+    if (stmt->expr->type == Expr::Range)
+    {
+        compile_range_for(compiler, stmt);
+        return;
+    }
+    if (stmt->expr->type == Expr::Call)
+    {
+        run_error(compiler, "generators can't be run by the interpreter");
+        return;
+    }
+
+    auto span = find_local(compiler, name_string(stmt->expr->dest_var.name));
+    auto element = run_type(stmt->var);
+    if (!span || !span->type.is_span || element.error || element.content.is_span)
+    {
+        run_error(compiler, "for can only walk an array of numbers");
+        return;
+    }
+
+    auto locals_size = compiler.locals.size();
+    auto span_reg = span->reg;
+    auto element_type = span->type.var_type;
+    // The element is the last local, so free_temporaries in the body leaves the counters alone
+    compile_span_loop(compiler, span_reg, [&](u32 index)
+    {
+        auto reg = new_register(compiler);
+        compiler.locals.push_back({name_string(stmt->var.name), reg, {.var_type = element_type}, (bool)stmt->var.is_mutable[0]});
+        emit(compiler, {.op = RunOp::LoadElement, .type = element_type, .a = reg, .b = span_reg, .c = index});
+        compile_block(compiler, stmt->body);
+        // A mut element writes back to the array
+        if (stmt->var.is_mutable[0])
+            emit(compiler, {.op = RunOp::StoreElement, .type = element_type, .a = span_reg, .b = index, .c = reg});
+    });
+    compiler.locals.resize(locals_size);
+}
+
+void compile_elements(RunCompiler& compiler, Stmt* stmt)
+{
+    std::vector<Var> arrays;
+    collect_elements(stmt->expr, arrays);
+    std::vector<RunLocal*> spans;
+    for (auto& array: arrays)
+    {
+        auto span = find_local(compiler, name_string(array.name));
+        if (!span || !span->type.is_span)
+        {
+            run_error(compiler, "element-wise operand must be an array");
+            return;
+        }
+        spans.push_back(span);
+    }
+
+    // Every array is walked with the first one's length, whatever --bounds says
+    auto span = spans[0];
+    for (auto i = 1; i < spans.size(); i++)
+    {
+        emit(compiler, {.op = RunOp::CheckLength, .a = span->reg, .b = spans[i]->reg});
+    }
+    compile_span_loop(compiler, span->reg, [&](u32 index)
+    {
+        compiler.element_index = index;
+        compile_expr(compiler, stmt->expr);
+        compiler.element_index = run_no_register;
+    });
+}
+
+void compile_global(RunCompiler& compiler, Stmt* stmt)
+{
+    auto name = name_string(stmt->var.name);
+    auto declared = run_type(stmt->var);
+    if (declared.error)
+    {
+        run_error(compiler, "{} has a type the interpreter can't run", name);
+        return;
+    }
+
+    auto type = declared.content;
+    RunOperand value;
+    if (stmt->expr)
+    {
+        value = compile_expr(compiler, stmt->expr);
+        if (is_void(type))
+            type = value.type;
+        value = convert(compiler, value, type);
+    }
+    else
+    {
+        value = {load_constant(compiler, {}, VarType::I32).reg, type};
+    }
+    if (compiler.failed)
+        return;
+
+    compiler.program.global_indices[name] = compiler.program.globals.size();
+    compiler.program.globals.push_back({type, (bool)stmt->var.is_mutable[0] && !stmt->is_constexpr});
+    emit(compiler, {.op = RunOp::StoreGlobal, .a = (u32)compiler.program.globals.size() - 1, .b = value.reg});
+}
+
+void compile_stmt(RunCompiler& compiler, Stmt* stmt)
+{
+    switch (stmt->type)
+    {
+        case Stmt::VarDecl:
+        {
+            if (!compiler.function.source && !compiler.block_depth)
+            {
+                compile_global(compiler, stmt);
+                break;
+            }
+
+            auto declared = run_type(stmt->var);
+            if (declared.error)
+            {
+                run_error(compiler, "{} has a type the interpreter can't run", name_string(stmt->var.name));
+                break;
+            }
+            auto type = declared.content;
+            // Zeroed registers are 0, 0.0 and the empty span alike
+            auto value = stmt->expr ? compile_expr(compiler, stmt->expr) : RunOperand{load_constant(compiler, {}, VarType::I32).reg, type};
+            if (is_void(type))
+                type = value.type;
+            auto reg = new_register(compiler);
+            convert(compiler, value, type, reg);
+            compiler.locals.push_back({name_string(stmt->var.name), reg, type, (bool)stmt->var.is_mutable[0] && !stmt->is_constexpr});
+            break;
+        }
+        case Stmt::Expression:
+            if (contains_expr(stmt->expr, Expr::Elements))
+                compile_elements(compiler, stmt);
+            else
+                compile_expr(compiler, stmt->expr);
+            break;
+        case Stmt::Return:
+        {
+            auto& function = compiler.function;
+            if (!stmt->expr)
+            {
+                if (!is_void(function.return_type))
+                    run_error(compiler, "return needs a value");
+                function.infer_return = false;
+                emit(compiler, {.op = RunOp::ReturnVoid});
+                break;
+            }
+
+            auto value = compile_expr(compiler, stmt->expr);
+            if (function.infer_return)
+            {
+                function.return_type = value.type;
+                function.infer_return = false;
+            }
+            else if (is_void(function.return_type))
+            {
+                run_error(compiler, "function without a return type returns a value");
+                break;
+            }
+            value = convert(compiler, value, function.return_type);
+            emit(compiler, {.op = RunOp::Return, .a = value.reg});
+            break;
+        }
+        case Stmt::While:
+        {
+            auto locals_size = compiler.locals.size();
+            auto loop = mark_label(compiler);
+            auto condition = convert(compiler, compile_expr(compiler, stmt->expr), VarType::Bool);
+            auto exit = emit(compiler, {.op = RunOp::JumpIfFalse, .b = condition.reg});
+            compile_block(compiler, stmt->body);
+            emit(compiler, {.op = RunOp::Jump, .a = (u32)loop});
+            patch_jump(compiler, exit);
+            compiler.locals.resize(locals_size);
+            break;
+        }
+        case Stmt::For:
+            compile_for(compiler, stmt);
+            break;
+        case Stmt::Yield:
+            // Only in generator functions, which compile_function turns down
+            break;
+    }
+    free_temporaries(compiler);
+}
+
+void compile_block(RunCompiler& compiler, std::vector<Stmt*>& body)
+{
+    auto locals_size = compiler.locals.size();
+    compiler.block_depth++;
+    for (auto stmt: body)
+    {
+        compile_stmt(compiler, stmt);
+    }
+    compiler.block_depth--;
+    compiler.locals.resize(locals_size);
+}
+
+void compile_function(RunProgram& program, u32 index)
+{
+    auto& function = program.functions[index];
+    function.state = RunFunction::Compiling;
+    RunCompiler compiler = {.program = program, .function = function, .element_index = run_no_register};
+
+    auto& source = *function.source;
+    if (!source.type_params.empty())
+    {
+        run_error(compiler, "generic functions can't be run by the interpreter");
+        function.state = RunFunction::Compiled;
+        return;
+    }
+    if (source.coroutine)
+    {
+        run_error(compiler, "async and generator functions can't be run by the interpreter");
+        function.state = RunFunction::Compiled;
+        return;
+    }
+    for (auto i = 0; i < source.params.size(); i++)
+    {
+        compiler.locals.push_back({name_string(source.params[i].name), (u32)i, function.param_types[i], function.mutable_params[i]});
+    }
+    compiler.next_register = function.register_count = source.params.size();
+
+    compile_block(compiler, source.body);
+    // A function reaching its end without returning is void unless a return said otherwise
+    if (function.infer_return)
+        function.infer_return = false;
+    emit(compiler, {.op = is_void(function.return_type) ? RunOp::ReturnVoid : RunOp::MissingReturn});
+    function.state = RunFunction::Compiled;
+    if (compiler.failed)
+        function.code.clear();
+}
+
+// Enum values are immutable globals, counting up from the previous value when not given
+void compile_enum(RunCompiler& compiler, TypeDecl* type_decl)
+{
+    RunType type = {.var_type = type_decl->underlying_type ? type_decl->underlying_type : VarType::I32};
+    auto one = add_constant(compiler, {.i = 1});
+    RunOperand previous = {run_no_register};
+    for (auto& value: type_decl->values)
+    {
+        RunOperand result;
+        if (value.value)
+        {
+            result = convert(compiler, compile_expr(compiler, value.value), type);
+        }
+        else if (previous.reg == run_no_register)
+        {
+            result = load_constant(compiler, {}, type.var_type);
+        }
+        else
+        {
+            auto step = new_register(compiler);
+            emit(compiler, {.op = RunOp::LoadConst, .a = step, .b = one});
+            result = {new_register(compiler), type};
+            emit(compiler, {.op = RunOp::AddI, .type = type.var_type, .a = result.reg, .b = previous.reg, .c = step});
+        }
+
+        compiler.program.global_indices[name_string(value.name)] = compiler.program.globals.size();
+        compiler.program.globals.push_back({type, false});
+        emit(compiler, {.op = RunOp::StoreGlobal, .a = (u32)compiler.program.globals.size() - 1, .b = result.reg});
+        previous = result;
+    }
+}
+
+// Registers every function before compiling anything, calls may go to functions declared later.
+// The init function, last in program.functions, runs the top-level statements in order
+ErrorOr<RunProgram> compile_program(std::vector<TopLevelDecl>& declarations)
+{
+    RunProgram program;
+    auto failed = false;
+    for (auto& declaration: declarations)
+    {
+        if (declaration.type != TopLevelDecl::Function)
+            continue;
+
+        auto& source = declaration.function;
+        RunFunction function = {.name = name_string(source.name), .source = &source};
+        auto return_type = run_type(source.return_type);
+        failed |= return_type.error;
+        function.return_type = return_type.error ? run_void : return_type.content;
+        function.infer_return = source.return_type.modifier.empty() && source.return_type.var_type == VarType::Any && !source.return_type.user_type;
+        for (auto& param: source.params)
+        {
+            auto param_type = run_type(param);
+            if (param_type.error || is_void(param_type.content))
+            {
+                fprintf(stderr, "%s: parameter %s has a type the interpreter can't run\n", function.name.c_str(), name_string(param.name).c_str());
+                failed = true;
+            }
+            function.param_types.push_back(param_type.content);
+            function.mutable_params.push_back(param.is_mutable[0]);
+        }
+        if (return_type.error)
+            fprintf(stderr, "%s: return type can't be run by the interpreter\n", function.name.c_str());
+        if (program.function_indices.contains(function.name))
+        {
+            fprintf(stderr, "%s: function is declared twice\n", function.name.c_str());
+            failed = true;
+        }
+
+        program.function_indices[function.name] = program.functions.size();
+        program.functions.push_back(function);
+    }
+    program.functions.push_back({.name = "top level", .state = RunFunction::Compiling});
+    if (failed)
+        return {};
+
+    auto& init = program.functions.back();
+    RunCompiler compiler = {.program = program, .function = init, .element_index = run_no_register};
+    for (auto& declaration: declarations)
+    {
+        if (declaration.type == TopLevelDecl::Stmt)
+            compile_stmt(compiler, declaration.stmt);
+        else if (declaration.type == TopLevelDecl::TypeDecl && declaration.type_decl->type == TypeDecl::Enum)
+            compile_enum(compiler, declaration.type_decl);
+    }
+    emit(compiler, {.op = RunOp::ReturnVoid});
+    init.state = RunFunction::Compiled;
+    failed |= compiler.failed;
+
+    for (auto i = 0; i < program.functions.size(); i++)
+    {
+        if (program.functions[i].state == RunFunction::Pending)
+            compile_function(program, i);
+        failed |= program.functions[i].code.empty();
+    }
+    if (failed)
+        return {};
+    return program;
+}
+
+struct RunFrame
+{
+    const RunFunction* function;
+    const Instruction* ip;
+    u64 base;
+    u32 dest;
+};
+
+constexpr u64 run_max_frames = 1 << 16;
+
+RunValue load_element(char* data, u64 index, enum VarType var_type)
+{
+    RunValue value = {};
+    auto element = data + index * var_type_sizes[var_type];
+    switch (var_type)
+    {
+        case VarType::I8: value.i = *(int8_t*)element; break;
+        case VarType::I16: value.i = *(int16_t*)element; break;
+        case VarType::I32: value.i = *(int32_t*)element; break;
+        case VarType::I64: value.i = *(int64_t*)element; break;
+        case VarType::U8: value.u = *(uint8_t*)element; break;
+        case VarType::U16: value.u = *(uint16_t*)element; break;
+        case VarType::U32: value.u = *(uint32_t*)element; break;
+        case VarType::U64: value.u = *(uint64_t*)element; break;
+        case VarType::Real32: value.f = *(float*)element; break;
+        case VarType::Real64: value.f = *(double*)element; break;
+        case VarType::Bool: value.i = *(bool*)element; break;
+        default: break;
+    }
+    return value;
+}
+
+void store_element(char* data, u64 index, enum VarType var_type, RunValue value)
+{
+    auto element = data + index * var_type_sizes[var_type];
+    switch (var_type)
+    {
+        case VarType::I8: case VarType::U8: *(uint8_t*)element = value.u; break;
+        case VarType::I16: case VarType::U16: *(uint16_t*)element = value.u; break;
+        case VarType::I32: case VarType::U32: *(uint32_t*)element = value.u; break;
+        case VarType::I64: case VarType::U64: *(uint64_t*)element = value.u; break;
+        case VarType::Real32: *(float*)element = value.f; break;
+        case VarType::Real64: *(double*)element = value.f; break;
+        case VarType::Bool: *(bool*)element = value.i; break;
+        default: break;
+    }
+}
+
+// Computed gotos jump from each handler straight to the next one, compilers without them go
+// through the switch every time
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+ErrorOr<RunValue> execute(const RunProgram& program, u32 entry, std::vector<RunValue>& globals, std::vector<RunValue>& args)
+{
+    std::vector<RunValue> registers(std::max<u64>(args.size(), 256));
+    std::copy(args.begin(), args.end(), registers.begin());
+    std::vector<RunFrame> frames;
+
+    auto function = &program.functions[entry];
+    auto ip = function->code.data();
+    auto constants = function->constants.data();
+    u64 base = 0;
+    registers.resize(std::max<u64>(registers.size(), function->register_count));
+    auto regs = registers.data();
+    RunValue result = {};
+
+    auto fail = [&](const char* message) -> ErrorOr<RunValue>
+    {
+        fprintf(stderr, "%s: %s\n", function->name.c_str(), message);
+        return {};
+    };
+
+#ifdef __GNUC__
+#define RUN_OP_LABEL(name) &&op_##name,
+    static void* const labels[] = { RUN_OPS(RUN_OP_LABEL) };
+#undef RUN_OP_LABEL
+#define RUN_CASE(name) case RunOp::name: op_##name
+#define RUN_DISPATCH() goto *labels[ip->op]
+#else
+#define RUN_CASE(name) case RunOp::name
+#define RUN_DISPATCH() continue
+#endif
+#define RUN_NEXT() { ip++; RUN_DISPATCH(); }
+
+    while (true)
+    {
+        switch (ip->op)
+        {
+            RUN_CASE(LoadConst):
+                regs[ip->a] = constants[ip->b];
+                RUN_NEXT();
+            RUN_CASE(Move):
+                regs[ip->a] = regs[ip->b];
+                RUN_NEXT();
+            RUN_CASE(Convert):
+                regs[ip->a] = convert_value(regs[ip->b], (VarType)ip->c, ip->type);
+                RUN_NEXT();
+            RUN_CASE(AddI):
+                regs[ip->a].i = wrap_integer(regs[ip->b].u + regs[ip->c].u, ip->type);
+                RUN_NEXT();
+            RUN_CASE(SubI):
+                regs[ip->a].i = wrap_integer(regs[ip->b].u - regs[ip->c].u, ip->type);
+                RUN_NEXT();
+            RUN_CASE(MulI):
+                regs[ip->a].i = wrap_integer(regs[ip->b].u * regs[ip->c].u, ip->type);
+                RUN_NEXT();
+            RUN_CASE(DivI):
+                if (!regs[ip->c].i)
+                    return fail("division by zero");
+                regs[ip->a].i = regs[ip->b].i == INT64_MIN && regs[ip->c].i == -1 ? INT64_MIN : wrap_integer(regs[ip->b].i / regs[ip->c].i, ip->type);
+                RUN_NEXT();
+            RUN_CASE(DivU):
+                if (!regs[ip->c].u)
+                    return fail("division by zero");
+                regs[ip->a].i = wrap_integer(regs[ip->b].u / regs[ip->c].u, ip->type);
+                RUN_NEXT();
+            RUN_CASE(ModI):
+                if (!regs[ip->c].i)
+                    return fail("division by zero");
+                regs[ip->a].i = regs[ip->c].i == -1 ? 0 : wrap_integer(regs[ip->b].i % regs[ip->c].i, ip->type);
+                RUN_NEXT();
+            RUN_CASE(ModU):
+                if (!regs[ip->c].u)
+                    return fail("division by zero");
+                regs[ip->a].i = wrap_integer(regs[ip->b].u % regs[ip->c].u, ip->type);
+                RUN_NEXT();
+            RUN_CASE(NegI):
+                regs[ip->a].i = wrap_integer(0 - regs[ip->b].u, ip->type);
+                RUN_NEXT();
+            RUN_CASE(AddF):
+                regs[ip->a].f = regs[ip->b].f + regs[ip->c].f;
+                RUN_NEXT();
+            RUN_CASE(SubF):
+                regs[ip->a].f = regs[ip->b].f - regs[ip->c].f;
+                RUN_NEXT();
+            RUN_CASE(MulF):
+                regs[ip->a].f = regs[ip->b].f * regs[ip->c].f;
+                RUN_NEXT();
+            RUN_CASE(DivF):
+                regs[ip->a].f = regs[ip->b].f / regs[ip->c].f;
+                RUN_NEXT();
+            RUN_CASE(NegF):
+                regs[ip->a].f = -regs[ip->b].f;
+                RUN_NEXT();
+            RUN_CASE(Not):
+                regs[ip->a].i = !regs[ip->b].i;
+                RUN_NEXT();
+            RUN_CASE(EqI):
+                regs[ip->a].i = regs[ip->b].i == regs[ip->c].i;
+                RUN_NEXT();
+            RUN_CASE(NeI):
+                regs[ip->a].i = regs[ip->b].i != regs[ip->c].i;
+                RUN_NEXT();
+            RUN_CASE(LtI):
+                regs[ip->a].i = regs[ip->b].i < regs[ip->c].i;
+                RUN_NEXT();
+            RUN_CASE(LeI):
+                regs[ip->a].i = regs[ip->b].i <= regs[ip->c].i;
+                RUN_NEXT();
+            RUN_CASE(LtU):
+                regs[ip->a].i = regs[ip->b].u < regs[ip->c].u;
+                RUN_NEXT();
+            RUN_CASE(LeU):
+                regs[ip->a].i = regs[ip->b].u <= regs[ip->c].u;
+                RUN_NEXT();
+            RUN_CASE(EqF):
+                regs[ip->a].i = regs[ip->b].f == regs[ip->c].f;
+                RUN_NEXT();
+            RUN_CASE(NeF):
+                regs[ip->a].i = regs[ip->b].f != regs[ip->c].f;
+                RUN_NEXT();
+            RUN_CASE(LtF):
+                regs[ip->a].i = regs[ip->b].f < regs[ip->c].f;
+                RUN_NEXT();
+            RUN_CASE(LeF):
+                regs[ip->a].i = regs[ip->b].f <= regs[ip->c].f;
+                RUN_NEXT();
+            RUN_CASE(Jump):
+                ip = function->code.data() + ip->a;
+                RUN_DISPATCH();
+            RUN_CASE(JumpIfFalse):
+                ip = !regs[ip->b].i ? function->code.data() + ip->a : ip + 1;
+                RUN_DISPATCH();
+            RUN_CASE(JumpIfTrue):
+                ip = regs[ip->b].i ? function->code.data() + ip->a : ip + 1;
+                RUN_DISPATCH();
+            RUN_CASE(LoadGlobal):
+                regs[ip->a] = globals[ip->b];
+                RUN_NEXT();
+            RUN_CASE(StoreGlobal):
+                globals[ip->a] = regs[ip->b];
+                RUN_NEXT();
+            RUN_CASE(LoadElement):
+                regs[ip->a] = load_element(regs[ip->b].data, regs[ip->c].u, ip->type);
+                RUN_NEXT();
+            RUN_CASE(StoreElement):
+                store_element(regs[ip->a].data, regs[ip->b].u, ip->type, regs[ip->c]);
+                RUN_NEXT();
+            RUN_CASE(CheckIndex):
+                if (regs[ip->a].u >= regs[ip->b].size)
+                    return fail(std::format("index {} is out of bounds of an array of {}", regs[ip->a].u, regs[ip->b].size).c_str());
+                RUN_NEXT();
+            RUN_CASE(CheckLength):
+                if (regs[ip->a].size != regs[ip->b].size)
+                    return fail(std::format("element-wise arrays have {} and {} elements", regs[ip->a].size, regs[ip->b].size).c_str());
+                RUN_NEXT();
+            RUN_CASE(Length):
+                regs[ip->a].u = regs[ip->b].size;
+                RUN_NEXT();
+            RUN_CASE(Call):
+            {
+                if (frames.size() == run_max_frames)
+                    return fail("call stack overflow");
+                frames.push_back({function, ip, base, ip->a});
+
+                // Arguments already sit where the callee's registers start
+                base += ip->c;
+                function = &program.functions[ip->b];
+                if (base + function->register_count > registers.size())
+                    registers.resize(std::max(base + function->register_count, registers.size() * 2));
+                regs = registers.data() + base;
+                constants = function->constants.data();
+                ip = function->code.data();
+                RUN_DISPATCH();
+            }
+            RUN_CASE(Return):
+            RUN_CASE(ReturnVoid):
+            {
+                result = ip->op == RunOp::Return ? regs[ip->a] : RunValue{};
+                if (frames.empty())
+                    return result;
+
+                auto frame = frames.back();
+                frames.pop_back();
+                function = frame.function;
+                base = frame.base;
+                regs = registers.data() + base;
+                constants = function->constants.data();
+                ip = frame.ip;
+                regs[frame.dest] = result;
+                RUN_NEXT();
+            }
+            RUN_CASE(MissingReturn):
+                return fail("function ended without returning a value");
+        }
+    }
+#undef RUN_CASE
+#undef RUN_DISPATCH
+#undef RUN_NEXT
+}
+#pragma GCC diagnostic pop
+
+// Numbers given on the command line become main's parameters in order, a span parameter takes every argument left
+ErrorOr<std::vector<RunValue>> main_arguments(const RunFunction& main, std::vector<std::string>& arguments, std::vector<std::vector<char>>& arrays)
+{
+    std::vector<RunValue> values;
+    u64 next = 0;
+    for (auto i = 0; i < main.param_types.size(); i++)
+    {
+        auto type = main.param_types[i];
+        auto parse = [&](const std::string& argument)
+        {
+            RunValue value = {};
+            if (is_real(type.var_type))
+                value.f = strtod(argument.c_str(), 0);
+            else if (var_type_signed[type.var_type])
+                value.i = strtoll(argument.c_str(), 0, 0);
+            else
+                value.u = strtoull(argument.c_str(), 0, 0);
+            return convert_value(value, is_real(type.var_type) ? VarType::Real64 : var_type_signed[type.var_type] ? VarType::I64 : VarType::U64, type.var_type);
+        };
+
+        if (!type.is_span)
+        {
+            if (next == arguments.size())
+            {
+                fprintf(stderr, "main takes %llu arguments\n", (unsigned long long)main.param_types.size());
+                return {};
+            }
+            values.push_back(parse(arguments[next++]));
+            continue;
+        }
+        if (i != main.param_types.size() - 1)
+        {
+            fprintf(stderr, "main can only take an array as its last parameter\n");
+            return {};
+        }
+
+        auto& array = arrays.emplace_back((arguments.size() - next) * var_type_sizes[type.var_type]);
+        RunValue span = {.size = arguments.size() - next};
+        span.data = array.data();
+        for (u64 j = 0; next < arguments.size(); j++)
+        {
+            store_element(array.data(), j, type.var_type, parse(arguments[next++]));
+        }
+        values.push_back(span);
+    }
+    if (next != arguments.size())
+    {
+        fprintf(stderr, "main takes %llu arguments\n", (unsigned long long)main.param_types.size());
+        return {};
+    }
+    return values;
+}
+
+// Runs main with the arguments after the inputs, its result is the exit code
+int run_program(std::vector<std::wstring>& inputs, std::vector<std::string>& arguments)
+{
+    std::vector<TopLevelDecl> declarations;
+    std::vector<Buffer> file_buffers;
+    auto result = 1;
+    if (parse_inputs(inputs, declarations, file_buffers))
+    {
+        auto error = compile_program(declarations);
+        if (!error.error)
+        {
+            auto& program = error.content;
+            auto main = program.function_indices.find("main");
+            std::vector<RunValue> globals(program.globals.size());
+            std::vector<RunValue> no_args;
+            std::vector<std::vector<char>> arrays;
+            if (main == program.function_indices.end())
+            {
+                fprintf(stderr, "program has no main function\n");
+            }
+            else if (!execute(program, program.functions.size() - 1, globals, no_args).error)
+            {
+                auto& main_function = program.functions[main->second];
+                auto args = main_arguments(main_function, arguments, arrays);
+                auto value = args.error ? ErrorOr<RunValue>() : execute(program, main->second, globals, args.content);
+                if (!value.error)
+                    result = is_void(main_function.return_type) ? 0 : (int)convert_value(value.content, main_function.return_type.var_type, VarType::I32).i;
+            }
+        }
+    }
+
+    release_nodes();
+    for (auto& file_buffer: file_buffers)
+    {
+        free_file_buffer(file_buffer);
+    }
+    return result;
+}
@@ -0,0 +1,459 @@
+#pragma once
+#include <stdio.h>
+#include <assert.h>
+
+#include <format>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "utils.h"
+#include "file_utils.cpp"
+#include "type_metagen.cpp"
+
+struct LexToken {
+    enum Type {
+        VarType, Keyword, Name, Number, Mut, Let, Multiply, Eof, StartParen, EndParen, StartRect, EndRect, StartCurly, EndCurly, Assign, Comma, SLComment, LessThen, BiggerThen, Plus, Minus,
+        Divide, Modulo, Not, Equal, NotEqual, LessEqual, BiggerEqual, And, Or, PlusAssign, MinusAssign, MultiplyAssign, DivideAssign, Unknown, TypeName
+    } type;
+
+    union {
+        char* name;
+        enum VarType var_type;
+        enum Keyword keyword;
+        struct TypeDecl* type_decl;
+    };
+    int string_size;
+};
+
+// Names declared by struct/enum/union, the lexer hands them out as TypeName tokens
+std::unordered_map<std::string_view, struct TypeDecl*> type_decls;
+// Types every program has, also handed out as TypeName tokens
+struct TypeDecl* builtin_type(const char* name, u64 size);
+
+struct LexBuffer {
+    Buffer buffer;
+    char* string;
+    const wchar_t* file_path;
+    int line_num;
+};
+
+bool is_name_char(char c)
+{
+    return c >= '0' && c <= '9' || c >= 'A' && c <= 'Z' || c >= 'a' && c <= 'z' || c == '_';
+}
+
+Buffer buffer_string_ptr(char* string)
+{
+    size_t size = 0;
+    char* terminated = string; 
+    while (*terminated && (*terminated >= '0' && *terminated <= '9' || *terminated >= 'A' && *terminated <= 'Z' || *terminated >= 'a' && *terminated <= 'z' || *terminated == '_')) 
+    {
+        terminated++; 
+        size++;
+    }
+    return {string, size};
+}
+
+bool name_equals(LexToken token, const char* string)
+{
+    return token.type == LexToken::Name && token.string_size == strlen(string) && strncmp(token.name, string, token.string_size) == 0;
+}
+
+std::string name_string(char* string)
+{
+    auto name = buffer_string_ptr(string);
+    return std::string(name.content, name.size);
+}
+
+LexToken lex_string(LexBuffer& lex_buffer, bool lookahead)
+{
+    PhaseScope lexing(PhaseStats::Lex);
+    while (true)
+    {
+        if (*lex_buffer.string == ' ' | *lex_buffer.string == '\t' | *lex_buffer.string == '\n')
+        {
+            if (*lex_buffer.string == '\n')
+            {
+                lex_buffer.line_num++;
+            }
+            lex_buffer.string++;
+        } 
+        else
+        {
+            break;
+        }
+    }
+
+    LexToken token;
+    token.string_size = 0;
+
+    if (!*lex_buffer.string)
+    {
+        token.type = LexToken::Eof;
+        return token;
+    }
+    if (strncmp(lex_buffer.string, "//", 2) == 0)
+    {
+        token.type = LexToken::SLComment;
+        if (!lookahead) lex_buffer.string += 2;
+        token.string_size = 2;
+        return token;
+    }
+    if (strncmp(lex_buffer.string, "==", 2) == 0)
+    {
+        token.type = LexToken::Equal;
+        if (!lookahead) lex_buffer.string += 2;
+        token.string_size = 2;
+        return token;
+    }
+    if (strncmp(lex_buffer.string, "!=", 2) == 0)
+    {
+        token.type = LexToken::NotEqual;
+        if (!lookahead) lex_buffer.string += 2;
+        token.string_size = 2;
+        return token;
+    }
+    if (strncmp(lex_buffer.string, "<=", 2) == 0)
+    {
+        token.type = LexToken::LessEqual;
+        if (!lookahead) lex_buffer.string += 2;
+        token.string_size = 2;
+        return token;
+    }
+    if (strncmp(lex_buffer.string, ">=", 2) == 0)
+    {
+        token.type = LexToken::BiggerEqual;
+        if (!lookahead) lex_buffer.string += 2;
+        token.string_size = 2;
+        return token;
+    }
+    if (strncmp(lex_buffer.string, "&&", 2) == 0)
+    {
+        token.type = LexToken::And;
+        if (!lookahead) lex_buffer.string += 2;
+        token.string_size = 2;
+        return token;
+    }
+    if (strncmp(lex_buffer.string, "||", 2) == 0)
+    {
+        token.type = LexToken::Or;
+        if (!lookahead) lex_buffer.string += 2;
+        token.string_size = 2;
+        return token;
+    }
+    if (strncmp(lex_buffer.string, "+=", 2) == 0)
+    {
+        token.type = LexToken::PlusAssign;
+        if (!lookahead) lex_buffer.string += 2;
+        token.string_size = 2;
+        return token;
+    }
+    if (strncmp(lex_buffer.string, "-=", 2) == 0)
+    {
+        token.type = LexToken::MinusAssign;
+        if (!lookahead) lex_buffer.string += 2;
+        token.string_size = 2;
+        return token;
+    }
+    if (strncmp(lex_buffer.string, "*=", 2) == 0)
+    {
+        token.type = LexToken::MultiplyAssign;
+        if (!lookahead) lex_buffer.string += 2;
+        token.string_size = 2;
+        return token;
+    }
+    if (strncmp(lex_buffer.string, "/=", 2) == 0)
+    {
+        token.type = LexToken::DivideAssign;
+        if (!lookahead) lex_buffer.string += 2;
+        token.string_size = 2;
+        return token;
+    }
+    if (*lex_buffer.string == ',')
+    {
+        token.type = LexToken::Comma;
+        if (!lookahead) lex_buffer.string += 1;
+        token.string_size = 1;
+        return token;
+    }
+    if (*lex_buffer.string == '+')
+    {
+        token.type = LexToken::Plus;
+        if (!lookahead) lex_buffer.string += 1;
+        token.string_size = 1;
+        return token;
+    }
+    if (*lex_buffer.string == '-')
+    {
+        token.type = LexToken::Minus;
+        if (!lookahead) lex_buffer.string += 1;
+        token.string_size = 1;
+        return token;
+    }
+    if (*lex_buffer.string == '*')
+    {
+        token.type = LexToken::Multiply;
+        if (!lookahead) lex_buffer.string += 1;
+        token.string_size = 1;
+        return token;
+    }
+    if (*lex_buffer.string == '(')
+    {
+        token.type = LexToken::StartParen;
+        if (!lookahead) lex_buffer.string += 1;
+        token.string_size = 1;
+        return token;
+    }
+    if (*lex_buffer.string == ')')
+    {
+        token.type = LexToken::EndParen;
+        if (!lookahead) lex_buffer.string += 1;
+        token.string_size = 1;
+        return token;
+    }
+    if (*lex_buffer.string == '[')
+    {
+        token.type = LexToken::StartRect;
+        if (!lookahead) lex_buffer.string += 1;
+        token.string_size = 1;
+        return token;
+    }
+    if (*lex_buffer.string == ']')
+    {
+        token.type = LexToken::EndRect;
+        if (!lookahead) lex_buffer.string += 1;
+        token.string_size = 1;
+        return token;
+    }
+    if (*lex_buffer.string == '{')
+    {
+        token.type = LexToken::StartCurly;
+        if (!lookahead) lex_buffer.string += 1;
+        token.string_size = 1;
+        return token;
+    }
+    if (*lex_buffer.string == '}')
+    {
+        token.type = LexToken::EndCurly;
+        if (!lookahead) lex_buffer.string += 1;
+        token.string_size = 1;
+        return token;
+    }
+    if (*lex_buffer.string == '=')
+    {
+        token.type = LexToken::Assign;
+        if (!lookahead) lex_buffer.string += 1;
+        token.string_size = 1;
+        return token;
+    }
+    if (*lex_buffer.string == '<')
+    {
+        token.type = LexToken::LessThen;
+        if (!lookahead) lex_buffer.string += 1;
+        token.string_size = 1;
+        return token;
+    }
+    if (*lex_buffer.string == '>')
+    {
+        token.type = LexToken::BiggerThen;
+        if (!lookahead) lex_buffer.string += 1;
+        token.string_size = 1;
+        return token;
+    }
+    if (*lex_buffer.string == '/')
+    {
+        token.type = LexToken::Divide;
+        if (!lookahead) lex_buffer.string += 1;
+        token.string_size = 1;
+        return token;
+    }
+    if (*lex_buffer.string == '%')
+    {
+        token.type = LexToken::Modulo;
+        if (!lookahead) lex_buffer.string += 1;
+        token.string_size = 1;
+        return token;
+    }
+    if (*lex_buffer.string == '!')
+    {
+        token.type = LexToken::Not;
+        if (!lookahead) lex_buffer.string += 1;
+        token.string_size = 1;
+        return token;
+    }
+    if (strncmp(lex_buffer.string, "mut", 3) == 0 && !is_name_char(lex_buffer.string[3]))
+    {
+        token.type = LexToken::Mut;
+        if (!lookahead) lex_buffer.string += 3;
+        token.string_size = 3;
+        return token;
+    }
+    if (strncmp(lex_buffer.string, "let", 3) == 0 && !is_name_char(lex_buffer.string[3]))
+    {
+        token.type = LexToken::Let;
+        if (!lookahead) lex_buffer.string += 3;
+        token.string_size = 3;
+        return token;
+    }
+
+    auto candidate = lex_buffer.string;
+    while (*candidate >= '0' && *candidate <= '9' || *candidate == '.') candidate++;
+    if (candidate == lex_buffer.string && !(*candidate >= 'A' && *candidate <= 'Z' || *candidate >= 'a' && *candidate <= 'z' || *candidate == '_'))
+    {
+        token.type = LexToken::Unknown;
+        token.name = lex_buffer.string;
+        token.string_size = 1;
+        if (!lookahead) lex_buffer.string += 1;
+        return token;
+    }
+    if (!(*candidate >= 'A' && *candidate <= 'Z' || *candidate >= 'a' && *candidate <= 'z' || *candidate == '_'))
+    {
+        token.type = LexToken::Number;
+        token.name = lex_buffer.string;
+        token.string_size = candidate - lex_buffer.string;
+        if (!lookahead) lex_buffer.string = candidate;
+        return token;
+    }
+
+    auto word = buffer_string_ptr(lex_buffer.string);
+    auto keyword = find_keyword(word.content, word.size);
+    if (keyword >= 0)
+    {
+        token.type = LexToken::Keyword;
+        token.keyword = (Keyword)keyword;
+        token.string_size = word.size;
+        if (!lookahead) lex_buffer.string += word.size;
+        return token;
+    }
+    auto var_type = find_var_type(word.content, word.size);
+    if (var_type != VarType::Any)
+    {
+        token.type = LexToken::VarType;
+        token.var_type = var_type;
+        token.string_size = word.size;
+        if (!lookahead) lex_buffer.string += word.size;
+        return token;
+    }
+    token.type = LexToken::Name;
+    token.name = lex_buffer.string;
+    while (*lex_buffer.string && (*lex_buffer.string >= '0' && *lex_buffer.string <= '9' || *lex_buffer.string >= 'A' && *lex_buffer.string <= 'Z' || *lex_buffer.string >= 'a' && *lex_buffer.string <= 'z' || *lex_buffer.string == '_')) {
+        token.string_size++;
+        lex_buffer.string++;
+    }
+
+    if (lookahead)
+    {
+        lex_buffer.string = token.name;
+    }
+
+    auto type_decl = type_decls.find(std::string_view(token.name, token.string_size));
+    if (type_decl != type_decls.end())
+    {
+        token.type = LexToken::TypeName;
+        token.type_decl = type_decl->second;
+    }
+    else if (auto builtin = builtin_type(token.name, token.string_size))
+    {
+        token.type = LexToken::TypeName;
+        token.type_decl = builtin;
+    }
+
+    return token;
+}
+
+// Skips blanks on the current line, statements end where the line does
+bool at_line_end(LexBuffer& lex_buffer)
+{
+    while (*lex_buffer.string == ' ' || *lex_buffer.string == '\t') lex_buffer.string++;
+    return !*lex_buffer.string || *lex_buffer.string == '\n';
+}
+
+// Leaves the line break in place so the lexer still counts it
+void skip_line(LexBuffer& lex_buffer)
+{
+    while (*lex_buffer.string && *lex_buffer.string != '\n') lex_buffer.string++;
+}
+
+// End of the line string is in, the buffer bounds the search
+char* line_end(LexBuffer& lex_buffer, char* string)
+{
+    auto buffer_end = lex_buffer.buffer.content + lex_buffer.buffer.size;
+    auto new_line = (char*)memchr(string, '\n', buffer_end - string);
+    return new_line ? new_line : buffer_end;
+}
+
+// Start of the line holding the token that ends where the lexer is
+char* token_line_start(LexBuffer& lex_buffer, LexToken lex_token)
+{
+    auto line_start = lex_buffer.string - lex_token.string_size;
+    while (line_start > lex_buffer.buffer.content && line_start[-1] != '\n') line_start--;
+    return line_start;
+}
+
+// Set by the language server to collect errors instead of printing them
+struct Diagnostic
+{
+    int line;
+    int column;
+    int size;
+    std::string message;
+};
+
+std::vector<Diagnostic>* diagnostics;
+
+void print_error(LexBuffer lex_buffer, LexToken lex_token, const char* msg, const char* line)
+{
+    auto token_start = lex_buffer.string - lex_token.string_size;
+    auto line_start = token_line_start(lex_buffer, lex_token);
+    if (diagnostics)
+    {
+        diagnostics->push_back({lex_buffer.line_num, (int)(token_start - line_start), lex_token.string_size, msg});
+        return;
+    }
+
+    auto gray_fg = "\x1b[90m";
+    auto red_fg = "\x1b[31m";
+    auto clear_fg = "\x1b[39m";
+    fprintf(stderr, "%s%ls:%d:%d: %serror: ", gray_fg, lex_buffer.file_path, lex_buffer.line_num, (int)(token_start - line_start + 1), red_fg);
+    fprintf(stderr, "%s%s%s\n", gray_fg, msg, clear_fg);
+    fprintf(stderr, " %d | ", lex_buffer.line_num);
+    if (!line)
+    {
+        auto red_underline = "\x1b[4m\x1b[31m";
+        auto clear_red_underline = "\x1b[39m\x1b[24m";
+        fprintf(stderr, "%s%s%s%s%s\n", std::string(line_start, token_start).c_str(), red_underline, std::string(token_start, lex_token.string_size).c_str(), clear_red_underline, std::string(lex_buffer.string, line_end(lex_buffer, lex_buffer.string)).c_str());
+    }
+    else
+    {
+        fprintf(stderr, "%s\n", line);
+    }
+}
+
+void print_expectation_error(LexBuffer lex_buffer, LexToken lex_token, std::vector<const char*> expectations)
+{
+    assert(expectations.size() > 0);
+    auto msg = std::format("expected \"{}\"", expectations[0]);
+    for (auto i = 1; i < expectations.size(); i++)
+    {
+        msg += std::format(" or \"{}\"", expectations[i]);
+    }
+    if (diagnostics || lex_token.string_size)
+    {
+        print_error(lex_buffer, lex_token, msg.c_str(), 0);
+        return;
+    }
+
+    // Nothing to underline, the line is shown with what was expected at its end
+    auto red_fg = "\x1b[31m";
+    auto clear_fg = "\x1b[39m";
+    auto gray_fg = "\x1b[90m";
+    std::string expectation_str = std::format("{}{}", red_fg, expectations[0]);
+    for (auto i = 1; i < expectations.size(); i++)
+    {
+        expectation_str += std::format("{}/{}{}", gray_fg, red_fg, expectations[i]);
+    }
+    auto line = std::format("{} {}{}", std::string(token_line_start(lex_buffer, lex_token), lex_buffer.string), expectation_str, clear_fg);
+    print_error(lex_buffer, lex_token, msg.c_str(), line.c_str());
+}
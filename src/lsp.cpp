@@ -0,0 +1,622 @@
+#pragma once
+#include <io.h>
+#include <fcntl.h>
+
+#include <memory>
+
+#include "driver.cpp"
+
+// Just enough JSON for the language server protocol messages cpec handles
+struct Json
+{
+    enum Type { Null, Bool, Number, String, Array, Object };
+
+    Type type;
+    bool boolean;
+    double number;
+    std::string string;
+    std::vector<Json> array;
+    std::vector<std::pair<std::string, Json>> object;
+};
+
+Json* json_get(Json& json, const char* key)
+{
+    for (auto& [name, value]: json.object)
+    {
+        if (name == key) return &value;
+    }
+    return 0;
+}
+
+// Line and character of a position, false when the client left either out
+bool json_position(Json& position, int& line, int& character)
+{
+    auto line_json = json_get(position, "line");
+    auto character_json = json_get(position, "character");
+    if (!line_json || !character_json || line_json->type != Json::Number || character_json->type != Json::Number)
+        return false;
+    line = (int)line_json->number;
+    character = (int)character_json->number;
+    return true;
+}
+
+void skip_json_blanks(const char*& string)
+{
+    while (*string == ' ' || *string == '\t' || *string == '\n' || *string == '\r') string++;
+}
+
+void append_utf8(std::string& result, u64 code_point)
+{
+    if (code_point < 0x80)
+    {
+        result += (char)code_point;
+    }
+    else if (code_point < 0x800)
+    {
+        result += (char)(0xC0 | code_point >> 6);
+        result += (char)(0x80 | code_point & 0x3F);
+    }
+    else if (code_point < 0x10000)
+    {
+        result += (char)(0xE0 | code_point >> 12);
+        result += (char)(0x80 | code_point >> 6 & 0x3F);
+        result += (char)(0x80 | code_point & 0x3F);
+    }
+    else
+    {
+        result += (char)(0xF0 | code_point >> 18);
+        result += (char)(0x80 | code_point >> 12 & 0x3F);
+        result += (char)(0x80 | code_point >> 6 & 0x3F);
+        result += (char)(0x80 | code_point & 0x3F);
+    }
+}
+
+bool parse_json_string(const char*& string, std::string& result)
+{
+    if (*string != '"') return false;
+    string++;
+
+    while (*string && *string != '"')
+    {
+        if (*string != '\\')
+        {
+            result += *string++;
+            continue;
+        }
+
+        string++;
+        switch (*string)
+        {
+            case 'n': result += '\n'; break;
+            case 't': result += '\t'; break;
+            case 'r': result += '\r'; break;
+            case 'b': result += '\b'; break;
+            case 'f': result += '\f'; break;
+            case 'u':
+            {
+                char hex[5] = {};
+                strncpy(hex, string + 1, 4);
+                u64 code_point = strtoul(hex, 0, 16);
+                string += strlen(hex);
+                // Characters outside the basic plane come as a surrogate pair
+                if (code_point >= 0xD800 && code_point < 0xDC00 && string[1] == '\\' && string[2] == 'u')
+                {
+                    strncpy(hex, string + 3, 4);
+                    code_point = 0x10000 + (code_point - 0xD800 << 10) + (strtoul(hex, 0, 16) - 0xDC00);
+                    string += 2 + strlen(hex);
+                }
+                append_utf8(result, code_point);
+                break;
+            }
+            case 0: return false;
+            default: result += *string; break;
+        }
+        string++;
+    }
+
+    if (*string != '"') return false;
+    string++;
+    return true;
+}
+
+bool parse_json(const char*& string, Json& json)
+{
+    skip_json_blanks(string);
+    json = {};
+
+    if (*string == '{')
+    {
+        json.type = Json::Object;
+        string++;
+        skip_json_blanks(string);
+        if (*string == '}')
+        {
+            string++;
+            return true;
+        }
+        while (true)
+        {
+            std::pair<std::string, Json> member;
+            skip_json_blanks(string);
+            if (!parse_json_string(string, member.first)) return false;
+            skip_json_blanks(string);
+            if (*string++ != ':') return false;
+            if (!parse_json(string, member.second)) return false;
+            json.object.push_back(std::move(member));
+
+            skip_json_blanks(string);
+            if (*string == '}')
+            {
+                string++;
+                return true;
+            }
+            if (*string++ != ',') return false;
+        }
+    }
+    else if (*string == '[')
+    {
+        json.type = Json::Array;
+        string++;
+        skip_json_blanks(string);
+        if (*string == ']')
+        {
+            string++;
+            return true;
+        }
+        while (true)
+        {
+            json.array.emplace_back();
+            if (!parse_json(string, json.array.back())) return false;
+
+            skip_json_blanks(string);
+            if (*string == ']')
+            {
+                string++;
+                return true;
+            }
+            if (*string++ != ',') return false;
+        }
+    }
+    else if (*string == '"')
+    {
+        json.type = Json::String;
+        return parse_json_string(string, json.string);
+    }
+    else if (strncmp(string, "true", 4) == 0 || strncmp(string, "false", 5) == 0)
+    {
+        json.type = Json::Bool;
+        json.boolean = *string == 't';
+        string += json.boolean ? 4 : 5;
+        return true;
+    }
+    else if (strncmp(string, "null", 4) == 0)
+    {
+        json.type = Json::Null;
+        string += 4;
+        return true;
+    }
+
+    char* end;
+    json.type = Json::Number;
+    json.number = strtod(string, &end);
+    if (end == string) return false;
+    string = end;
+    return true;
+}
+
+std::string json_escape(const std::string& string)
+{
+    std::string result = "\"";
+    for (auto c: string)
+    {
+        if (c == '"' || c == '\\')
+        {
+            result += '\\';
+            result += c;
+        }
+        else if (c == '\n')
+            result += "\\n";
+        else if ((unsigned char)c < 0x20)
+            result += std::format("\\u{:04x}", (int)c);
+        else
+            result += c;
+    }
+    return result + "\"";
+}
+
+// Request ids are echoed back as they came, either a number or a string
+std::string json_id(Json* id)
+{
+    if (!id) return "null";
+    if (id->type == Json::String) return json_escape(id->string);
+    return std::format("{}", (i64)id->number);
+}
+
+bool read_message(std::string& content)
+{
+    u64 content_length = 0;
+    char header[256];
+    while (fgets(header, sizeof(header), stdin))
+    {
+        if (strcmp(header, "\r\n") == 0 || strcmp(header, "\n") == 0)
+        {
+            content.resize(content_length);
+            return fread(content.data(), 1, content_length, stdin) == content_length;
+        }
+        if (strncmp(header, "Content-Length:", 15) == 0)
+        {
+            content_length = strtoull(header + 15, 0, 10);
+        }
+    }
+    return false;
+}
+
+void write_message(const std::string& content)
+{
+    printf("Content-Length: %llu\r\n\r\n", (unsigned long long)content.size());
+    fwrite(content.data(), 1, content.size(), stdout);
+    fflush(stdout);
+}
+
+// A run of lines holding one top-level declaration, parsed on its own so an edit
+// only costs the declarations it touches
+struct Declaration
+{
+    int first_line;
+    std::unique_ptr<std::string> source;
+    std::vector<Diagnostic> diagnostics;
+    // What later declarations can see, names point into source
+    std::vector<Var> globals;
+    std::vector<std::pair<std::string_view, TypeDecl*>> types;
+    // Every TypeDecl parsing it made, freed along with it
+    std::vector<std::unique_ptr<TypeDecl>> type_storage;
+};
+
+struct Document
+{
+    std::vector<Declaration> declarations;
+};
+
+std::unordered_map<std::string, Document> documents;
+
+// Declarations start at the first column, bodies are indented and braces never start one
+bool starts_declaration(const char* line)
+{
+    return *line && *line != ' ' && *line != '\t' && *line != '\n' && *line != '{' && *line != '}';
+}
+
+bool is_generic_line(const char* line)
+{
+    return strncmp(line, "generic", 7) == 0 && !is_name_char(line[7]);
+}
+
+int count_lines(const std::string& string)
+{
+    auto result = 0;
+    for (auto c: string)
+    {
+        if (c == '\n') result++;
+    }
+    return result;
+}
+
+// Offset of the line, or of the end of the string when there are fewer lines
+u64 line_offset(const std::string& string, int line)
+{
+    u64 offset = 0;
+    while (line > 0 && offset < string.size())
+    {
+        if (string[offset++] == '\n') line--;
+    }
+    return offset;
+}
+
+// Offset of a position the editor sent. A column can't go past the line, where its line break started
+u64 position_offset(const std::string& string, int line, int column)
+{
+    auto offset = line_offset(string, line);
+    auto line_end = string.find('\n', offset);
+    auto line_size = (line_end == std::string::npos ? string.size() : line_end) - offset;
+    return offset + std::min((u64)std::max(column, 0), line_size);
+}
+
+// CRLF line endings become LF as they do for files, a lone CR isn't a line ending and stays
+std::string unix_text(const std::string& text)
+{
+    std::string result;
+    result.reserve(text.size());
+    for (u64 i = 0; i < text.size(); i++)
+    {
+        if (text[i] != '\r' || i + 1 == text.size() || text[i + 1] != '\n')
+            result += text[i];
+    }
+    return result;
+}
+
+const char* last_line(const std::string& string)
+{
+    auto line_end = string.size() > 1 ? string.rfind('\n', string.size() - 2) : std::string::npos;
+    return string.c_str() + (line_end == std::string::npos ? 0 : line_end + 1);
+}
+
+// A generic clause belongs to the function on the next line
+std::vector<std::string> split_declarations(const std::string& text)
+{
+    std::vector<std::string> result(1);
+    const char* previous_line = 0;
+    auto line = text.c_str();
+    while (*line)
+    {
+        if (previous_line && starts_declaration(line) && !is_generic_line(previous_line))
+        {
+            result.emplace_back();
+        }
+
+        auto line_end = strchr(line, '\n');
+        auto next = line_end ? line_end + 1 : line + strlen(line);
+        result.back().append(line, next);
+        previous_line = line;
+        line = next;
+    }
+    return result;
+}
+
+// Scope as seen by the first declaration after end
+void enter_declarations(Document& document, int end)
+{
+    forget_declarations();
+    for (auto i = 0; i < end; i++)
+    {
+        auto& declaration = document.declarations[i];
+        scope_vars.insert(scope_vars.end(), declaration.globals.begin(), declaration.globals.end());
+        type_decls.insert(declaration.types.begin(), declaration.types.end());
+    }
+}
+
+void parse_declaration(Declaration& declaration)
+{
+    auto scope_size = scope_vars.size();
+    declaration.diagnostics.clear();
+    diagnostics = &declaration.diagnostics;
+
+    std::string output;
+    compile_file({.content = declaration.source->data(), .size = declaration.source->size()}, L"", output);
+    release_nodes();
+
+    diagnostics = 0;
+    declaration.type_storage = std::move(parsed_type_decls);
+    parsed_type_decls.clear();
+    declaration.globals.assign(scope_vars.begin() + scope_size, scope_vars.end());
+    declaration.types.clear();
+    auto source_begin = declaration.source->data();
+    auto source_end = source_begin + declaration.source->size();
+    for (auto& [name, type_decl]: type_decls)
+    {
+        if (name.data() >= source_begin && name.data() < source_end)
+            declaration.types.emplace_back(name, type_decl);
+    }
+}
+
+// Changes here force the declarations below to be parsed again
+std::string exported_names(Document& document, int first, int last)
+{
+    std::string result;
+    for (auto i = first; i <= last; i++)
+    {
+        for (auto& global: document.declarations[i].globals)
+        {
+            result += std::format("{} {}\n", recurse_var(global, 0), name_string(global.name));
+        }
+        for (auto& [name, type_decl]: document.declarations[i].types)
+        {
+            result += std::format("type {}\n", name);
+        }
+    }
+    return result;
+}
+
+void parse_document(Document& document, const std::string& editor_text)
+{
+    document.declarations.clear();
+    auto first_line = 0;
+    for (auto& source: split_declarations(unix_text(editor_text)))
+    {
+        Declaration declaration = {.first_line = first_line, .source = std::make_unique<std::string>(source)};
+        first_line += count_lines(source);
+        document.declarations.push_back(std::move(declaration));
+    }
+
+    enter_declarations(document, 0);
+    for (auto& declaration: document.declarations)
+    {
+        parse_declaration(declaration);
+    }
+}
+
+int declaration_at(Document& document, int line)
+{
+    auto result = 0;
+    while (result + 1 < document.declarations.size() && document.declarations[result + 1].first_line <= line) result++;
+    return result;
+}
+
+// Splices the edit into the declarations it touches and parses only those again,
+// plus the ones after them when what they declare changed
+void apply_change(Document& document, int start_line, int start_column, int end_line, int end_column, const std::string& text)
+{
+    auto& declarations = document.declarations;
+    auto first = declaration_at(document, start_line);
+    auto last = declaration_at(document, end_line);
+
+    std::string region;
+    for (auto i = first; i <= last; i++)
+    {
+        region += *declarations[i].source;
+    }
+    auto old_line_count = count_lines(region);
+    auto region_line = declarations[first].first_line;
+
+    // A column past the end of a line, where the editor may still count a CR, stops at the line break
+    auto start = position_offset(region, start_line - region_line, start_column);
+    auto end = position_offset(region, end_line - region_line, end_column);
+    region.replace(start, end > start ? end - start : 0, text);
+    // A CR typed in one change can meet its LF in the next
+    region = unix_text(region);
+
+    // Indented lines continue the declaration above and a generic clause the one below
+    while (first > 0 && (!starts_declaration(region.c_str()) || is_generic_line(last_line(*declarations[first - 1].source))))
+    {
+        first--;
+        old_line_count += count_lines(*declarations[first].source);
+        region_line = declarations[first].first_line;
+        region = *declarations[first].source + region;
+    }
+    while (last + 1 < declarations.size() && (region.empty() || region.back() != '\n' || is_generic_line(last_line(region))))
+    {
+        last++;
+        old_line_count += count_lines(*declarations[last].source);
+        region += *declarations[last].source;
+    }
+
+    auto old_names = exported_names(document, first, last);
+    // Later declarations point at the types of the replaced ones, which go with them
+    auto declared_types = false;
+    for (auto i = first; i <= last; i++)
+    {
+        declared_types |= !declarations[i].types.empty();
+    }
+    std::vector<Declaration> replacements;
+    auto first_line = region_line;
+    for (auto& source: split_declarations(region))
+    {
+        Declaration declaration = {.first_line = first_line, .source = std::make_unique<std::string>(source)};
+        first_line += count_lines(source);
+        replacements.push_back(std::move(declaration));
+    }
+
+    enter_declarations(document, first);
+    for (auto& declaration: replacements)
+    {
+        parse_declaration(declaration);
+    }
+
+    auto replaced = (int)replacements.size();
+    declarations.erase(declarations.begin() + first, declarations.begin() + last + 1);
+    declarations.insert(declarations.begin() + first, std::make_move_iterator(replacements.begin()), std::make_move_iterator(replacements.end()));
+
+    auto line_delta = count_lines(region) - old_line_count;
+    auto reparse = declared_types || exported_names(document, first, first + replaced - 1) != old_names;
+    for (auto i = first + replaced; i < declarations.size(); i++)
+    {
+        declarations[i].first_line += line_delta;
+        if (reparse) parse_declaration(declarations[i]);
+    }
+}
+
+// Columns are counted in bytes, which matches the UTF-16 offsets editors send for ASCII sources
+void publish_diagnostics(const std::string& uri, Document& document)
+{
+    std::string items;
+    for (auto& declaration: document.declarations)
+    {
+        for (auto& diagnostic: declaration.diagnostics)
+        {
+            auto line = declaration.first_line + diagnostic.line - 1;
+            items += std::format("{}{{\"range\":{{\"start\":{{\"line\":{},\"character\":{}}},\"end\":{{\"line\":{},\"character\":{}}}}},\"severity\":1,\"source\":\"cpec\",\"message\":{}}}",
+                items.empty() ? "" : ",", line, diagnostic.column, line, diagnostic.column + diagnostic.size, json_escape(diagnostic.message));
+        }
+    }
+    write_message(std::format("{{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\",\"params\":{{\"uri\":{},\"diagnostics\":[{}]}}}}", json_escape(uri), items));
+}
+
+int run_language_server()
+{
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+
+    auto shutdown = false;
+    std::string content;
+    while (read_message(content))
+    {
+        Json message;
+        auto cursor = content.c_str();
+        if (!parse_json(cursor, message) || message.type != Json::Object)
+            continue;
+
+        auto method = json_get(message, "method");
+        auto id = json_get(message, "id");
+        auto params = json_get(message, "params");
+        if (!method || method->type != Json::String)
+            continue;
+
+        if (method->string == "initialize")
+        {
+            // Sync kind 2 sends only the edited ranges
+            write_message(std::format("{{\"jsonrpc\":\"2.0\",\"id\":{},\"result\":{{\"capabilities\":{{\"textDocumentSync\":{{\"openClose\":true,\"change\":2}}}},\"serverInfo\":{{\"name\":\"cpec\"}}}}}}", json_id(id)));
+        }
+        else if (method->string == "shutdown")
+        {
+            shutdown = true;
+            write_message(std::format("{{\"jsonrpc\":\"2.0\",\"id\":{},\"result\":null}}", json_id(id)));
+        }
+        else if (method->string == "exit")
+        {
+            return !shutdown;
+        }
+        else if (method->string == "textDocument/didOpen" && params)
+        {
+            auto text_document = json_get(*params, "textDocument");
+            if (!text_document) continue;
+            auto uri = json_get(*text_document, "uri");
+            auto text = json_get(*text_document, "text");
+            if (!uri || !text) continue;
+
+            auto& document = documents[uri->string];
+            parse_document(document, text->string);
+            publish_diagnostics(uri->string, document);
+        }
+        else if (method->string == "textDocument/didChange" && params)
+        {
+            auto text_document = json_get(*params, "textDocument");
+            auto changes = json_get(*params, "contentChanges");
+            if (!text_document || !changes) continue;
+            auto uri = json_get(*text_document, "uri");
+            if (!uri || !documents.contains(uri->string)) continue;
+
+            auto& document = documents[uri->string];
+            for (auto& change: changes->array)
+            {
+                auto text = json_get(change, "text");
+                auto range = json_get(change, "range");
+                if (!text) continue;
+                if (!range)
+                {
+                    parse_document(document, text->string);
+                    continue;
+                }
+
+                auto start = json_get(*range, "start");
+                auto end = json_get(*range, "end");
+                int start_line, start_character, end_line, end_character;
+                if (!start || !end || !json_position(*start, start_line, start_character) || !json_position(*end, end_line, end_character)) continue;
+                apply_change(document, start_line, start_character, end_line, end_character, text->string);
+            }
+            publish_diagnostics(uri->string, document);
+        }
+        else if (method->string == "textDocument/didClose" && params)
+        {
+            auto text_document = json_get(*params, "textDocument");
+            auto uri = text_document ? json_get(*text_document, "uri") : 0;
+            if (!uri) continue;
+
+            documents.erase(uri->string);
+            write_message(std::format("{{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\",\"params\":{{\"uri\":{},\"diagnostics\":[]}}}}", json_escape(uri->string)));
+        }
+        else if (id)
+        {
+            write_message(std::format("{{\"jsonrpc\":\"2.0\",\"id\":{},\"error\":{{\"code\":-32601,\"message\":\"unsupported method\"}}}}", json_id(id)));
+        }
+    }
+
+    return 1;
+}
@@ -0,0 +1,139 @@
+#pragma once
+#include <atomic>
+#include <new>
+#include <vector>
+#include <stdio.h>
+#include "windows_framework.h"
+#include <psapi.h>
+#include "utils.h"
+
+// The compiler's own allocations go through here, counted by what they hold, so a run can tell
+// where its memory went and the pipeline can stay under --max-memory
+struct MemoryStats
+{
+    enum Phase { Input, Tree, Output, PhaseCount };
+
+    std::atomic<u64> in_use[PhaseCount];
+    std::atomic<u64> peak[PhaseCount];
+    std::atomic<u64> total_in_use;
+    std::atomic<u64> total_peak;
+};
+
+MemoryStats memory_stats;
+const char* memory_phase_names[] = { "input", "tree", "output" };
+
+// Bytes the pipeline tries to stay under, 0 when there's no budget
+u64 memory_budget;
+
+void raise_peak(std::atomic<u64>& peak, u64 value)
+{
+    auto previous = peak.load();
+    while (previous < value && !peak.compare_exchange_weak(previous, value));
+}
+
+// Size is negative when memory is given back
+void track_memory(MemoryStats::Phase phase, i64 size)
+{
+    auto in_use = memory_stats.in_use[phase] += size;
+    raise_peak(memory_stats.peak[phase], in_use);
+    auto total_in_use = memory_stats.total_in_use += size;
+    raise_peak(memory_stats.total_peak, total_in_use);
+}
+
+bool over_memory_budget()
+{
+    return memory_budget && memory_stats.total_in_use >= memory_budget;
+}
+
+// Every allocation remembers its size and phase in front of it, so freeing needs neither
+struct alignas(16) AllocationHeader
+{
+    u64 size;
+    MemoryStats::Phase phase;
+};
+
+void* memory_alloc(u64 size, MemoryStats::Phase phase)
+{
+    auto header = (AllocationHeader*)VirtualAlloc(0, sizeof(AllocationHeader) + size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (!header)
+    {
+        DebugLog(L"Failed to allocate memory!\n");
+        return 0;
+    }
+
+    *header = {.size = size, .phase = phase};
+    track_memory(phase, size);
+    return header + 1;
+}
+
+void memory_free(void* memory)
+{
+    if (!memory)
+        return;
+
+    auto header = (AllocationHeader*)memory - 1;
+    track_memory(header->phase, -(i64)header->size);
+    VirtualFree(header, 0, MEM_RELEASE);
+}
+
+// Exprs and Stmts of the file being compiled, released together once its C++ is out.
+// Parsed type declarations outlive the file that declared them and aren't kept here
+struct NodeArena
+{
+    std::vector<char*> blocks;
+    u64 used;
+    // Nodes hold vectors, so they get destroyed before their blocks go
+    std::vector<std::pair<void*, void (*)(void*)>> nodes;
+};
+
+constexpr u64 node_block_size = KB(64);
+NodeArena tree_arena;
+
+template <typename T>
+T* new_node(T node = {})
+{
+    static_assert(sizeof(T) <= node_block_size);
+    auto size = (sizeof(T) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+    if (tree_arena.blocks.empty() || tree_arena.used + size > node_block_size)
+    {
+        auto block = (char*)memory_alloc(node_block_size, MemoryStats::Tree);
+        if (!block)
+            throw std::bad_alloc();
+        tree_arena.blocks.push_back(block);
+        tree_arena.used = 0;
+    }
+
+    auto result = new (tree_arena.blocks.back() + tree_arena.used) T(std::move(node));
+    tree_arena.used += size;
+    tree_arena.nodes.emplace_back(result, [](void* pointer) { ((T*)pointer)->~T(); });
+    return result;
+}
+
+void release_nodes()
+{
+    for (auto [node, destroy]: tree_arena.nodes)
+    {
+        destroy(node);
+    }
+    tree_arena.nodes.clear();
+    for (auto block: tree_arena.blocks)
+    {
+        memory_free(block);
+    }
+    tree_arena.blocks.clear();
+    tree_arena.used = 0;
+}
+
+void print_memory_stats()
+{
+    fprintf(stderr, "memory      in use        peak\n");
+    for (auto i = 0; i < MemoryStats::PhaseCount; i++)
+    {
+        fprintf(stderr, "%-8s %9llu KB %9llu KB\n", memory_phase_names[i], memory_stats.in_use[i].load() / 1024, memory_stats.peak[i].load() / 1024);
+    }
+    fprintf(stderr, "%-8s %9llu KB %9llu KB\n", "total", memory_stats.total_in_use.load() / 1024, memory_stats.total_peak.load() / 1024);
+
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        fprintf(stderr, "peak working set %llu KB\n", (u64)counters.PeakWorkingSetSize / 1024);
+}
@@ -0,0 +1,1617 @@
+#pragma once
+#include <algorithm>
+#include <memory>
+#include <unordered_set>
+#include "lexer.cpp"
+
+struct Var {
+    enum Modifier { None, Ptr, Array };
+
+    std::vector<Modifier> modifier;
+    std::vector<bool> is_mutable;
+    char* name;
+    enum VarType var_type;
+    struct TypeDecl* user_type;
+};
+
+struct Expr {
+    enum Type {
+        VarInit, Paren, Unary, Binary, Call, Number, Name, Elements, Index, Range, Await, New
+    } type;
+    LexToken token;
+    // The binding of a VarInit, the array walked by Elements, the array lhs evaluates to for an Index,
+    // or what a New allocates from the arena named by lhs, rhs elements of it for an array
+    Var dest_var;
+    Expr* lhs;
+    Expr* rhs;
+    std::vector<Expr*> args;
+};
+
+struct Stmt {
+    enum Type {
+        VarDecl, While, For, Return, Expression, Yield
+    } type;
+    Var var;
+    Expr* expr;
+    std::vector<Stmt*> body;
+    bool is_constexpr;
+    // Alignment the array of a For is promised to have, 0 when unknown
+    int align;
+    // A parallel For runs chunks of its iterations on a pool of threads
+    bool is_parallel;
+    // Outer variables a parallel For combines across threads, each as its update without a right side: total +=
+    std::vector<Expr*> reductions;
+    // Where a While starts in its source file
+    int line_num;
+};
+
+// Variables visible at the current point of the parse, innermost last
+std::vector<Var> scope_vars;
+
+Var* find_var(char* name, int size)
+{
+    for (auto i = (int)scope_vars.size() - 1; i >= 0; i--)
+    {
+        auto var_name = buffer_string_ptr(scope_vars[i].name);
+        if (var_name.size == size && strncmp(var_name.content, name, size) == 0)
+        {
+            return &scope_vars[i];
+        }
+    }
+    return 0;
+}
+
+// The type of one element of an array variable
+Var element_var(Var array)
+{
+    assert(array.modifier.size() && array.modifier[0] == Var::Array);
+    auto element = array;
+    element.modifier.erase(element.modifier.begin());
+    element.is_mutable.erase(element.is_mutable.begin());
+    return element;
+}
+
+bool contains_expr(Expr* expr, int type)
+{
+    if (!expr)
+        return false;
+    if (expr->type == type || contains_expr(expr->lhs, type) || contains_expr(expr->rhs, type))
+        return true;
+    for (auto arg: expr->args)
+    {
+        if (contains_expr(arg, type))
+            return true;
+    }
+    return false;
+}
+
+struct EnumValue {
+    char* name;
+    Expr* value;
+};
+
+struct TypeDecl {
+    enum Type {
+        Enum, Struct, Union, Generic, Arena
+    } type;
+    char* name;
+    std::vector<Var> fields;
+    std::vector<EnumValue> values;
+    // For Generic this is the type substituted while emitting an instantiation
+    enum VarType underlying_type;
+    // Generic parameters may be limited to some VarTypes, each gets instantiated
+    std::vector<enum VarType> constraints;
+
+    // Layout attributes, align 0 keeps the natural alignment
+    int align;
+    bool packed;
+    bool reorder;
+    bool soa;
+};
+
+// Every TypeDecl the parser made. They outlive the file declaring them, so they aren't nodes; whoever keeps
+// declarations around longer takes them over, the rest go with forget_declarations
+std::vector<std::unique_ptr<TypeDecl>> parsed_type_decls;
+
+TypeDecl* new_type_decl()
+{
+    return parsed_type_decls.emplace_back(std::make_unique<TypeDecl>()).get();
+}
+
+// Regions new allocates from. An arena declared in a scope frees everything allocated from it at the end of the scope
+TypeDecl arena_type = {.type = TypeDecl::Arena, .name = (char*)"arena"};
+
+TypeDecl* builtin_type(const char* name, u64 size)
+{
+    if (size == 5 && strncmp(name, "arena", 5) == 0)
+        return &arena_type;
+    return 0;
+}
+
+bool is_arena(Var& var)
+{
+    return var.modifier.empty() && var.user_type && var.user_type->type == TypeDecl::Arena;
+}
+
+// How indexing an array is checked. --bounds picks it for the build and a function may pick its own,
+// Default leaves it to the build
+struct Bounds
+{
+    enum Policy { Default, Checked, Debug, Unchecked, PolicyCount };
+};
+
+const char* bounds_policy_names[] = { "", "checked", "debug", "unchecked" };
+
+Bounds::Policy bounds_policy_named(const char* name)
+{
+    for (auto policy = 1; policy < Bounds::PolicyCount; policy++)
+    {
+        if (strcmp(name, bounds_policy_names[policy]) == 0)
+            return (Bounds::Policy)policy;
+    }
+    return Bounds::Default;
+}
+
+// async functions return a task their callers await, generator functions a sequence a for walks as they yield it
+struct Coroutine
+{
+    enum Kind { None, Async, Generator };
+};
+
+// Kind of the function whose body is being parsed, await and yield only go in coroutines
+Coroutine::Kind parsing_coroutine;
+// What every generator function declared so far yields, a for walks their calls
+std::unordered_map<std::string, Var> generator_yields;
+
+struct Function {
+    Var return_type;
+    char* name;
+    std::vector<Var> params;
+    std::vector<Stmt*> body;
+    std::vector<TypeDecl*> type_params;
+    bool is_constexpr;
+    // Where the declaration starts in its source file
+    int line_num;
+    Bounds::Policy bounds;
+    Coroutine::Kind coroutine;
+};
+
+ErrorOr<Var> lex_var(LexBuffer& lex_buffer, LexToken first_token)
+{
+    Var variable = {.var_type = VarType::Any};
+    LexToken lex_token;
+    auto first_time = true;
+    while (true)
+    {
+        if (first_time)
+        {
+            lex_token = first_token;
+        }
+        else
+        {
+            lex_token = lex_string(lex_buffer, true);
+            if (lex_token.type != LexToken::VarType && lex_token.type != LexToken::TypeName && lex_token.type != LexToken::Mut && lex_token.type != LexToken::LessThen && lex_token.type != LexToken::StartRect && lex_token.type != LexToken::Let)
+            {
+                break;
+            }
+            else
+            {
+                lex_string(lex_buffer, false);
+            }
+        }
+
+        if (lex_token.type == LexToken::Mut)
+        {
+            if (variable.is_mutable.size() == variable.modifier.size())
+            {
+                variable.is_mutable.push_back(true);
+            }
+            else
+            {
+                DebugLog(L"se fudeu");
+                break;
+            }
+        }
+        else
+        {
+            if (variable.is_mutable.size() == variable.modifier.size())
+            {
+                variable.is_mutable.push_back(false);
+            }
+
+            if (lex_token.type == LexToken::LessThen)
+            {
+                variable.modifier.push_back(Var::Modifier::Ptr);
+            }
+            else if (lex_token.type == LexToken::StartRect)
+            {
+                variable.modifier.push_back(Var::Modifier::Array);
+            }
+            else if (lex_token.type == LexToken::VarType)
+            {
+                variable.var_type = lex_token.var_type;
+            }
+            else if (lex_token.type == LexToken::TypeName)
+            {
+                variable.user_type = lex_token.type_decl;
+            }
+            else if (lex_token.type == LexToken::Let)
+            {
+                if (!first_time)
+                {
+                    print_error(lex_buffer, lex_token, "unexpected \"let\"", 0);
+                    break;
+                }
+            }
+        }
+
+        first_time = false;
+    }
+
+    auto starting_arrays = 0;
+    auto starting_ptrs = 0;
+    for (auto modifier: variable.modifier)
+    {
+        if (modifier == Var::Ptr)
+            starting_ptrs++;
+        else if (modifier == Var::Array)
+            starting_arrays++;
+    }
+
+    auto lex_token2 = lex_token;
+
+    auto closing_arrays = 0;
+    auto closing_ptrs = 0;
+    while (true)
+    {
+        if (lex_token2.type == LexToken::EndRect)
+        {
+            lex_token2 = lex_string(lex_buffer, false);
+            closing_arrays++;
+        }
+        else if (lex_token2.type == LexToken::BiggerThen)
+        {
+            lex_token2 = lex_string(lex_buffer, false);
+            closing_ptrs++;
+        }
+        else
+        {
+            if (closing_arrays != starting_arrays || closing_ptrs != starting_ptrs)
+            {
+                if (lex_token.type == LexToken::Name)
+                {
+                    lex_string(lex_buffer, false);
+                    print_error(lex_buffer, lex_token, "unknown token", 0);
+                }
+                else
+                {
+                    if (closing_arrays != starting_arrays)
+                        print_error(lex_buffer, lex_token2, "wrong number of ending ]", 0);
+                    else
+                        print_error(lex_buffer, lex_token2, "wrong number of ending >", 0);
+                }
+                return {};
+            }
+            break;
+        }
+        lex_token2 = lex_string(lex_buffer, true);
+    }
+
+    return variable;
+}
+
+bool possibly_var(LexToken::Type type)
+{
+    return type == LexToken::Mut || type == LexToken::VarType || type == LexToken::TypeName || type == LexToken::StartRect || type == LexToken::Let || type == LexToken::LessThen;
+}
+
+bool possibly_expr(LexToken::Type type)
+{
+    return type == LexToken::Name || type == LexToken::Number || type == LexToken::StartParen || type == LexToken::Minus || type == LexToken::Not;
+}
+
+bool is_assignment(LexToken::Type type)
+{
+    return type == LexToken::Assign || type == LexToken::PlusAssign || type == LexToken::MinusAssign || type == LexToken::MultiplyAssign || type == LexToken::DivideAssign;
+}
+
+// Same binding strength as C++ so the backend can print operators as they were written
+int binary_precedence(LexToken::Type type)
+{
+    switch (type)
+    {
+        case LexToken::Assign: case LexToken::PlusAssign: case LexToken::MinusAssign: case LexToken::MultiplyAssign: case LexToken::DivideAssign:
+            return 1;
+        case LexToken::Or:
+            return 2;
+        case LexToken::And:
+            return 3;
+        case LexToken::Equal: case LexToken::NotEqual:
+            return 4;
+        case LexToken::LessThen: case LexToken::BiggerThen: case LexToken::LessEqual: case LexToken::BiggerEqual:
+            return 5;
+        case LexToken::Plus: case LexToken::Minus:
+            return 6;
+        case LexToken::Multiply: case LexToken::Divide: case LexToken::Modulo:
+            return 7;
+        default:
+            return 0;
+    }
+}
+
+ErrorOr<Expr*> lex_expr(LexBuffer& lex_buffer, bool in_parens, int min_precedence = 1);
+
+// new [mut T](count) in scratch for an array, new <mut T> in scratch for one value, zeroed either way.
+// Whether the span or pointer can be written through is up to its mut, like any other
+ErrorOr<Expr*> lex_new(LexBuffer& lex_buffer, LexToken new_token)
+{
+    auto lex_token = lex_string(lex_buffer, false);
+    if (lex_token.type != LexToken::StartRect && lex_token.type != LexToken::LessThen)
+    {
+        print_expectation_error(lex_buffer, lex_token, {"[", "<"});
+        return {};
+    }
+    auto error = lex_var(lex_buffer, lex_token);
+    if (error.error)
+        return {};
+    auto expr = new_node(Expr{.type = Expr::New, .token = new_token, .dest_var = error.content});
+    auto& allocated = expr->dest_var;
+    if (allocated.var_type == VarType::Any && !allocated.user_type)
+    {
+        print_error(lex_buffer, lex_token, "new needs the type it allocates", 0);
+        return {};
+    }
+    // Nothing allocated from an arena is destroyed, only freed
+    if (allocated.modifier.size() == 1 && allocated.user_type && (allocated.user_type->soa || allocated.user_type->type == TypeDecl::Arena))
+    {
+        print_error(lex_buffer, lex_token, "soa structs and arenas can't be allocated from an arena", 0);
+        return {};
+    }
+
+    if (allocated.modifier[0] == Var::Array)
+    {
+        lex_token = lex_string(lex_buffer, false);
+        if (lex_token.type != LexToken::StartParen)
+        {
+            print_expectation_error(lex_buffer, lex_token, {"("});
+            return {};
+        }
+        auto count = lex_expr(lex_buffer, true);
+        if (count.error)
+            return {};
+        expr->rhs = count.content;
+        lex_token = lex_string(lex_buffer, false);
+        if (lex_token.type != LexToken::EndParen)
+        {
+            print_expectation_error(lex_buffer, lex_token, {")"});
+            return {};
+        }
+    }
+
+    lex_token = lex_string(lex_buffer, false);
+    if (!name_equals(lex_token, "in"))
+    {
+        print_expectation_error(lex_buffer, lex_token, {"in"});
+        return {};
+    }
+    lex_token = lex_string(lex_buffer, false);
+    auto arena = lex_token.type == LexToken::Name ? find_var(lex_token.name, lex_token.string_size) : 0;
+    if (!arena || !is_arena(*arena))
+    {
+        print_error(lex_buffer, lex_token, "new allocates from an arena", 0);
+        return {};
+    }
+    if (!arena->is_mutable[0])
+    {
+        print_error(lex_buffer, lex_token, "allocating from an arena needs it to be mut", 0);
+        return {};
+    }
+    expr->lhs = new_node(Expr{.type = Expr::Name, .token = lex_token, .dest_var = *arena});
+    return expr;
+}
+
+// let and mut bindings of a new take its type, so what they hold can be indexed and walked
+Var binding_type(Var variable, Expr* value)
+{
+    if (variable.var_type != VarType::Any || variable.user_type || variable.modifier.size() || value->type != Expr::New)
+        return variable;
+    auto typed = value->dest_var;
+    typed.name = variable.name;
+    typed.is_mutable[0] = variable.is_mutable[0];
+    return typed;
+}
+
+ErrorOr<Expr*> lex_primary(LexBuffer& lex_buffer, bool in_parens)
+{
+    Expr* expr = new_node<Expr>();
+
+    auto is_newline = !in_parens && at_line_end(lex_buffer);
+    auto lex_token = is_newline ? LexToken{.type = LexToken::Eof} : lex_string(lex_buffer, false);
+    expr->token = lex_token;
+
+    if (lex_token.type == LexToken::Number)
+    {
+        expr->type = Expr::Number;
+    }
+    else if (lex_token.type == LexToken::Name)
+    {
+        expr->type = Expr::Name;
+        if (strncmp(lex_buffer.string, "[]", 2) == 0)
+        {
+            auto array = find_var(lex_token.name, lex_token.string_size);
+            lex_buffer.string += 2;
+            if (!array || !array->modifier.size() || array->modifier[0] != Var::Array)
+            {
+                print_error(lex_buffer, lex_token, "element-wise operand must be an array", 0);
+                return {};
+            }
+            expr->type = Expr::Elements;
+            expr->dest_var = *array;
+        }
+        else if (*lex_buffer.string == '[')
+        {
+            auto array = find_var(lex_token.name, lex_token.string_size);
+            auto array_var = array ? *array : Var{};
+            // a[i][j] indexes what a[i] holds
+            while (*lex_buffer.string == '[')
+            {
+                auto start_rect = lex_string(lex_buffer, false);
+                if (!array_var.modifier.size() || array_var.modifier[0] != Var::Array)
+                {
+                    print_error(lex_buffer, start_rect, "only arrays can be indexed", 0);
+                    return {};
+                }
+
+                auto error = lex_expr(lex_buffer, true);
+                if (error.error)
+                    return {};
+
+                lex_token = lex_string(lex_buffer, false);
+                if (lex_token.type != LexToken::EndRect)
+                {
+                    print_expectation_error(lex_buffer, lex_token, {"]"});
+                    return {};
+                }
+                expr = new_node(Expr{.type = Expr::Index, .token = start_rect, .dest_var = array_var, .lhs = expr, .rhs = error.content});
+                array_var = element_var(array_var);
+            }
+        }
+        else if (*lex_buffer.string == '(')
+        {
+            expr->type = Expr::Call;
+            lex_string(lex_buffer, false);
+            if (lex_string(lex_buffer, true).type == LexToken::EndParen)
+            {
+                lex_string(lex_buffer, false);
+                return expr;
+            }
+            while (true)
+            {
+                auto error = lex_expr(lex_buffer, true);
+                if (error.error)
+                    return {};
+                expr->args.push_back(error.content);
+
+                lex_token = lex_string(lex_buffer, false);
+                if (lex_token.type == LexToken::EndParen)
+                {
+                    break;
+                }
+                else if (lex_token.type != LexToken::Comma)
+                {
+                    print_expectation_error(lex_buffer, lex_token, {")", ","});
+                    return {};
+                }
+            }
+        }
+    }
+    else if (lex_token.type == LexToken::StartParen)
+    {
+        expr->type = Expr::Paren;
+        auto error = lex_expr(lex_buffer, true);
+        if (error.error)
+            return {};
+        expr->rhs = error.content;
+
+        lex_token = lex_string(lex_buffer, false);
+        if (lex_token.type != LexToken::EndParen)
+        {
+            print_expectation_error(lex_buffer, lex_token, {")"});
+            return {};
+        }
+    }
+    else if (lex_token.type == LexToken::Minus || lex_token.type == LexToken::Not)
+    {
+        expr->type = Expr::Unary;
+        auto error = lex_primary(lex_buffer, in_parens);
+        if (error.error)
+            return {};
+        expr->rhs = error.content;
+    }
+    else if (lex_token.type == LexToken::Keyword && lex_token.keyword == Keyword::New)
+    {
+        return lex_new(lex_buffer, lex_token);
+    }
+    else if (lex_token.type == LexToken::Keyword && lex_token.keyword == Keyword::Await)
+    {
+        if (parsing_coroutine != Coroutine::Async)
+        {
+            print_error(lex_buffer, lex_token, "await can only be used in an async function", 0);
+            return {};
+        }
+        expr->type = Expr::Await;
+        auto error = lex_primary(lex_buffer, in_parens);
+        if (error.error)
+            return {};
+        expr->rhs = error.content;
+    }
+    else if (lex_token.type == LexToken::Mut || lex_token.type == LexToken::Let)
+    {
+        Var variable = {.var_type = VarType::Any};
+        variable.is_mutable.push_back(lex_token.type == LexToken::Mut);
+
+        lex_token = lex_string(lex_buffer, false);
+        if (lex_token.type != LexToken::Name)
+        {
+            print_expectation_error(lex_buffer, lex_token, {"name"});
+            return {};
+        }
+        variable.name = lex_token.name;
+
+        lex_token = lex_string(lex_buffer, false);
+        if (lex_token.type != LexToken::Assign)
+        {
+            print_expectation_error(lex_buffer, lex_token, {"="});
+            return {};
+        }
+
+        expr->type = Expr::VarInit;
+        auto error = lex_expr(lex_buffer, in_parens);
+        if (error.error)
+            return {};
+        expr->rhs = error.content;
+        expr->dest_var = binding_type(variable, expr->rhs);
+        scope_vars.push_back(expr->dest_var);
+    }
+    else
+    {
+        print_expectation_error(lex_buffer, lex_token, {"expression"});
+        return {};
+    }
+
+    return expr;
+}
+
+ErrorOr<Expr*> lex_expr(LexBuffer& lex_buffer, bool in_parens, int min_precedence)
+{
+    auto error = lex_primary(lex_buffer, in_parens);
+    if (error.error)
+        return {};
+    auto lhs = error.content;
+
+    while (true)
+    {
+        if (!in_parens && at_line_end(lex_buffer))
+            break;
+
+        auto lex_token = lex_string(lex_buffer, true);
+        auto precedence = binary_precedence(lex_token.type);
+        if (!precedence || precedence < min_precedence)
+            break;
+
+        lex_string(lex_buffer, false);
+        if (is_assignment(lex_token.type) && lhs->type != Expr::Name && lhs->type != Expr::Elements && lhs->type != Expr::Index)
+        {
+            print_error(lex_buffer, lex_token, "left side of assignment is not a variable", 0);
+            return {};
+        }
+        if (is_assignment(lex_token.type) && lhs->type == Expr::Index && !lhs->dest_var.is_mutable[1])
+        {
+            print_error(lex_buffer, lex_token, "elements of an immutable array can't be assigned", 0);
+            return {};
+        }
+
+        // Assignments are right associative, everything else groups to the left
+        auto error = lex_expr(lex_buffer, in_parens, is_assignment(lex_token.type) ? precedence : precedence + 1);
+        if (error.error)
+            return {};
+
+        auto binary = new_node<Expr>();
+        binary->type = Expr::Binary;
+        binary->token = lex_token;
+        binary->lhs = lhs;
+        binary->rhs = error.content;
+        lhs = binary;
+    }
+
+    return lhs;
+}
+
+bool expect_statement_end(LexBuffer& lex_buffer)
+{
+    if (at_line_end(lex_buffer))
+        return true;
+
+    auto lex_token = lex_string(lex_buffer, true);
+    if (lex_token.type == LexToken::EndCurly || lex_token.type == LexToken::SLComment || lex_token.type == LexToken::Eof)
+        return true;
+
+    lex_string(lex_buffer, false);
+    print_error(lex_buffer, lex_token, "unexpected token at the end of the statement", 0);
+    return false;
+}
+
+// Element-wise operations lower to a loop of their own, so they can only make up a whole statement
+bool expect_no_elements(LexBuffer& lex_buffer, Expr* expr)
+{
+    if (contains_expr(expr, Expr::Elements))
+    {
+        print_error(lex_buffer, expr->token, "element-wise operation must be a statement of its own", 0);
+        return false;
+    }
+    return true;
+}
+
+ErrorOr<Stmt*> lex_var_init(LexBuffer& lex_buffer, Var variable)
+{
+    auto stmt = new_node<Stmt>();
+    stmt->type = Stmt::VarDecl;
+
+    auto error = lex_expr(lex_buffer, false);
+    if (error.error)
+        return {};
+    stmt->expr = error.content;
+    stmt->var = binding_type(variable, stmt->expr);
+
+    if (!expect_no_elements(lex_buffer, stmt->expr) || !expect_statement_end(lex_buffer))
+        return {};
+
+    scope_vars.push_back(stmt->var);
+    return stmt;
+}
+
+ErrorOr<std::vector<Stmt*>> lex_block(LexBuffer& lex_buffer);
+
+// "const" takes a full type like any declaration, or only a name like "let"
+ErrorOr<Var> lex_const_var(LexBuffer& lex_buffer)
+{
+    auto lex_token = lex_string(lex_buffer, true);
+    if (lex_token.type == LexToken::Name)
+    {
+        Var variable = {.var_type = VarType::Any};
+        variable.is_mutable.push_back(false);
+        return variable;
+    }
+
+    lex_string(lex_buffer, false);
+    if (!possibly_var(lex_token.type))
+    {
+        print_expectation_error(lex_buffer, lex_token, {"name", "variable type"});
+        return {};
+    }
+
+    auto error = lex_var(lex_buffer, lex_token);
+    if (error.error)
+        return {};
+    if (error.content.is_mutable[0])
+    {
+        print_error(lex_buffer, lex_token, "compile-time constant can't be mut", 0);
+        return {};
+    }
+    return error.content;
+}
+
+ErrorOr<Stmt*> lex_const_decl(LexBuffer& lex_buffer)
+{
+    auto error = lex_const_var(lex_buffer);
+    if (error.error)
+        return {};
+    auto variable = error.content;
+
+    auto lex_token = lex_string(lex_buffer, false);
+    if (lex_token.type != LexToken::Name)
+    {
+        print_expectation_error(lex_buffer, lex_token, {"name"});
+        return {};
+    }
+    variable.name = lex_token.name;
+
+    lex_token = lex_string(lex_buffer, false);
+    if (lex_token.type != LexToken::Assign)
+    {
+        print_expectation_error(lex_buffer, lex_token, {"="});
+        return {};
+    }
+
+    auto stmt = lex_var_init(lex_buffer, variable);
+    if (stmt.error)
+        return {};
+    stmt.content->is_constexpr = true;
+    return stmt;
+}
+
+ErrorOr<Stmt*> lex_while(LexBuffer& lex_buffer)
+{
+    auto stmt = new_node<Stmt>();
+    stmt->type = Stmt::While;
+    stmt->line_num = lex_buffer.line_num;
+    auto error = lex_expr(lex_buffer, false);
+    if (error.error)
+        return {};
+    stmt->expr = error.content;
+    if (!expect_no_elements(lex_buffer, stmt->expr))
+        return {};
+
+    auto lex_token = lex_string(lex_buffer, false);
+    if (lex_token.type != LexToken::StartCurly)
+    {
+        print_expectation_error(lex_buffer, lex_token, {"{"});
+        return {};
+    }
+
+    auto body = lex_block(lex_buffer);
+    if (body.error)
+        return {};
+    stmt->body = body.content;
+    return stmt;
+}
+
+// range([first,] end) of a parallel for, first is 0 when left out
+ErrorOr<Expr*> lex_range(LexBuffer& lex_buffer, LexToken range_token)
+{
+    auto lex_token = lex_string(lex_buffer, false);
+    if (lex_token.type != LexToken::StartParen)
+    {
+        print_expectation_error(lex_buffer, lex_token, {"("});
+        return {};
+    }
+
+    auto range = new_node(Expr{.type = Expr::Range, .token = range_token});
+    auto error = lex_expr(lex_buffer, true);
+    if (error.error)
+        return {};
+    range->rhs = error.content;
+
+    lex_token = lex_string(lex_buffer, false);
+    if (lex_token.type == LexToken::Comma)
+    {
+        range->lhs = range->rhs;
+        error = lex_expr(lex_buffer, true);
+        if (error.error)
+            return {};
+        range->rhs = error.content;
+        lex_token = lex_string(lex_buffer, false);
+    }
+    if (lex_token.type != LexToken::EndParen)
+    {
+        print_expectation_error(lex_buffer, lex_token, {")", ","});
+        return {};
+    }
+    if (!expect_no_elements(lex_buffer, range->rhs) || range->lhs && !expect_no_elements(lex_buffer, range->lhs))
+        return {};
+    return range;
+}
+
+// reduce(a, b) of a parallel for, the update each gets is found in the body
+bool lex_reductions(LexBuffer& lex_buffer, Stmt* stmt)
+{
+    auto lex_token = lex_string(lex_buffer, false);
+    if (lex_token.type != LexToken::StartParen)
+    {
+        print_expectation_error(lex_buffer, lex_token, {"("});
+        return false;
+    }
+    while (true)
+    {
+        lex_token = lex_string(lex_buffer, false);
+        auto var = lex_token.type == LexToken::Name ? find_var(lex_token.name, lex_token.string_size) : 0;
+        if (!var || var->modifier.size() || var->user_type || var->var_type == VarType::Any || var->var_type == VarType::Bool || !var->is_mutable[0])
+        {
+            print_error(lex_buffer, lex_token, "only mutable numeric variables can be reduced", 0);
+            return false;
+        }
+        auto name = new_node(Expr{.type = Expr::Name, .token = lex_token, .dest_var = *var});
+        stmt->reductions.push_back(new_node(Expr{.type = Expr::Binary, .token = {.type = LexToken::Unknown}, .lhs = name}));
+
+        lex_token = lex_string(lex_buffer, false);
+        if (lex_token.type == LexToken::EndParen)
+            return true;
+        if (lex_token.type != LexToken::Comma)
+        {
+            print_expectation_error(lex_buffer, lex_token, {")", ","});
+            return false;
+        }
+    }
+}
+
+// for [mut] x in values [align(N)] { ... }
+// parallel for [mut] x in values [align(N)] [reduce(a, b)] { ... }, or with i in range([first,] end) instead
+ErrorOr<Stmt*> lex_for(LexBuffer& lex_buffer, bool is_parallel = false)
+{
+    auto stmt = new_node<Stmt>();
+    stmt->type = Stmt::For;
+    stmt->is_parallel = is_parallel;
+
+    auto lex_token = lex_string(lex_buffer, false);
+    auto is_mutable = lex_token.type == LexToken::Mut;
+    if (is_mutable)
+        lex_token = lex_string(lex_buffer, false);
+    if (lex_token.type != LexToken::Name)
+    {
+        print_expectation_error(lex_buffer, lex_token, {"name"});
+        return {};
+    }
+    auto var_name = lex_token.name;
+
+    lex_token = lex_string(lex_buffer, false);
+    if (!name_equals(lex_token, "in"))
+    {
+        print_expectation_error(lex_buffer, lex_token, {"in"});
+        return {};
+    }
+
+    auto walked_buffer = lex_buffer;
+    lex_token = lex_string(lex_buffer, false);
+    auto array = lex_token.type == LexToken::Name ? find_var(lex_token.name, lex_token.string_size) : 0;
+    auto generator = !array && lex_token.type == LexToken::Name && *lex_buffer.string == '(' ? generator_yields.find(std::string(lex_token.name, lex_token.string_size)) : generator_yields.end();
+    if (is_parallel && !array && name_equals(lex_token, "range"))
+    {
+        if (is_mutable)
+        {
+            print_error(lex_buffer, lex_token, "the index of a range can't be mut", 0);
+            return {};
+        }
+        auto error = lex_range(lex_buffer, lex_token);
+        if (error.error)
+            return {};
+        stmt->expr = error.content;
+        stmt->var = {.is_mutable = {false}, .name = var_name, .var_type = VarType::I64};
+    }
+    else if (!is_parallel && generator != generator_yields.end())
+    {
+        // The call is an expression of its own, parsed again from its name
+        lex_buffer = walked_buffer;
+        auto error = lex_primary(lex_buffer, false);
+        if (error.error)
+            return {};
+        stmt->expr = error.content;
+        stmt->var = generator->second;
+        stmt->var.name = var_name;
+        stmt->var.is_mutable[0] = is_mutable;
+    }
+    else
+    {
+        if (!array || !array->modifier.size() || array->modifier[0] != Var::Array)
+        {
+            print_error(lex_buffer, lex_token, is_parallel ? "parallel for can only walk an array or a range" : "for can only walk an array or a generator", 0);
+            return {};
+        }
+        stmt->expr = new_node(Expr{.type = Expr::Name, .token = lex_token, .dest_var = *array});
+
+        stmt->var = element_var(*array);
+        stmt->var.name = var_name;
+        if (is_mutable && !stmt->var.is_mutable[0])
+        {
+            print_error(lex_buffer, lex_token, "elements of an immutable array can't be mut", 0);
+            return {};
+        }
+        stmt->var.is_mutable[0] = is_mutable;
+    }
+
+    lex_token = lex_string(lex_buffer, false);
+    if (name_equals(lex_token, "align"))
+    {
+        if (stmt->expr->type != Expr::Name)
+        {
+            print_error(lex_buffer, lex_token, "only an array walked can be aligned", 0);
+            return {};
+        }
+        lex_token = lex_string(lex_buffer, false);
+        if (lex_token.type == LexToken::StartParen)
+            lex_token = lex_string(lex_buffer, false);
+        auto align = lex_token.type == LexToken::Number ? atoi(std::string(lex_token.name, lex_token.string_size).c_str()) : 0;
+        if (align <= 0 || align & (align - 1))
+        {
+            print_error(lex_buffer, lex_token, "alignment must be a power of two", 0);
+            return {};
+        }
+        stmt->align = align;
+
+        lex_token = lex_string(lex_buffer, false);
+        if (lex_token.type != LexToken::EndParen)
+        {
+            print_expectation_error(lex_buffer, lex_token, {")"});
+            return {};
+        }
+        lex_token = lex_string(lex_buffer, false);
+    }
+    if (is_parallel && name_equals(lex_token, "reduce"))
+    {
+        if (!lex_reductions(lex_buffer, stmt))
+            return {};
+        lex_token = lex_string(lex_buffer, false);
+    }
+    if (lex_token.type != LexToken::StartCurly)
+    {
+        if (is_parallel)
+            print_expectation_error(lex_buffer, lex_token, {"{", "align", "reduce"});
+        else
+            print_expectation_error(lex_buffer, lex_token, {"{", "align"});
+        return {};
+    }
+
+    auto scope_size = scope_vars.size();
+    scope_vars.push_back(stmt->var);
+    auto body = lex_block(lex_buffer);
+    scope_vars.resize(scope_size);
+    if (body.error)
+        return {};
+    stmt->body = body.content;
+    return stmt;
+}
+
+// What the body of a parallel for may do: it can't return, and of the outer variables it only assigns its reductions,
+// each either with += and -= or with *=. Reductions are only complete after the loop, so they can't be read inside
+struct ParallelCheck
+{
+    std::vector<std::string> locals;
+    std::vector<Expr*>& reductions;
+    // The first problem found
+    std::string error;
+
+    bool is_local(const std::string& name)
+    {
+        return std::find(locals.begin(), locals.end(), name) != locals.end();
+    }
+
+    Expr* find_reduction(const std::string& name)
+    {
+        for (auto reduction: reductions)
+        {
+            if (std::string(reduction->lhs->token.name, reduction->lhs->token.string_size) == name)
+                return reduction;
+        }
+        return 0;
+    }
+};
+
+void check_parallel_expr(Expr* expr, ParallelCheck& check)
+{
+    if (!expr || !check.error.empty())
+        return;
+    if (expr->type == Expr::VarInit)
+    {
+        // Bound after its value is computed
+        check_parallel_expr(expr->rhs, check);
+        check.locals.push_back(name_string(expr->dest_var.name));
+        return;
+    }
+    if (expr->type == Expr::Binary && is_assignment(expr->token.type) && expr->lhs->type == Expr::Name)
+    {
+        auto name = std::string(expr->lhs->token.name, expr->lhs->token.string_size);
+        if (!check.is_local(name))
+        {
+            auto reduction = check.find_reduction(name);
+            auto additive = expr->token.type == LexToken::PlusAssign || expr->token.type == LexToken::MinusAssign;
+            if (!reduction)
+                check.error = std::format("parallel for assigns {}, which isn't one of its reductions", name);
+            else if (!additive && expr->token.type != LexToken::MultiplyAssign)
+                check.error = std::format("reduction {} can only be updated with +=, -= or *=", name);
+            else if (reduction->token.type != LexToken::Unknown && (reduction->token.type == LexToken::PlusAssign) != additive)
+                check.error = std::format("reduction {} can't be both added to and multiplied", name);
+            else
+                reduction->token.type = additive ? LexToken::PlusAssign : LexToken::MultiplyAssign;
+            check_parallel_expr(expr->rhs, check);
+            return;
+        }
+    }
+    if (expr->type == Expr::Await)
+    {
+        check.error = "await can't suspend inside a parallel for";
+        return;
+    }
+    if (expr->type == Expr::New && !check.is_local(std::string(expr->lhs->token.name, expr->lhs->token.string_size)))
+    {
+        check.error = std::format("parallel for allocates from {}, only an arena declared in its body can be", std::string(expr->lhs->token.name, expr->lhs->token.string_size));
+        return;
+    }
+    if (expr->type == Expr::Name && !check.is_local(std::string(expr->token.name, expr->token.string_size)) && check.find_reduction(std::string(expr->token.name, expr->token.string_size)))
+    {
+        check.error = std::format("reduction {} is only complete after the parallel for, it can't be read inside", std::string(expr->token.name, expr->token.string_size));
+        return;
+    }
+    check_parallel_expr(expr->lhs, check);
+    check_parallel_expr(expr->rhs, check);
+    for (auto arg: expr->args)
+    {
+        check_parallel_expr(arg, check);
+    }
+}
+
+void check_parallel_body(std::vector<Stmt*>& body, ParallelCheck& check)
+{
+    auto locals_size = check.locals.size();
+    for (auto stmt: body)
+    {
+        if (!check.error.empty())
+            return;
+        if (stmt->type == Stmt::Return)
+            check.error = "return can't leave a parallel for";
+        if (stmt->type == Stmt::Yield)
+            check.error = "yield can't suspend inside a parallel for";
+        for (auto reduction: stmt->reductions)
+        {
+            // Combined once the nested loop is done, by the thread running it
+            auto name = std::string(reduction->lhs->token.name, reduction->lhs->token.string_size);
+            if (!check.is_local(name))
+                check.error = std::format("nested parallel for reduces {}, which isn't a variable of the enclosing body", name);
+        }
+        check_parallel_expr(stmt->expr, check);
+        if (stmt->type == Stmt::VarDecl || stmt->type == Stmt::For)
+            check.locals.push_back(name_string(stmt->var.name));
+        check_parallel_body(stmt->body, check);
+    }
+    check.locals.resize(locals_size);
+}
+
+ErrorOr<Stmt*> lex_parallel_for(LexBuffer& lex_buffer, LexToken parallel_token)
+{
+    // Problems with the body are only known once it's parsed, they're reported at "parallel"
+    auto parallel_buffer = lex_buffer;
+    auto lex_token = lex_string(lex_buffer, false);
+    if (lex_token.type != LexToken::Keyword || lex_token.keyword != Keyword::For)
+    {
+        print_expectation_error(lex_buffer, lex_token, {"for"});
+        return {};
+    }
+
+    auto error = lex_for(lex_buffer, true);
+    if (error.error)
+        return {};
+    auto stmt = error.content;
+    ParallelCheck check = {.locals = {name_string(stmt->var.name)}, .reductions = stmt->reductions};
+    check_parallel_body(stmt->body, check);
+    if (!check.error.empty())
+    {
+        print_error(parallel_buffer, parallel_token, check.error.c_str(), 0);
+        return {};
+    }
+    // Never updated, adding nothing leaves them as they were
+    for (auto reduction: stmt->reductions)
+    {
+        if (reduction->token.type == LexToken::Unknown)
+            reduction->token.type = LexToken::PlusAssign;
+    }
+    return stmt;
+}
+
+ErrorOr<Stmt*> lex_statement(LexBuffer& lex_buffer)
+{
+    auto lex_token = lex_string(lex_buffer, true);
+    if (possibly_expr(lex_token.type) || lex_token.type == LexToken::Keyword && lex_token.keyword == Keyword::Await)
+    {
+        auto stmt = new_node<Stmt>();
+        stmt->type = Stmt::Expression;
+        auto error = lex_expr(lex_buffer, false);
+        if (error.error)
+            return {};
+        stmt->expr = error.content;
+        if (contains_expr(stmt->expr, Expr::Elements) && contains_expr(stmt->expr, Expr::VarInit))
+        {
+            print_error(lex_buffer, stmt->expr->token, "element-wise operation can't bind variables", 0);
+            return {};
+        }
+
+        if (!expect_statement_end(lex_buffer))
+            return {};
+
+        return stmt;
+    }
+
+    lex_string(lex_buffer, false);
+    if (possibly_var(lex_token.type))
+    {
+        auto error = lex_var(lex_buffer, lex_token);
+        if (error.error)
+            return {};
+        auto variable = error.content;
+
+        lex_token = lex_string(lex_buffer, false);
+        if (lex_token.type != LexToken::Name)
+        {
+            print_expectation_error(lex_buffer, lex_token, {"name"});
+            return {};
+        }
+        variable.name = lex_token.name;
+
+        auto next_type = at_line_end(lex_buffer) ? LexToken::Eof : lex_string(lex_buffer, true).type;
+        if (next_type == LexToken::Eof || next_type == LexToken::EndCurly || next_type == LexToken::SLComment)
+        {
+            if (variable.var_type == VarType::Any && !variable.user_type)
+            {
+                print_error(lex_buffer, lex_token, "variable without a type needs an initializer", 0);
+                return {};
+            }
+            if (!variable.is_mutable[0])
+            {
+                print_error(lex_buffer, lex_token, "immutable variable needs an initializer", 0);
+                return {};
+            }
+
+            auto stmt = new_node<Stmt>();
+            stmt->type = Stmt::VarDecl;
+            stmt->var = variable;
+            stmt->expr = 0;
+            scope_vars.push_back(variable);
+            return stmt;
+        }
+
+        lex_token = lex_string(lex_buffer, false);
+        if (lex_token.type != LexToken::Assign)
+        {
+            print_expectation_error(lex_buffer, lex_token, {"="});
+            return {};
+        }
+
+        return lex_var_init(lex_buffer, variable);
+    }
+    else if (lex_token.type == LexToken::Keyword)
+    {
+        if (lex_token.keyword == Keyword::While)
+        {
+            return lex_while(lex_buffer);
+        }
+        else if (lex_token.keyword == Keyword::For)
+        {
+            return lex_for(lex_buffer);
+        }
+        else if (lex_token.keyword == Keyword::Parallel)
+        {
+            return lex_parallel_for(lex_buffer, lex_token);
+        }
+        else if (lex_token.keyword == Keyword::Const)
+        {
+            return lex_const_decl(lex_buffer);
+        }
+        else if (lex_token.keyword == Keyword::Return)
+        {
+            auto stmt = new_node<Stmt>();
+            stmt->type = Stmt::Return;
+            stmt->expr = 0;
+            // Looking for a value skips ahead, the errors below point at "return"
+            auto return_buffer = lex_buffer;
+            auto has_value = !at_line_end(lex_buffer) && lex_string(lex_buffer, true).type != LexToken::EndCurly;
+            if (parsing_coroutine == Coroutine::Generator && has_value)
+            {
+                print_error(return_buffer, lex_token, "a generator yields its values, its return can't have one", 0);
+                return {};
+            }
+            if (parsing_coroutine == Coroutine::Async && !has_value)
+            {
+                print_error(return_buffer, lex_token, "return of an async function needs a value", 0);
+                return {};
+            }
+            if (has_value)
+            {
+                auto error = lex_expr(lex_buffer, false);
+                if (error.error)
+                    return {};
+                stmt->expr = error.content;
+                if (!expect_no_elements(lex_buffer, stmt->expr))
+                    return {};
+            }
+
+            if (!expect_statement_end(lex_buffer))
+                return {};
+
+            return stmt;
+        }
+        else if (lex_token.keyword == Keyword::Yield)
+        {
+            if (parsing_coroutine != Coroutine::Generator)
+            {
+                print_error(lex_buffer, lex_token, "yield can only be used in a generator function", 0);
+                return {};
+            }
+            auto stmt = new_node<Stmt>();
+            stmt->type = Stmt::Yield;
+            auto error = lex_expr(lex_buffer, false);
+            if (error.error)
+                return {};
+            stmt->expr = error.content;
+            if (!expect_no_elements(lex_buffer, stmt->expr))
+                return {};
+
+            if (!expect_statement_end(lex_buffer))
+                return {};
+
+            return stmt;
+        }
+    }
+
+    print_error(lex_buffer, lex_token, "expected statement", 0);
+    return {};
+}
+
+// Parses statements up to and including the closing "}"
+ErrorOr<std::vector<Stmt*>> lex_block(LexBuffer& lex_buffer)
+{
+    auto scope_size = scope_vars.size();
+    std::vector<Stmt*> body;
+    while (true)
+    {
+        auto lex_token = lex_string(lex_buffer, true);
+        if (lex_token.type == LexToken::EndCurly)
+        {
+            lex_string(lex_buffer, false);
+            break;
+        }
+        else if (lex_token.type == LexToken::Eof)
+        {
+            print_expectation_error(lex_buffer, lex_token, {"}"});
+            return {};
+        }
+        else if (lex_token.type == LexToken::SLComment)
+        {
+            skip_line(lex_buffer);
+            continue;
+        }
+
+        auto error = lex_statement(lex_buffer);
+        if (error.error)
+            return {};
+        body.push_back(error.content);
+    }
+
+    scope_vars.resize(scope_size);
+    return body;
+}
+
+ErrorOr<Function> lex_function(LexBuffer& lex_buffer, Var return_type, Coroutine::Kind coroutine = Coroutine::None)
+{
+    Function function = {};
+    function.return_type = return_type;
+    function.name = return_type.name;
+    function.line_num = lex_buffer.line_num;
+    function.coroutine = coroutine;
+    auto scope_size = scope_vars.size();
+    // Looking a name up among the params so far would make long parameter lists quadratic
+    std::unordered_set<std::string_view> param_names;
+
+    while (true)
+    {
+        auto lex_token = lex_string(lex_buffer, false);
+        if (possibly_var(lex_token.type))
+        {
+            auto error = lex_var(lex_buffer, lex_token);
+            if (error.error) return {};
+            auto var = error.content;
+            lex_token = lex_string(lex_buffer, false);
+            if (lex_token.type == LexToken::Name)
+            {
+                auto name = buffer_string_ptr(lex_token.name);
+                if (param_names.insert(std::string_view(name.content, name.size)).second)
+                {
+                    var.name = lex_token.name;
+                    function.params.push_back(var);
+                    scope_vars.push_back(var);
+
+                    lex_token = lex_string(lex_buffer, false);
+                    if (lex_token.type == LexToken::EndParen)
+                    {
+                        break;
+                    }
+                    else if (lex_token.type != LexToken::Comma)
+                    {
+                        print_expectation_error(lex_buffer, lex_token, {")", ","});
+                        return {};
+                    }
+                }
+                else
+                {
+                    print_error(lex_buffer, lex_token, "function parameter is repeated", 0);
+                    return {};
+                }
+            }
+            else
+            {
+                print_expectation_error(lex_buffer, lex_token, {"name"});
+                return {};
+            }
+        }
+        else
+        {
+            if (function.params.size() == 0 && lex_token.type == LexToken::EndParen)
+            {
+                break;
+            }
+            else
+            {
+                print_expectation_error(lex_buffer, lex_token, {"variable type"});
+                return {};
+            }
+        }
+    }
+
+    auto lex_token = lex_string(lex_buffer, false);
+    if (name_equals(lex_token, "bounds"))
+    {
+        lex_token = lex_string(lex_buffer, false);
+        if (lex_token.type != LexToken::StartParen)
+        {
+            print_expectation_error(lex_buffer, lex_token, {"("});
+            return {};
+        }
+        lex_token = lex_string(lex_buffer, false);
+        function.bounds = lex_token.type == LexToken::Name ? bounds_policy_named(name_string(lex_token.name).c_str()) : Bounds::Default;
+        if (!function.bounds)
+        {
+            print_expectation_error(lex_buffer, lex_token, {"checked", "debug", "unchecked"});
+            return {};
+        }
+        lex_token = lex_string(lex_buffer, false);
+        if (lex_token.type != LexToken::EndParen)
+        {
+            print_expectation_error(lex_buffer, lex_token, {")"});
+            return {};
+        }
+        lex_token = lex_string(lex_buffer, false);
+    }
+    if (lex_token.type != LexToken::StartCurly)
+    {
+        print_expectation_error(lex_buffer, lex_token, {"{", "bounds"});
+        return {};
+    }
+
+    // Declared ahead of the body, a generator may walk itself
+    if (coroutine == Coroutine::Generator)
+        generator_yields[name_string(function.name)] = return_type;
+    parsing_coroutine = coroutine;
+    auto body = lex_block(lex_buffer);
+    parsing_coroutine = Coroutine::None;
+    scope_vars.resize(scope_size);
+    if (body.error)
+        return {};
+    function.body = body.content;
+
+    return function;
+}
+
+// Attributes sit between the type name and "{": align(N), packed, reorder and soa
+bool lex_layout_attributes(LexBuffer& lex_buffer, TypeDecl* type_decl)
+{
+    while (true)
+    {
+        auto lex_token = lex_string(lex_buffer, false);
+        if (lex_token.type == LexToken::StartCurly)
+        {
+            return true;
+        }
+        else if (type_decl->type == TypeDecl::Enum && lex_token.type == LexToken::VarType && !type_decl->underlying_type)
+        {
+            type_decl->underlying_type = lex_token.var_type;
+        }
+        else if (type_decl->type != TypeDecl::Enum && name_equals(lex_token, "align"))
+        {
+            lex_token = lex_string(lex_buffer, false);
+            if (lex_token.type != LexToken::StartParen)
+            {
+                print_expectation_error(lex_buffer, lex_token, {"("});
+                return false;
+            }
+            lex_token = lex_string(lex_buffer, false);
+            auto align = lex_token.type == LexToken::Number ? atoi(std::string(lex_token.name, lex_token.string_size).c_str()) : 0;
+            if (align <= 0 || align & (align - 1))
+            {
+                print_error(lex_buffer, lex_token, "alignment must be a power of two", 0);
+                return false;
+            }
+            type_decl->align = align;
+            lex_token = lex_string(lex_buffer, false);
+            if (lex_token.type != LexToken::EndParen)
+            {
+                print_expectation_error(lex_buffer, lex_token, {")"});
+                return false;
+            }
+        }
+        else if (type_decl->type != TypeDecl::Enum && name_equals(lex_token, "packed"))
+        {
+            type_decl->packed = true;
+        }
+        else if (type_decl->type == TypeDecl::Struct && name_equals(lex_token, "reorder"))
+        {
+            type_decl->reorder = true;
+        }
+        else if (type_decl->type == TypeDecl::Struct && name_equals(lex_token, "soa"))
+        {
+            type_decl->soa = true;
+        }
+        else
+        {
+            if (type_decl->type == TypeDecl::Enum)
+                print_expectation_error(lex_buffer, lex_token, {"{", "variable type"});
+            else
+                print_expectation_error(lex_buffer, lex_token, {"{", "layout attribute"});
+            return false;
+        }
+    }
+}
+
+ErrorOr<TypeDecl*> lex_type_decl(LexBuffer& lex_buffer, Keyword keyword)
+{
+    auto type_decl = new_type_decl();
+    type_decl->type = keyword == Keyword::Enum ? TypeDecl::Enum : keyword == Keyword::Struct ? TypeDecl::Struct : TypeDecl::Union;
+
+    auto lex_token = lex_string(lex_buffer, false);
+    if (lex_token.type == LexToken::TypeName)
+    {
+        print_error(lex_buffer, lex_token, "type is already declared", 0);
+        return {};
+    }
+    if (lex_token.type != LexToken::Name)
+    {
+        print_expectation_error(lex_buffer, lex_token, {"name"});
+        return {};
+    }
+    type_decl->name = lex_token.name;
+    // Registered before the body so fields can point back at the type
+    type_decls[std::string_view(lex_token.name, lex_token.string_size)] = type_decl;
+
+    if (!lex_layout_attributes(lex_buffer, type_decl))
+        return {};
+
+    while (true)
+    {
+        lex_token = lex_string(lex_buffer, false);
+        if (lex_token.type == LexToken::EndCurly)
+        {
+            break;
+        }
+        else if (lex_token.type == LexToken::SLComment)
+        {
+            skip_line(lex_buffer);
+        }
+        else if (type_decl->type == TypeDecl::Enum && lex_token.type == LexToken::Name)
+        {
+            EnumValue value = {.name = lex_token.name};
+            if (!at_line_end(lex_buffer) && lex_string(lex_buffer, true).type == LexToken::Assign)
+            {
+                lex_string(lex_buffer, false);
+                auto error = lex_expr(lex_buffer, false);
+                if (error.error)
+                    return {};
+                value.value = error.content;
+            }
+            type_decl->values.push_back(value);
+
+            if (!at_line_end(lex_buffer) && lex_string(lex_buffer, true).type == LexToken::Comma)
+                lex_string(lex_buffer, false);
+        }
+        else if (type_decl->type != TypeDecl::Enum && possibly_var(lex_token.type))
+        {
+            auto error = lex_var(lex_buffer, lex_token);
+            if (error.error)
+                return {};
+            auto field = error.content;
+
+            lex_token = lex_string(lex_buffer, false);
+            if (lex_token.type != LexToken::Name)
+            {
+                print_expectation_error(lex_buffer, lex_token, {"name"});
+                return {};
+            }
+            field.name = lex_token.name;
+            if (field.var_type == VarType::Any && !field.user_type)
+            {
+                print_error(lex_buffer, lex_token, "field needs a type", 0);
+                return {};
+            }
+            if (!field.modifier.size() && field.user_type == type_decl)
+            {
+                print_error(lex_buffer, lex_token, "type can't contain itself", 0);
+                return {};
+            }
+            if (is_arena(field))
+            {
+                print_error(lex_buffer, lex_token, "an arena frees its memory at the end of a scope, it can't be a field", 0);
+                return {};
+            }
+            type_decl->fields.push_back(field);
+
+            if (!expect_statement_end(lex_buffer))
+                return {};
+        }
+        else
+        {
+            if (type_decl->type == TypeDecl::Enum)
+                print_expectation_error(lex_buffer, lex_token, {"name", "}"});
+            else
+                print_expectation_error(lex_buffer, lex_token, {"field", "}"});
+            return {};
+        }
+    }
+
+    if (type_decl->soa && type_decl->fields.empty())
+    {
+        print_error(lex_buffer, lex_token, "soa struct needs at least one field", 0);
+        return {};
+    }
+
+    return type_decl;
+}
+
+// Type parameters only live as long as the function they were declared for
+void forget_type_params(std::vector<TypeDecl*>& type_params)
+{
+    for (auto type_param: type_params)
+    {
+        type_decls.erase(std::string_view(type_param->name, buffer_string_ptr(type_param->name).size));
+    }
+}
+
+// generic T, U(i32, real32) declares type parameters for the function that follows
+ErrorOr<std::vector<TypeDecl*>> lex_generic(LexBuffer& lex_buffer)
+{
+    std::vector<TypeDecl*> type_params;
+    while (true)
+    {
+        auto lex_token = lex_string(lex_buffer, false);
+        if (lex_token.type != LexToken::Name)
+        {
+            if (lex_token.type == LexToken::TypeName)
+                print_error(lex_buffer, lex_token, "type is already declared", 0);
+            else
+                print_expectation_error(lex_buffer, lex_token, {"name"});
+            forget_type_params(type_params);
+            return {};
+        }
+
+        auto type_param = new_type_decl();
+        type_param->type = TypeDecl::Generic;
+        type_param->name = lex_token.name;
+
+        if (!at_line_end(lex_buffer) && lex_string(lex_buffer, true).type == LexToken::StartParen)
+        {
+            lex_string(lex_buffer, false);
+            while (true)
+            {
+                lex_token = lex_string(lex_buffer, false);
+                if (lex_token.type != LexToken::VarType)
+                {
+                    print_expectation_error(lex_buffer, lex_token, {"variable type"});
+                    forget_type_params(type_params);
+                    return {};
+                }
+                type_param->constraints.push_back(lex_token.var_type);
+
+                lex_token = lex_string(lex_buffer, false);
+                if (lex_token.type == LexToken::EndParen)
+                {
+                    break;
+                }
+                else if (lex_token.type != LexToken::Comma)
+                {
+                    print_expectation_error(lex_buffer, lex_token, {")", ","});
+                    forget_type_params(type_params);
+                    return {};
+                }
+            }
+        }
+
+        type_decls[std::string_view(type_param->name, buffer_string_ptr(type_param->name).size)] = type_param;
+        type_params.push_back(type_param);
+
+        if (at_line_end(lex_buffer))
+            break;
+
+        lex_token = lex_string(lex_buffer, false);
+        if (lex_token.type != LexToken::Comma)
+        {
+            print_expectation_error(lex_buffer, lex_token, {","});
+            forget_type_params(type_params);
+            return {};
+        }
+    }
+
+    return type_params;
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdio.h>
+#include <intrin.h>
+#include "windows_framework.h"
+#include "utils.h"
+
+// Where the compiler's time goes per input file, split into reading (with the CRLF normalization), lexing,
+// parsing and emitting. Phases nest, the lexing a parse asks for counts as lexing only. Time is counted in
+// TSC cycles, which include waiting on the disk; the CPU cycles the thread itself ran are kept per file next
+// to them. Windows keeps the counters behind instructions, branch misses and cache misses from user mode
+// programs, so those aren't collected
+struct PhaseStats
+{
+    enum Phase { None, Read, Lex, Parse, Emit, PhaseCount };
+};
+
+const char* phase_names[] = { "", "read", "lex", "parse", "emit" };
+
+struct FileStats
+{
+    std::wstring path;
+    u64 size;
+    u64 cycles[PhaseStats::PhaseCount];
+    u64 thread_cycles;
+};
+
+// Set by --phase-stats, nothing is counted otherwise
+bool phase_stats_enabled;
+
+std::mutex file_stats_mutex;
+// Pointers stay valid as the table grows, reader threads hold on to theirs
+std::vector<FileStats*> file_stats_table;
+std::unordered_map<std::wstring, FileStats*> file_stats_by_path;
+
+FileStats* file_stats(const wchar_t* file_path)
+{
+    std::lock_guard lock(file_stats_mutex);
+    auto& stats = file_stats_by_path[file_path];
+    if (!stats)
+    {
+        stats = new FileStats{.path = file_path};
+        file_stats_table.push_back(stats);
+    }
+    return stats;
+}
+
+u64 thread_cycles()
+{
+    ULONG64 cycles = 0;
+    QueryThreadCycleTime(GetCurrentThread(), &cycles);
+    return cycles;
+}
+
+// The phase and file the current thread spends its cycles on
+struct PhaseState
+{
+    PhaseStats::Phase phase;
+    FileStats* file;
+    u64 start;
+};
+
+thread_local PhaseState phase_state;
+
+// Charges the cycles since the last switch to the phase being left, a phase given no file stays on the current one.
+// A scope given a file also charges it the CPU cycles the thread runs until the scope ends
+struct PhaseScope
+{
+    PhaseState previous;
+    FileStats* file;
+    u64 thread_start;
+
+    PhaseScope(PhaseStats::Phase phase, FileStats* file = 0) : file(file)
+    {
+        if (!phase_stats_enabled)
+            return;
+        if (file)
+            thread_start = thread_cycles();
+        auto now = __rdtsc();
+        previous = phase_state;
+        if (phase_state.file)
+            phase_state.file->cycles[phase_state.phase] += now - phase_state.start;
+        phase_state = {.phase = phase, .file = file ? file : phase_state.file, .start = now};
+    }
+
+    ~PhaseScope()
+    {
+        if (!phase_stats_enabled)
+            return;
+        auto now = __rdtsc();
+        if (phase_state.file)
+            phase_state.file->cycles[phase_state.phase] += now - phase_state.start;
+        if (file)
+            file->thread_cycles += thread_cycles() - thread_start;
+        phase_state = {.phase = previous.phase, .file = previous.file, .start = now};
+    }
+};
+
+void print_phase_stats()
+{
+    std::lock_guard lock(file_stats_mutex);
+    FileStats total = {};
+    fprintf(stderr, "%10s", "bytes");
+    for (auto phase = 1; phase < PhaseStats::PhaseCount; phase++)
+    {
+        fprintf(stderr, " %12s", phase_names[phase]);
+    }
+    fprintf(stderr, " %9s %12s  file (TSC cycles)\n", "lex/byte", "cpu cycles");
+
+    auto print_row = [](FileStats& stats, const wchar_t* name)
+    {
+        fprintf(stderr, "%10llu", stats.size);
+        for (auto phase = 1; phase < PhaseStats::PhaseCount; phase++)
+        {
+            fprintf(stderr, " %12llu", stats.cycles[phase]);
+        }
+        fprintf(stderr, " %9.1f %12llu  %ls\n", stats.size ? (double)stats.cycles[PhaseStats::Lex] / stats.size : 0.0, stats.thread_cycles, name);
+    };
+    for (auto stats: file_stats_table)
+    {
+        print_row(*stats, stats->path.c_str());
+        total.size += stats->size;
+        total.thread_cycles += stats->thread_cycles;
+        for (auto phase = 0; phase < PhaseStats::PhaseCount; phase++)
+        {
+            total.cycles[phase] += stats->cycles[phase];
+        }
+    }
+    print_row(total, L"total");
+    fprintf(stderr, "instructions, branch misses and cache misses: not available to user mode programs on Windows\n");
+}
@@ -0,0 +1,161 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "driver.cpp"
+
+// Reader threads fetch the next inputs while the main thread compiles and a writer thread prints
+// finished output, so compiling doesn't wait on the disk. Compilation stays on the main thread in
+// input order, it's the only stage touching the scope and type tables. Under --max-memory readers
+// stop fetching ahead while the budget is used up
+struct Pipeline
+{
+    std::vector<std::wstring>& inputs;
+    // At most this many files are read but not compiled, and compiled but not written
+    u64 max_in_flight;
+
+    std::mutex mutex;
+    std::vector<Buffer> buffers;
+    std::vector<bool> read;
+    u64 next_read;
+    u64 next_compile;
+    std::condition_variable read_done;
+    std::condition_variable slot_free;
+
+    std::deque<std::string> outputs;
+    bool outputs_done;
+    std::condition_variable output_ready;
+    std::condition_variable output_taken;
+};
+
+void read_inputs(Pipeline& pipeline)
+{
+    while (true)
+    {
+        u64 index;
+        {
+            std::unique_lock lock(pipeline.mutex);
+            // The file compiled next is always read, or nothing would ever free memory
+            pipeline.slot_free.wait(lock, [&] { return pipeline.next_read == pipeline.inputs.size() || pipeline.next_read == pipeline.next_compile || pipeline.next_read < pipeline.next_compile + pipeline.max_in_flight && !over_memory_budget(); });
+            if (pipeline.next_read == pipeline.inputs.size())
+                return;
+            index = pipeline.next_read++;
+        }
+
+        auto buffer = read_file_to_unix_buffer(pipeline.inputs[index].c_str());
+        {
+            std::lock_guard lock(pipeline.mutex);
+            pipeline.buffers[index] = buffer;
+            pipeline.read[index] = true;
+        }
+        pipeline.read_done.notify_all();
+    }
+}
+
+void write_outputs(Pipeline& pipeline)
+{
+    while (true)
+    {
+        std::string output;
+        {
+            std::unique_lock lock(pipeline.mutex);
+            pipeline.output_ready.wait(lock, [&] { return !pipeline.outputs.empty() || pipeline.outputs_done; });
+            if (pipeline.outputs.empty())
+                return;
+            output = std::move(pipeline.outputs.front());
+            pipeline.outputs.pop_front();
+        }
+        pipeline.output_taken.notify_one();
+        fwrite(output.data(), 1, output.size(), stdout);
+        track_memory(MemoryStats::Output, -(i64)output.size());
+        pipeline.slot_free.notify_all();
+    }
+}
+
+// Compiles the inputs in order and prints their C++, stopping at the first file that can't be read
+bool compile_inputs(std::vector<std::wstring>& inputs)
+{
+    Pipeline pipeline = {.inputs = inputs, .max_in_flight = 8};
+    pipeline.buffers.resize(inputs.size());
+    pipeline.read.resize(inputs.size());
+    auto preamble = output_preamble();
+    if (!preamble.empty())
+    {
+        track_memory(MemoryStats::Output, preamble.size());
+        pipeline.outputs.push_back(preamble);
+    }
+
+    std::vector<std::thread> readers;
+    auto reader_count = std::clamp(std::thread::hardware_concurrency(), 1u, 4u);
+    for (auto i = 0; i < reader_count; i++)
+    {
+        readers.emplace_back(read_inputs, std::ref(pipeline));
+    }
+    std::thread writer(write_outputs, std::ref(pipeline));
+
+    // Sources whose names stay visible to later files through the scope or type tables
+    std::vector<Buffer> retained_buffers;
+    auto failed = false;
+    for (u64 i = 0; i < inputs.size(); i++)
+    {
+        Buffer file_buffer;
+        {
+            std::unique_lock lock(pipeline.mutex);
+            pipeline.read_done.wait(lock, [&] { return pipeline.read[i]; });
+            file_buffer = pipeline.buffers[i];
+        }
+        if (!file_buffer.content)
+        {
+            failed = true;
+            break;
+        }
+
+        auto scope_size = scope_vars.size();
+        auto type_count = type_decls.size();
+        std::string output;
+        if (!compile_file(file_buffer, inputs[i].c_str(), output))
+            failed = true;
+        release_nodes();
+        if (scope_vars.size() == scope_size && type_decls.size() == type_count)
+            free_file_buffer(file_buffer);
+        else
+            retained_buffers.push_back(file_buffer);
+        track_memory(MemoryStats::Output, output.size());
+
+        {
+            std::unique_lock lock(pipeline.mutex);
+            pipeline.output_taken.wait(lock, [&] { return pipeline.outputs.size() < pipeline.max_in_flight; });
+            pipeline.outputs.push_back(std::move(output));
+            pipeline.next_compile = i + 1;
+        }
+        pipeline.output_ready.notify_one();
+        pipeline.slot_free.notify_all();
+    }
+
+    {
+        std::lock_guard lock(pipeline.mutex);
+        // Readers still waiting for a slot have nothing left to do
+        pipeline.next_read = inputs.size();
+        pipeline.outputs_done = true;
+    }
+    pipeline.slot_free.notify_all();
+    pipeline.output_ready.notify_one();
+    for (auto& reader: readers)
+    {
+        reader.join();
+    }
+    writer.join();
+    // Inputs read ahead of a file that failed were never compiled
+    for (auto i = pipeline.next_compile; i < inputs.size(); i++)
+    {
+        free_file_buffer(pipeline.buffers[i]);
+    }
+    for (auto& buffer: retained_buffers)
+    {
+        free_file_buffer(buffer);
+    }
+
+    return !failed;
+}
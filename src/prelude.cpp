@@ -0,0 +1,77 @@
+#pragma once
+#include <string>
+
+#include "driver.cpp"
+#include "inputs.cpp"
+
+bool run_command(std::wstring command)
+{
+    STARTUPINFOW startup_info = {};
+    startup_info.cb = sizeof(startup_info);
+    PROCESS_INFORMATION process_info;
+    if (!CreateProcessW(0, command.data(), 0, 0, FALSE, 0, 0, 0, &startup_info, &process_info))
+    {
+        DebugLog(L"Failed to run \"%ls\"!\n", command.c_str());
+        return false;
+    }
+
+    WaitForSingleObject(process_info.hProcess, INFINITE);
+    DWORD exit_code;
+    GetExitCodeProcess(process_info.hProcess, &exit_code);
+    CloseHandle(process_info.hThread);
+    CloseHandle(process_info.hProcess);
+    return exit_code == 0;
+}
+
+bool file_exists(const wchar_t* file_path)
+{
+    return GetFileAttributesW(file_path) != INVALID_FILE_ATTRIBUTES;
+}
+
+// Writes the prelude header and, given a compiler command, precompiles it to <header>.gch for gcc or
+// <header>.pch otherwise. <header>.hash records what the outputs were built from so a later run with the
+// same VarType table and command leaves them, and their timestamps, alone
+bool write_prelude(const wchar_t* header_path, const wchar_t* pch_command)
+{
+    auto prelude = emit_prelude();
+    auto key = prelude + (pch_command ? wide_to_utf8(pch_command) : "");
+    auto hash = std::format("{:016x}", hash_buffer({.content = key.data(), .size = key.size()}));
+
+    std::wstring header = header_path;
+    auto separator = header.find_last_of(L"\\/");
+    prelude_include = std::format("#include \"{}\"\n", wide_to_utf8(header.c_str() + (separator == std::wstring::npos ? 0 : separator + 1)));
+
+    std::wstring pch_path;
+    if (pch_command)
+    {
+        std::wstring command = pch_command;
+        auto gcc = command.find(L"clang") == std::wstring::npos && (command.find(L"g++") != std::wstring::npos || command.find(L"gcc") != std::wstring::npos);
+        pch_path = header + (gcc ? L".gch" : L".pch");
+    }
+
+    auto hash_path = header + L".hash";
+    if (file_exists(hash_path.c_str()) && file_exists(header_path) && (pch_path.empty() || file_exists(pch_path.c_str())))
+    {
+        auto cached = read_file_to_unix_buffer(hash_path.c_str());
+        auto up_to_date = cached.content && std::string(cached.content, cached.size) == hash;
+        if (cached.content)
+            free_file_buffer(cached);
+        if (up_to_date)
+            return true;
+    }
+
+    if (!write_file_atomically(header_path, {.content = prelude.data(), .size = prelude.size()}))
+        return false;
+
+    if (pch_command)
+    {
+        auto command = std::wstring(pch_command) + L" -x c++-header \"" + header + L"\" -o \"" + pch_path + L"\"";
+        if (!run_command(command))
+        {
+            fprintf(stderr, "Failed to precompile %ls\n", header_path);
+            return false;
+        }
+    }
+
+    return write_file_atomically(hash_path.c_str(), {.content = hash.data(), .size = hash.size()});
+}
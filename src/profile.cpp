@@ -0,0 +1,108 @@
+#pragma once
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdio.h>
+
+#include "file_utils.cpp"
+#include "utils.h"
+
+// Counts of one site of a profile written by an --instrument build
+struct ProfileCounts
+{
+    u64 self_cycles;
+    u64 cycles;
+    u64 calls;
+    u64 iterations;
+};
+
+// What --profile-use read. Functions are found by name, loops by the file and line of their while,
+// spelled as the input was given to the instrumented build
+struct Profile
+{
+    std::unordered_map<std::string, ProfileCounts> functions;
+    std::unordered_map<std::string, ProfileCounts> loops;
+    // Functions with at least this many self cycles make up most of the profiled time
+    u64 hot_self_cycles;
+    bool loaded;
+};
+
+Profile profile;
+
+// Share of all self cycles the hot functions account for
+constexpr u64 profile_hot_percent = 90;
+
+std::string profile_loop_key(const std::string& file, int line)
+{
+    return std::format("{}:{}", file, line);
+}
+
+// Every line past the header is: self cycles, cycles, calls, iterations, site name, then file:line to the end of the line
+bool load_profile(const wchar_t* file_path)
+{
+    auto file_buffer = read_file_to_unix_buffer(file_path);
+    if (!file_buffer.content)
+        return false;
+
+    std::string text(file_buffer.content, file_buffer.size);
+    free_file_buffer(file_buffer);
+
+    std::vector<u64> function_cycles;
+    u64 total_cycles = 0;
+    u64 line_start = 0;
+    for (auto line_num = 1; line_start < text.size(); line_num++)
+    {
+        auto line_end = text.find('\n', line_start);
+        if (line_end == std::string::npos)
+            line_end = text.size();
+        auto line = text.substr(line_start, line_end - line_start);
+        line_start = line_end + 1;
+
+        unsigned long long self_cycles, cycles, calls, iterations;
+        char name[256];
+        int site_start;
+        if (sscanf(line.c_str(), "%llu %llu %llu %llu %255s %n", &self_cycles, &cycles, &calls, &iterations, name, &site_start) != 5)
+        {
+            if (line_num == 1 || line.find_first_not_of(' ') == std::string::npos)
+                continue;
+            fprintf(stderr, "%ls:%d: expected the counts, name and file:line of a site\n", file_path, line_num);
+            return false;
+        }
+
+        auto site = line.substr(site_start);
+        auto separator = site.rfind(':');
+        if (separator == std::string::npos)
+        {
+            fprintf(stderr, "%ls:%d: expected file:line after the site name\n", file_path, line_num);
+            return false;
+        }
+
+        ProfileCounts counts = {.self_cycles = self_cycles, .cycles = cycles, .calls = calls, .iterations = iterations};
+        if (strcmp(name, "while") == 0)
+        {
+            profile.loops[profile_loop_key(site.substr(0, separator), atoi(site.c_str() + separator + 1))] = counts;
+        }
+        else
+        {
+            profile.functions[name] = counts;
+            function_cycles.push_back(self_cycles);
+            total_cycles += self_cycles;
+        }
+    }
+
+    // The biggest functions until they cover the hot share
+    std::sort(function_cycles.begin(), function_cycles.end(), std::greater<u64>());
+    profile.hot_self_cycles = ~0ull;
+    u64 covered = 0;
+    for (auto cycles: function_cycles)
+    {
+        if (!cycles || covered * 100 >= total_cycles * profile_hot_percent)
+            break;
+        covered += cycles;
+        profile.hot_self_cycles = cycles;
+    }
+
+    profile.loaded = true;
+    return true;
+}
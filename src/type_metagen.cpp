@@ -1,6 +1,141 @@
+#pragma once
 enum VarType { Any, I8, I16, I32, I64, U8, U16, U32, U64, Real32, Real64, Bool };
-const char* var_types[] = { 0, "i8", "i16", "i32", "i64", "u8", "u16", "u32", "u64", "real32", "real64", "bool"};
+const char* var_types[] = { 0, "i8", "i16", "i32", "i64", "u8", "u16", "u32", "u64", "real32", "real64", "bool" };
+constexpr u64 var_type_sizes[] = { 0, 1, 2, 4, 8, 1, 2, 4, 8, 4, 8, 1 };
+constexpr u64 var_type_aligns[] = { 0, 1, 2, 4, 8, 1, 2, 4, 8, 4, 8, 1 };
+constexpr bool var_type_signed[] = { false, true, true, true, true, false, false, false, false, true, true, false };
 
-enum Keyword { Enum, Struct, Union, While };
-const char* keywords[] = { "enum", "struct", "union", "while" };
+enum Keyword { Enum, Struct, Union, While, For, Return, Const, Generic, Parallel, Async, Await, Generator, Yield, New };
+const char* keywords[] = { "enum", "struct", "union", "while", "for", "return", "const", "generic", "parallel", "async", "await", "generator", "yield", "new" };
 
+constexpr bool metagen_equal(const char* name, const char* candidate, u64 size)
+{
+    for (u64 i = 0; i < size; i++)
+    {
+        if (name[i] != candidate[i]) return false;
+    }
+    return true;
+}
+
+constexpr VarType find_var_type(const char* name, u64 size)
+{
+    switch (size)
+    {
+        case 2:
+            switch (name[0])
+            {
+                case 'i':
+                    return metagen_equal(name, "i8", 2) ? VarType::I8 : VarType::Any;
+                case 'u':
+                    return metagen_equal(name, "u8", 2) ? VarType::U8 : VarType::Any;
+                default:
+                    return VarType::Any;
+            }
+        case 3:
+            switch (name[1])
+            {
+                case '1':
+                    switch (name[0])
+                    {
+                        case 'i':
+                            return metagen_equal(name, "i16", 3) ? VarType::I16 : VarType::Any;
+                        case 'u':
+                            return metagen_equal(name, "u16", 3) ? VarType::U16 : VarType::Any;
+                        default:
+                            return VarType::Any;
+                    }
+                case '3':
+                    switch (name[0])
+                    {
+                        case 'i':
+                            return metagen_equal(name, "i32", 3) ? VarType::I32 : VarType::Any;
+                        case 'u':
+                            return metagen_equal(name, "u32", 3) ? VarType::U32 : VarType::Any;
+                        default:
+                            return VarType::Any;
+                    }
+                case '6':
+                    switch (name[0])
+                    {
+                        case 'i':
+                            return metagen_equal(name, "i64", 3) ? VarType::I64 : VarType::Any;
+                        case 'u':
+                            return metagen_equal(name, "u64", 3) ? VarType::U64 : VarType::Any;
+                        default:
+                            return VarType::Any;
+                    }
+                default:
+                    return VarType::Any;
+            }
+        case 4:
+            return metagen_equal(name, "bool", 4) ? VarType::Bool : VarType::Any;
+        case 6:
+            switch (name[4])
+            {
+                case '3':
+                    return metagen_equal(name, "real32", 6) ? VarType::Real32 : VarType::Any;
+                case '6':
+                    return metagen_equal(name, "real64", 6) ? VarType::Real64 : VarType::Any;
+                default:
+                    return VarType::Any;
+            }
+        default:
+            return VarType::Any;
+    }
+}
+
+// -1 when the name isn't a keyword
+constexpr int find_keyword(const char* name, u64 size)
+{
+    switch (size)
+    {
+        case 3:
+            switch (name[0])
+            {
+                case 'f':
+                    return metagen_equal(name, "for", 3) ? Keyword::For : -1;
+                case 'n':
+                    return metagen_equal(name, "new", 3) ? Keyword::New : -1;
+                default:
+                    return -1;
+            }
+        case 4:
+            return metagen_equal(name, "enum", 4) ? Keyword::Enum : -1;
+        case 5:
+            switch (name[1])
+            {
+                case 'n':
+                    return metagen_equal(name, "union", 5) ? Keyword::Union : -1;
+                case 'h':
+                    return metagen_equal(name, "while", 5) ? Keyword::While : -1;
+                case 'o':
+                    return metagen_equal(name, "const", 5) ? Keyword::Const : -1;
+                case 's':
+                    return metagen_equal(name, "async", 5) ? Keyword::Async : -1;
+                case 'w':
+                    return metagen_equal(name, "await", 5) ? Keyword::Await : -1;
+                case 'i':
+                    return metagen_equal(name, "yield", 5) ? Keyword::Yield : -1;
+                default:
+                    return -1;
+            }
+        case 6:
+            switch (name[0])
+            {
+                case 's':
+                    return metagen_equal(name, "struct", 6) ? Keyword::Struct : -1;
+                case 'r':
+                    return metagen_equal(name, "return", 6) ? Keyword::Return : -1;
+                default:
+                    return -1;
+            }
+        case 7:
+            return metagen_equal(name, "generic", 7) ? Keyword::Generic : -1;
+        case 8:
+            return metagen_equal(name, "parallel", 8) ? Keyword::Parallel : -1;
+        case 9:
+            return metagen_equal(name, "generator", 9) ? Keyword::Generator : -1;
+        default:
+            return -1;
+    }
+}
@@ -1,60 +1,285 @@
-#include <stdio.h>
-
-#include "../../file_utils.cpp"
-#include "../../utils.h"
-
-int wmain(int argc, const wchar_t** argv)
-{
-    if (argc < 5)
-    {
-        auto bold = "\x1b[1m";
-        auto clear = "\x1b[0m";
-        printf("Usage: %stype_metagen%s -o file -t types...", bold, clear);
-        return 0;
-    }
-
-    Buffer buffer;
-	buffer.size = KB(10);
-	buffer.content = (char *)VirtualAlloc(0, buffer.size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
-
-    auto buffer_ptr = buffer.content;
-
-    strcpy_s(buffer_ptr, buffer.size, "enum VarType { ");
-    for (auto i = 4; i < argc; i++)
-    {
-        *(buffer_ptr + strlen(buffer_ptr)) = argv[i][0] - 32;
-        auto size_needed = WideCharToMultiByte(CP_UTF8, 0, &argv[i][1], wcslen(&argv[i][1]), 0, 0, 0, 0);
-	    auto utf8 = (char *)VirtualAlloc(0, size_needed, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
-        WideCharToMultiByte(CP_UTF8, 0, &argv[i][1], wcslen(&argv[i][1]), utf8, size_needed, 0, 0);
-        strcpy_s(buffer_ptr + strlen(buffer_ptr), buffer.size, utf8);
-        VirtualFree(utf8, size_needed, MEM_RELEASE);
-
-        if (i < argc - 1)
-        {
-            strcpy_s(buffer_ptr + strlen(buffer_ptr), buffer.size, ", ");
-        }
-    }
-    strcpy_s(buffer_ptr + strlen(buffer_ptr), buffer.size, " };\n");
-
-    strcpy_s(buffer_ptr + strlen(buffer_ptr), buffer.size, "const char* var_types[] = { ");
-    for (auto i = 4; i < argc; i++)
-    {
-        buffer_ptr += strcpy_s(buffer_ptr + strlen(buffer_ptr), buffer.size, "\"");
-        auto size_needed = WideCharToMultiByte(CP_UTF8, 0, argv[i], wcslen(argv[i]), 0, 0, 0, 0);
-	    auto utf8 = (char *)VirtualAlloc(0, size_needed, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
-        WideCharToMultiByte(CP_UTF8, 0, argv[i], wcslen(argv[i]), utf8, size_needed, 0, 0);
-        strcpy_s(buffer_ptr + strlen(buffer_ptr), buffer.size, utf8);
-        VirtualFree(utf8, size_needed, MEM_RELEASE);
-        strcpy_s(buffer_ptr + strlen(buffer_ptr), buffer.size, "\"");
-
-        if (i < argc - 1)
-        {
-            strcpy_s(buffer_ptr + strlen(buffer_ptr), buffer.size, ", ");
-        }
-    }
-    strcpy_s(buffer_ptr + strlen(buffer_ptr), buffer.size, " };\n");
-
-    auto out_file = create_wo_file(argv[2]);
-    buffer.size = strlen(buffer_ptr);
-    return write_file(out_file, argv[2], buffer);
-}
\ No newline at end of file
+#include <stdio.h>
+
+#include <format>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../../file_utils.cpp"
+#include "../../utils.h"
+
+// Output grows by doubling so appending stays linear in the size of the generated file
+struct OutputBuffer
+{
+    Buffer buffer;
+    u64 capacity;
+};
+
+void append(OutputBuffer& output, std::string_view string)
+{
+    if (output.buffer.size + string.size() > output.capacity)
+    {
+        auto capacity = output.capacity ? output.capacity : KB(4);
+        while (output.buffer.size + string.size() > capacity) capacity *= 2;
+
+        auto content = (char *)VirtualAlloc(0, capacity, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        if (output.buffer.content)
+        {
+            memcpy(content, output.buffer.content, output.buffer.size);
+            VirtualFree(output.buffer.content, 0, MEM_RELEASE);
+        }
+        output.buffer.content = content;
+        output.capacity = capacity;
+    }
+
+    memcpy(output.buffer.content + output.buffer.size, string.data(), string.size());
+    output.buffer.size += string.size();
+}
+
+std::string to_utf8(const wchar_t* string)
+{
+    auto size = wcslen(string);
+    std::string result(WideCharToMultiByte(CP_UTF8, 0, string, size, 0, 0, 0, 0), 0);
+    WideCharToMultiByte(CP_UTF8, 0, string, size, result.data(), result.size(), 0, 0);
+    return result;
+}
+
+// Names in a list file are separated by blanks or line breaks
+bool read_names(const wchar_t* file_path, std::vector<std::string>& names)
+{
+    auto file_buffer = read_file_to_unix_buffer(file_path);
+    if (!file_buffer.content)
+        return false;
+
+    u64 start = 0;
+    for (u64 i = 0; i <= file_buffer.size; i++)
+    {
+        if (i == file_buffer.size || file_buffer.content[i] == ' ' || file_buffer.content[i] == '\t' || file_buffer.content[i] == '\n')
+        {
+            if (i > start) names.emplace_back(file_buffer.content + start, i - start);
+            start = i + 1;
+        }
+    }
+
+    free_file_buffer(file_buffer);
+    return true;
+}
+
+// A name listed twice can't be told apart from itself by any character, the lookup would never bottom out
+bool unique_names(const std::vector<std::string>& names, const char* list)
+{
+    std::set<std::string> seen;
+    for (auto& name: names)
+    {
+        if (!seen.insert(name).second)
+        {
+            DebugLog(L"%hs \"%hs\" is listed more than once!\n", list, name.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string enum_name(const std::string& name)
+{
+    auto result = name;
+    result[0] -= 32;
+    return result;
+}
+
+// Bit width is spelled in the type name (i32, real64), types without one (bool) take a byte
+u64 type_size(const std::string& name)
+{
+    auto digits = name.find_first_of("0123456789");
+    if (digits == std::string::npos) return 1;
+    return atoi(name.c_str() + digits) / 8;
+}
+
+bool type_signed(const std::string& name)
+{
+    return name[0] == 'i' || name.starts_with("real");
+}
+
+// Character position splitting the names of a bucket into the most groups
+int splitting_position(const std::vector<int>& bucket, const std::vector<std::string>& names)
+{
+    auto result = 0;
+    auto most_groups = 0;
+    for (auto position = 0; position < names[bucket[0]].size(); position++)
+    {
+        std::string seen;
+        for (auto i: bucket)
+        {
+            if (seen.find(names[i][position]) == std::string::npos) seen += names[i][position];
+        }
+        if (seen.size() > most_groups)
+        {
+            most_groups = seen.size();
+            result = position;
+        }
+    }
+    return result;
+}
+
+// Nested switches over characters until a single candidate is left to compare against
+void append_bucket(OutputBuffer& buffer, const std::vector<int>& bucket, const std::vector<std::string>& names, const std::vector<std::string>& values, const char* not_found, int indent)
+{
+    std::string indentation(indent * 4, ' ');
+    auto size = names[bucket[0]].size();
+    if (bucket.size() == 1)
+    {
+        append(buffer, std::format("{}return metagen_equal(name, \"{}\", {}) ? {} : {};\n", indentation, names[bucket[0]], size, values[bucket[0]], not_found));
+        return;
+    }
+
+    auto position = splitting_position(bucket, names);
+    append(buffer, std::format("{}switch (name[{}])\n{}{{\n", indentation, position, indentation));
+    std::string seen;
+    for (auto i: bucket)
+    {
+        auto c = names[i][position];
+        if (seen.find(c) != std::string::npos) continue;
+        seen += c;
+
+        std::vector<int> group;
+        for (auto j: bucket)
+        {
+            if (names[j][position] == c) group.push_back(j);
+        }
+        append(buffer, std::format("{}    case '{}':\n", indentation, c));
+        append_bucket(buffer, group, names, values, not_found, indent + 2);
+    }
+    append(buffer, std::format("{}    default:\n{}        return {};\n{}}}\n", indentation, indentation, not_found, indentation));
+}
+
+// Switch over the name length and then over the characters that tell the names of that length apart,
+// so a lookup costs one comparison against a single candidate
+void append_lookup(OutputBuffer& buffer, const char* signature, const char* not_found, const std::vector<std::string>& names, const std::vector<std::string>& values)
+{
+    std::map<u64, std::vector<int>> buckets;
+    for (auto i = 0; i < names.size(); i++)
+    {
+        buckets[names[i].size()].push_back(i);
+    }
+
+    append(buffer, std::format("constexpr {}\n{{\n    switch (size)\n    {{\n", signature));
+    for (auto& [size, bucket]: buckets)
+    {
+        append(buffer, std::format("        case {}:\n", size));
+        append_bucket(buffer, bucket, names, values, not_found, 3);
+    }
+    append(buffer, std::format("        default:\n            return {};\n    }}\n}}\n", not_found));
+}
+
+int wmain(int argc, const wchar_t** argv)
+{
+    if (argc < 5)
+    {
+        auto bold = "\x1b[1m";
+        auto clear = "\x1b[0m";
+        printf("Usage: %stype_metagen%s -o file -t types... [-k keywords...] (@file reads a list from file)", bold, clear);
+        return 0;
+    }
+
+    std::vector<std::string> types;
+    std::vector<std::string> keywords;
+    auto names = &types;
+    for (auto i = 4; i < argc; i++)
+    {
+        if (wcscmp(argv[i], L"-k") == 0)
+        {
+            names = &keywords;
+            continue;
+        }
+        if (argv[i][0] == '@')
+        {
+            if (!read_names(&argv[i][1], *names))
+                return 1;
+            continue;
+        }
+        names->push_back(to_utf8(argv[i]));
+    }
+    if (!unique_names(types, "Type") || !unique_names(keywords, "Keyword"))
+        return 1;
+
+    OutputBuffer buffer = {};
+
+    append(buffer, "#pragma once\n");
+    append(buffer, "enum VarType { Any");
+    for (auto& type: types)
+    {
+        append(buffer, std::format(", {}", enum_name(type)));
+    }
+    append(buffer, " };\n");
+
+    append(buffer, "const char* var_types[] = { 0");
+    for (auto& type: types)
+    {
+        append(buffer, std::format(", \"{}\"", type));
+    }
+    append(buffer, " };\n");
+
+    append(buffer, "constexpr u64 var_type_sizes[] = { 0");
+    for (auto& type: types)
+    {
+        append(buffer, std::format(", {}", type_size(type)));
+    }
+    append(buffer, " };\n");
+
+    append(buffer, "constexpr u64 var_type_aligns[] = { 0");
+    for (auto& type: types)
+    {
+        append(buffer, std::format(", {}", type_size(type)));
+    }
+    append(buffer, " };\n");
+
+    append(buffer, "constexpr bool var_type_signed[] = { false");
+    for (auto& type: types)
+    {
+        append(buffer, std::format(", {}", type_signed(type) ? "true" : "false"));
+    }
+    append(buffer, " };\n");
+
+    if (!keywords.empty())
+    {
+        append(buffer, "\nenum Keyword { ");
+        for (auto i = 0; i < keywords.size(); i++)
+        {
+            append(buffer, std::format("{}{}", i ? ", " : "", enum_name(keywords[i])));
+        }
+        append(buffer, " };\n");
+
+        append(buffer, "const char* keywords[] = { ");
+        for (auto i = 0; i < keywords.size(); i++)
+        {
+            append(buffer, std::format("{}\"{}\"", i ? ", " : "", keywords[i]));
+        }
+        append(buffer, " };\n");
+    }
+
+    append(buffer, "\nconstexpr bool metagen_equal(const char* name, const char* candidate, u64 size)\n{\n");
+    append(buffer, "    for (u64 i = 0; i < size; i++)\n    {\n        if (name[i] != candidate[i]) return false;\n    }\n    return true;\n}\n\n");
+
+    std::vector<std::string> values;
+    for (auto& type: types)
+    {
+        values.push_back(std::format("VarType::{}", enum_name(type)));
+    }
+    append_lookup(buffer, "VarType find_var_type(const char* name, u64 size)", "VarType::Any", types, values);
+
+    if (!keywords.empty())
+    {
+        values.clear();
+        for (auto& keyword: keywords)
+        {
+            values.push_back(std::format("Keyword::{}", enum_name(keyword)));
+        }
+        append(buffer, "\n// -1 when the name isn't a keyword\n");
+        append_lookup(buffer, "int find_keyword(const char* name, u64 size)", "-1", keywords, values);
+    }
+
+    auto out_file = create_wo_file(argv[2]);
+    return !write_file(out_file, argv[2], buffer.buffer);
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "driver.cpp"
+#include "inputs.cpp"
+
+struct UnityUnit
+{
+    std::string output;
+    u64 size;
+};
+
+u64 input_size(const wchar_t* file_path)
+{
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExW(file_path, GetFileExInfoStandard, &attributes))
+        return 0;
+    return (u64)attributes.nFileSizeHigh << 32 | attributes.nFileSizeLow;
+}
+
+// Spreads the inputs over unit_count translation units <prefix>_<n>.cpp of similar source size.
+// Every unit includes <prefix>_prelude.h, which holds the headers, the VarType typedefs and each
+// type definition once, no matter how many inputs repeat it
+int run_unity(int unit_count, const wchar_t* prefix, std::vector<std::wstring>& inputs)
+{
+    if (unit_count < 1)
+    {
+        DebugLog(L"Expected at least one unity translation unit!\n");
+        return 1;
+    }
+
+    // Largest inputs first, each to the unit with the least source so far
+    std::vector<int> order(inputs.size());
+    std::vector<u64> sizes(inputs.size());
+    for (auto i = 0; i < inputs.size(); i++)
+    {
+        order[i] = i;
+        sizes[i] = input_size(inputs[i].c_str());
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return sizes[a] > sizes[b]; });
+
+    std::vector<UnityUnit> units(unit_count);
+    std::vector<int> unit_of(inputs.size());
+    for (auto i: order)
+    {
+        auto unit = std::min_element(units.begin(), units.end(), [](const UnityUnit& a, const UnityUnit& b) { return a.size < b.size; });
+        unit->size += sizes[i];
+        unit_of[i] = unit - units.begin();
+    }
+
+    std::wstring prefix_path = prefix;
+    auto separator = prefix_path.find_last_of(L"\\/");
+    auto prelude_name = prefix_path.substr(separator == std::wstring::npos ? 0 : separator + 1) + L"_prelude.h";
+    for (auto& unit: units)
+    {
+        unit.output = std::format("#include \"{}\"\n", wide_to_utf8(prelude_name.c_str()));
+    }
+
+    auto prelude = prelude_include.empty() ? emit_prelude() : "#pragma once\n" + prelude_include;
+    // Every unit includes the prelude, which has the bounds, parallel, coroutine and arena runtimes
+    bounds_runtime_emitted = true;
+    parallel_runtime_emitted = true;
+    coroutine_runtime_emitted = true;
+    arena_runtime_emitted = true;
+    std::unordered_map<std::string, std::string> type_definitions;
+    auto failed = false;
+    for (auto i = 0; i < inputs.size(); i++)
+    {
+        auto file = inputs[i].c_str();
+        auto file_buffer = read_file_to_unix_buffer(file);
+        if (!file_buffer.content)
+            return 1;
+
+        // Inputs can't see each other's declarations when compiled one by one, a unit shouldn't change that
+        forget_declarations();
+        std::string output;
+        std::vector<std::pair<std::string, std::string>> file_types;
+        if (!compile_file(file_buffer, file, output, &file_types))
+            failed = true;
+        release_nodes();
+        free_file_buffer(file_buffer);
+
+        for (auto& [name, definition]: file_types)
+        {
+            auto existing = type_definitions.find(name);
+            if (existing == type_definitions.end())
+            {
+                type_definitions[name] = definition;
+                prelude += definition;
+            }
+            else if (existing->second != definition)
+            {
+                fprintf(stderr, "%ls: type %s is defined differently by an earlier input\n", file, name.c_str());
+                failed = true;
+            }
+        }
+
+        auto& unit = units[unit_of[i]];
+        unit.output += std::format("\n// {}\n{}", wide_to_utf8(file), output);
+    }
+
+    if (!write_file_atomically((prefix_path + L"_prelude.h").c_str(), {.content = prelude.data(), .size = prelude.size()}))
+        return 1;
+    for (auto i = 0; i < unit_count; i++)
+    {
+        auto unit_path = prefix_path + L"_" + std::to_wstring(i) + L".cpp";
+        if (!write_file_atomically(unit_path.c_str(), {.content = units[i].output.data(), .size = units[i].output.size()}))
+            return 1;
+    }
+
+    return failed;
+}
@@ -1,15 +1,40 @@
-#pragma once
-#include "windows_framework.h"
-
-#define KB(x) ((x) * 1024ll)
-#define COUNTOF(x) (sizeof(x) / sizeof((x)[0]))
-
-void DebugLog(LPCWSTR format, ...)
-{
-    va_list args;
-    va_start(args, format);
-    WCHAR szBuffer[512]; // get rid of this hard-coded buffer
-    vswprintf_s(szBuffer, format, args);
-    OutputDebugStringW(szBuffer);
-    va_end(args);
-}
+#pragma once
+#include <stdint.h>
+#include "windows_framework.h"
+
+typedef int64_t i64;
+typedef uint64_t u64;
+typedef uint32_t u32;
+typedef uint16_t u16;
+typedef uint8_t u8;
+
+#define KB(x) ((x) * 1024ll)
+#define COUNTOF(x) (sizeof(x) / sizeof((x)[0]))
+
+void DebugLog(LPCWSTR format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    WCHAR szBuffer[512]; // get rid of this hard-coded buffer
+    vswprintf_s(szBuffer, format, args);
+    OutputDebugStringW(szBuffer);
+    va_end(args);
+}
+
+template <typename T>
+struct ErrorOr
+{
+    ErrorOr()
+    {
+        error = true;
+    }
+
+    ErrorOr(T ok)
+    {
+        error = false;
+        content = ok;
+    }
+
+    T content;
+    bool error;
+};
@@ -0,0 +1,131 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "driver.cpp"
+
+struct WatchedFile
+{
+    const wchar_t* path;
+    std::wstring output_path;
+    FILETIME last_write;
+    u64 hash;
+    bool compiled;
+};
+
+// example.cpp compiles to example.gen.cpp next to it
+std::wstring generated_path(const wchar_t* path)
+{
+    std::wstring result = path;
+    auto extension = result.find_last_of(L'.');
+    auto separator = result.find_last_of(L"\\/");
+    if (extension != std::wstring::npos && (separator == std::wstring::npos || extension > separator))
+        result.resize(extension);
+    return result + L".gen.cpp";
+}
+
+std::wstring directory_of(const wchar_t* path)
+{
+    std::wstring result = path;
+    auto separator = result.find_last_of(L"\\/");
+    return separator == std::wstring::npos ? L"." : result.substr(0, separator + 1);
+}
+
+void rebuild_if_changed(WatchedFile& file)
+{
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExW(file.path, GetFileExInfoStandard, &attributes))
+        return;
+    if (file.compiled && CompareFileTime(&attributes.ftLastWriteTime, &file.last_write) == 0)
+        return;
+    file.last_write = attributes.ftLastWriteTime;
+
+    auto file_buffer = read_file_to_unix_buffer(file.path);
+    if (!file_buffer.content)
+        return;
+
+    // Touching a file or saving it unchanged doesn't cost a rebuild
+    auto hash = hash_buffer(file_buffer);
+    if (file.compiled && hash == file.hash)
+    {
+        free_file_buffer(file_buffer);
+        return;
+    }
+    file.hash = hash;
+    file.compiled = true;
+
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+
+    // Every file is compiled on its own so a rebuild doesn't depend on which files came before it
+    forget_declarations();
+    auto output = output_preamble();
+    auto compiled = compile_file(file_buffer, file.path, output) && write_file_atomically(file.output_path.c_str(), {.content = output.data(), .size = output.size()});
+    release_nodes();
+    free_file_buffer(file_buffer);
+
+    QueryPerformanceCounter(&end);
+    auto milliseconds = (end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart;
+    if (compiled)
+        printf("%ls -> %ls (%.2f ms)\n", file.path, file.output_path.c_str(), milliseconds);
+    fflush(stdout);
+}
+
+// Stays resident and rebuilds an input whenever its contents change, waiting on change
+// notifications for the directories holding the inputs
+int run_watch(std::vector<std::wstring>& file_paths)
+{
+    std::vector<WatchedFile> files;
+    std::vector<std::wstring> directories;
+    for (auto& file_path: file_paths)
+    {
+        files.push_back({.path = file_path.c_str(), .output_path = generated_path(file_path.c_str())});
+
+        auto directory = directory_of(file_path.c_str());
+        if (std::find(directories.begin(), directories.end(), directory) == directories.end())
+            directories.push_back(directory);
+    }
+
+    std::vector<HANDLE> notifications;
+    for (auto& directory: directories)
+    {
+        if (notifications.size() == MAXIMUM_WAIT_OBJECTS)
+            break;
+
+        auto notification = FindFirstChangeNotificationW(directory.c_str(), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE);
+        if (notification == INVALID_HANDLE_VALUE)
+        {
+            DebugLog(L"Failed to watch directory \"%ls\"!\n", directory.c_str());
+            continue;
+        }
+        notifications.push_back(notification);
+    }
+
+    // Directories that couldn't be watched are polled instead
+    auto timeout = notifications.size() < directories.size() ? 250 : INFINITE;
+    while (true)
+    {
+        for (auto& file: files)
+        {
+            rebuild_if_changed(file);
+        }
+
+        if (notifications.empty())
+        {
+            Sleep(timeout);
+            continue;
+        }
+
+        auto signaled = WaitForMultipleObjects(notifications.size(), notifications.data(), FALSE, timeout);
+        if (signaled >= WAIT_OBJECT_0 && signaled < WAIT_OBJECT_0 + notifications.size())
+        {
+            FindNextChangeNotification(notifications[signaled - WAIT_OBJECT_0]);
+        }
+        else if (signaled == WAIT_FAILED)
+        {
+            DebugLog(L"Failed to wait for file changes!\n");
+            return 1;
+        }
+    }
+}
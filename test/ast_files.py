@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+
+# Writes an AST file with --ast, checks --from-ast takes it and rejects every damaged copy of it instead of
+# emitting from a tree it can't walk. Usage: ast_files.py <path to cpec>
+
+import struct
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+
+source = """i64 add(i64 a, i64 b)
+{
+    return a + b
+}
+"""
+
+# AstFileHeader is the magic and 6 u32s, an AstNode 4 u8s and 5 u32s, an AstVar 5 u32s and 2 u16s
+header_size = 4 + 6 * 4
+node_size = 4 + 5 * 4
+var_size = 5 * 4 + 2 * 2
+node_format = "<BBBBIIIII"
+
+function_kind, expr_kind = 0, 6
+binary_type = 3
+lhs_flag, rhs_flag = 16, 32
+
+def nodes(data):
+    count = struct.unpack_from("<I", data, 8)[0]
+    return [list(struct.unpack_from(node_format, data, header_size + i * node_size)) for i in range(count)]
+
+def with_node(data, index, node):
+    damaged = bytearray(data)
+    struct.pack_into(node_format, damaged, header_size + index * node_size, *node)
+    return bytes(damaged)
+
+# Copies of the file with one node changed by change, which gets the node's fields and returns them
+def damage(data, kind, type, change):
+    for index, node in enumerate(nodes(data)):
+        if node[0] == kind and (type is None or node[1] == type):
+            changed = change(list(node))
+            return with_node(data, index, changed)
+    raise ValueError("no node to damage")
+
+def field(position, value):
+    def change(node):
+        node[position] = value
+        return node
+    return change
+
+# Copy of the file where the first child of the first node of kind and type is its second one too
+def shared_child(data, kind, type):
+    node_count, var_count = struct.unpack_from("<II", data, 8)
+    children = header_size + node_count * node_size + var_count * var_size
+    for node in nodes(data):
+        if node[0] == kind and node[1] == type:
+            damaged = bytearray(data)
+            first = struct.unpack_from("<I", data, children + node[7] * 4)[0]
+            struct.pack_into("<I", damaged, children + (node[7] + 1) * 4, first)
+            return bytes(damaged)
+    raise ValueError("no node to damage")
+
+def damaged_copies(data):
+    return {
+        "truncated": data[:-1],
+        "expr type out of range": damage(data, expr_kind, binary_type, field(1, 200)),
+        "token out of range": damage(data, expr_kind, binary_type, field(2, 255)),
+        "binary without rhs": damage(data, expr_kind, binary_type, field(3, lhs_flag)),
+        "binary missing a child": damage(data, expr_kind, binary_type, field(8, 1)),
+        "bounds policy out of range": damage(data, function_kind, None, field(2, 9)),
+        "coroutine kind out of range": damage(data, function_kind, None, field(1, 7)),
+        "child with two parents": shared_child(data, expr_kind, binary_type),
+    }
+
+def from_ast(cpec, path):
+    return subprocess.run([cpec, "--from-ast", str(path)], stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True, errors="replace")
+
+def main():
+    if len(sys.argv) != 2:
+        print("Usage: ast_files.py <path to cpec>")
+        return 1
+    cpec = sys.argv[1]
+
+    failed = False
+    with tempfile.TemporaryDirectory() as directory:
+        source_path = Path(directory) / "add.cpe"
+        source_path.write_text(source)
+        ast_path = Path(directory) / "add.ast"
+        subprocess.run([cpec, "--ast", str(ast_path), str(source_path)], check=True)
+
+        result = from_ast(cpec, ast_path)
+        passed = result.returncode == 0
+        failed |= not passed
+        print(f"{'ok  ' if passed else 'FAIL'} valid file is taken")
+
+        data = ast_path.read_bytes()
+        for name, damaged in damaged_copies(data).items():
+            damaged_path = Path(directory) / "damaged.ast"
+            damaged_path.write_bytes(damaged)
+            result = from_ast(cpec, damaged_path)
+            passed = result.returncode != 0 and "not a valid AST file" in result.stderr
+            failed |= not passed
+            print(f"{'ok  ' if passed else 'FAIL'} {name} is rejected")
+
+    return 1 if failed else 0
+
+if __name__ == "__main__":
+    sys.exit(main())
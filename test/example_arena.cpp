@@ -0,0 +1,33 @@
+struct Point {
+    real64 x
+    real64 y
+}
+
+// Allocated from the caller's arena, the squares outlive this call
+[mut i64] squares(mut arena numbers, i64 n)
+{
+    let values = new [mut i64](n) in numbers
+    mut i64 i = 0
+    while i < n {
+        values[i] = i * i
+        i += 1
+    }
+    return values
+}
+
+i64 sum_squares(i64 n)
+{
+    // Freed as a whole once the function returns
+    mut arena scratch
+    [i64] values = squares(scratch, n)
+    let zeros = new [i64](n) in scratch
+    let origin = new <Point> in scratch
+    mut i64 total = 0
+    for value in values {
+        total += value
+    }
+    for zero in zeros {
+        total += zero
+    }
+    return total
+}
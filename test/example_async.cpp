@@ -0,0 +1,43 @@
+generator i64 naturals(i64 n)
+{
+    mut i64 i = 0
+    while i < n {
+        yield i
+        i += 1
+    }
+}
+
+generator i64 squares(i64 n)
+{
+    for x in naturals(n) {
+        yield x * x
+    }
+}
+
+i64 sum_squares(i64 n)
+{
+    mut i64 total = 0
+    for x in squares(n) {
+        total += x
+    }
+    return total
+}
+
+// read_block comes from the host, both reads are started before either is awaited
+async i64 checksum(i64 first, i64 second)
+{
+    let a = read_block(first)
+    let b = read_block(second)
+    return await a + await b
+}
+
+async i64 pipeline(i64 n)
+{
+    mut i64 total = 0
+    mut i64 i = 0
+    while i < n {
+        total += await checksum(i, i + 1)
+        i += 1
+    }
+    return total
+}
@@ -0,0 +1,15 @@
+i32 sum([i32] values, i64 count)
+{
+    mut i32 total = 0
+    mut i64 i = 0
+    // walk every value
+    while i < count {
+        let value = at(values, i)
+        total += value * 2
+        i = i + 1
+    }
+    while (let left = count - i) > 0 && left != 3 {
+        i -= 1
+    }
+    return total
+}
@@ -0,0 +1,33 @@
+i64 sum([i64] values, i64 n)
+{
+    mut i64 total = 0
+    mut i64 i = 0
+    while i < n {
+        total += values[i]
+        i += 1
+    }
+    return total
+}
+
+i64 last([i64] values, i64 n) bounds(unchecked)
+{
+    return values[n - 1]
+}
+
+i8 scale([mut i64] values, i64 first, i64 factor) bounds(checked)
+{
+    values[first] *= factor
+    values[first + 1] = values[first] + 1
+    return 0
+}
+
+i64 sum_even([i64] values, i64 n)
+{
+    mut i64 total = 0
+    mut i64 i = 0
+    while i < n {
+        total += values[i]
+        i += 2
+    }
+    return total
+}
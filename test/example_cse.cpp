@@ -0,0 +1,23 @@
+i64 square(i64 x)
+{
+    return x * x
+}
+
+i64 steps(i64 n)
+{
+    mut i64 i = 0
+    while (square(n) - i * 2) > 0 && (square(n) - i * 2) < 100 {
+        i += 1
+    }
+    while (let a = square(n)) + (let b = square(n)) < square(n) + i {
+        i -= 1
+    }
+    while (let c = 3) + (let c = 3) < i {
+        i -= 1
+    }
+    // only evaluated when i > 0, stays where it is
+    while i > 0 && square(i) > 2 || square(i) < 1 {
+        i -= 1
+    }
+    return square(n + 1) + square(n + 1) * 2
+}
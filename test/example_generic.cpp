@@ -0,0 +1,26 @@
+const i32 lanes = 8
+const scale = lanes * 2
+
+const i64 square(i64 x)
+{
+    return x * x
+}
+
+generic T(i32, real32, real64)
+T sum([T] values, u64 count)
+{
+    const unroll = 4
+    mut T total = 0
+    mut u64 i = 0
+    while i < count {
+        total += at(values, i)
+        i += 1
+    }
+    return total
+}
+
+generic T
+T pick(bool first, T a, T b)
+{
+    return a
+}
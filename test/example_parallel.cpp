@@ -0,0 +1,37 @@
+i64 square(i64 x)
+{
+    return x * x
+}
+
+real64 dot([real64] a, [real64] b, i64 n)
+{
+    mut real64 total = 0
+    parallel for i in range(n) reduce(total) {
+        total += a[i] * b[i]
+    }
+    return total
+}
+
+i64 stats([i64] values, i64 n)
+{
+    mut i64 sum = 0
+    mut i64 product = 1
+    parallel for value in values reduce(sum, product) {
+        sum += square(value)
+        sum -= 1
+        product *= 1
+    }
+    parallel for i in range(2, n) reduce(sum) {
+        let s = i * 2
+        sum += s
+    }
+    return sum + product
+}
+
+i8 scale([mut i64] values, i64 factor)
+{
+    parallel for mut value in values {
+        value *= factor
+    }
+    return 0
+}
@@ -0,0 +1,27 @@
+enum Step u8 {
+    One = 1, Two
+}
+
+i64 fib(i64 n)
+{
+    mut i64 a = 0
+    mut i64 b = 1
+    mut i64 i = 0
+    while i < n {
+        let t = a + b
+        a = b
+        b = t
+        i += One
+    }
+    return a
+}
+
+i32 main(i64 n, [mut i64] rest)
+{
+    mut i64 total = fib(n)
+    rest[] = rest[] * Two
+    for value in rest {
+        total += value
+    }
+    return total % 256
+}
@@ -0,0 +1,30 @@
+real32 dot([real32] a, [real32] b)
+{
+    mut real32 total = 0
+    total += a[] * b[]
+    return total
+}
+
+i8 saxpy([mut real32] y, [real32] x, real32 alpha)
+{
+    y[] = alpha * x[] + y[]
+    for mut value in y align(64) {
+        let doubled = value * 2
+        value = doubled + 1
+    }
+    mut real32 largest = 0
+    for value in x {
+        largest = value
+    }
+    return 0
+}
+
+// b is an element short of a, walking the two together stops the program
+i8 mismatched(i64 n) bounds(checked)
+{
+    mut arena scratch
+    let a = new [mut real32](n) in scratch
+    let b = new [real32](n - 1) in scratch
+    a[] = a[] + b[]
+    return 0
+}
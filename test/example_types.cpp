@@ -0,0 +1,35 @@
+enum Kind u8 {
+    Idle
+    Moving = 4
+    Dead
+}
+
+struct Particle reorder soa {
+    mut i8 alive
+    mut real64 mass
+    Kind kind
+    mut real32 x
+    [real32] history
+}
+
+struct Header packed align(16) {
+    u8 tag
+    u32 length
+}
+
+union Bits {
+    mut u32 raw
+    mut real32 value
+}
+
+real64 total_mass([Particle] particles, <mut Particle> last)
+{
+    mut real64 total = 0
+    Particle first = at(particles, 0)
+    return total
+}
+
+bool same_kind(Particle a, mut Particle b, Header header)
+{
+    return true
+}
@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+
+# Runs cpec on generated inputs of doubling size for each construct and fails when time or memory grows
+# faster than about linearly. Usage: scaling.py <path to cpec>
+
+import math
+import re
+import subprocess
+import sys
+import tempfile
+import time
+from pathlib import Path
+
+# Growth exponent allowed between the two biggest sizes, 1 is linear
+max_exponent = 1.35
+# Runs per size, the fastest counts
+repeats = 5
+
+def deep_nesting(n):
+    opening = "(" * n
+    closing = ")" * n
+    return [f"i64 nested(i64 x)\n{{\n    return {opening}x{closing}\n}}\n"]
+
+# Long names and comments rather than long operator chains, every pass recurses down those as deep as they're long
+def long_lines(n):
+    name = "x" * n
+    comment = " x" * n
+    return [f"i64 long_line(i64 {name})\n{{\n    return {name} + {name} // {comment}\n}}\n"]
+
+def many_statements(n):
+    body = "".join(f"    total += {i}\n" for i in range(n))
+    return [f"i64 statements(i64 x)\n{{\n    mut i64 total = x\n{body}    return total\n}}\n"]
+
+def many_params(n):
+    params = ", ".join(f"i64 p{i}" for i in range(n))
+    return [f"i64 params({params})\n{{\n    return p0\n}}\n"]
+
+# Every error comes after a long valid prefix, printing it shouldn't look at more than the line it's on
+def many_errors(n):
+    prefix = "".join(f"i64 f{i}(i64 x)\n{{\n    return x\n}}\n" for i in range(n))
+    return [prefix + "i64 broken(i64 x\n{\n}\n" for i in range(8)]
+
+def crlf(n):
+    body = "".join(f"    total += {i}\r\n" for i in range(n))
+    return [f"i64 crlf(i64 x)\r\n{{\r\n    mut i64 total = x\r\n{body}    return total\r\n}}\r\n"]
+
+constructs = {
+    "deep nesting": (deep_nesting, 2000),
+    "long lines": (long_lines, 1000000),
+    "many statements": (many_statements, 20000),
+    "many params": (many_params, 4000),
+    "many errors": (many_errors, 4000),
+    "crlf": (crlf, 20000),
+}
+
+def run(cpec, files):
+    best_time = None
+    peak_memory = 0
+    for _ in range(repeats):
+        start = time.perf_counter()
+        result = subprocess.run([cpec, "--memory-stats", *files], stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True, errors="replace")
+        elapsed = time.perf_counter() - start
+        best_time = elapsed if best_time is None else min(best_time, elapsed)
+        match = re.search(r"^total\s+\d+ KB\s+(\d+) KB", result.stderr, re.MULTILINE)
+        if match:
+            peak_memory = int(match.group(1))
+    return best_time, peak_memory
+
+# How the measure grew with the size, x^1 when it doubled along with a doubled size
+def exponent(small, big):
+    if small <= 0 or big <= 0:
+        return 0
+    return math.log(big / small, 2)
+
+def main():
+    if len(sys.argv) != 2:
+        print("Usage: scaling.py <path to cpec>")
+        return 1
+    cpec = sys.argv[1]
+
+    failed = False
+    with tempfile.TemporaryDirectory() as directory:
+        for name, (generate, base) in constructs.items():
+            sizes = [base, base * 2, base * 4]
+            results = []
+            for size in sizes:
+                files = []
+                for i, source in enumerate(generate(size)):
+                    path = Path(directory) / f"{name.replace(' ', '_')}_{size}_{i}.cpe"
+                    path.write_bytes(source.encode())
+                    files.append(str(path))
+                results.append(run(cpec, files))
+
+            (small_time, small_memory), (big_time, big_memory) = results[-2], results[-1]
+            time_exponent = exponent(small_time, big_time)
+            memory_exponent = exponent(small_memory, big_memory)
+            timings = ", ".join(f"{size}: {elapsed * 1000:.1f} ms {memory} KB" for size, (elapsed, memory) in zip(sizes, results))
+            passed = time_exponent <= max_exponent and memory_exponent <= max_exponent
+            failed |= not passed
+            print(f"{'ok  ' if passed else 'FAIL'} {name}: time x^{time_exponent:.2f}, memory x^{memory_exponent:.2f} ({timings})")
+
+    return 1 if failed else 0
+
+if __name__ == "__main__":
+    sys.exit(main())